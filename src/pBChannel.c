@@ -0,0 +1,362 @@
+#
+/*******************************************************************************
+ *  Port -B- Logical Channels implementation
+ *  ----------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Several independent streams (commands, telemetry, debug log...) share
+ *  port -B-. Every channel has its own transmitter and receiver queues of
+ *  lines. A line of channel N is sent with a tag (CHANNEL_TAG, '0'+N)
+ *  before it, channel 0 (CHANNEL_CMD) lines are not tagged, so a terminal
+ *  talks to it as usual. Received lines are routed by the tag into the
+ *  receiver queue of the channel (untagged ones go to channel 0), a consumer
+ *  reads its own lines only.
+ *
+ *  The transmitter queues are fed into the port output queue by turns (a
+ *  line of each channel per *pBChannelPoll* step, while it fits), so a
+ *  noisy channel doesn't hold up the others. Channels keep the only input
+ *  request of the port and take *pBPoll* request callbacks (don't call
+ *  *pBInRequest* and *pBSetHandlers* in this mode).
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBChannelInit() - resets the channels, run after *pBInit*
+ *
+ *    pBChannelPush(nChannel, sLine) - queues a line to be sent by the
+ *      channel, returns 1/0 (successfully or overflow)
+ *
+ *    pBChannelRead(nChannel, sBuffer, nSize) - takes the oldest line received
+ *      by the channel into *sBuffer*, returns 1/0 (a line or nothing)
+ *
+ *    pBChannelPending(nChannel) - returns number of received lines waiting
+ *
+ *    pBChannelPoll() - feeds the port, keeps the input request and services
+ *      the port once (*pBPoll*), returns *pBPoll* events mask
+ *
+ *    pBChannelStat(nChannel, pStat) - copies the channel counters
+ *
+ *    pBChannelSetOverflow(nChannel, nPolicy) - sets what the channel queues
+ *      do when full: OVERFLOW_REJECT (new lines, default) or
+ *      OVERFLOW_DROP_OLDEST (old lines are dropped, the freshest kept).
+ *
+ *  Sample:
+ *  -------
+ *
+ *  ...    pBInit(0, 0);
+ *  ...    pBChannelInit();
+ *  ...    pBChannelPush(CHANNEL_TELEMETRY, "T=25.1");
+ *  ...    while( events ) {
+ *  ...        pBChannelPoll();
+ *  ...        if( pBChannelRead(CHANNEL_CMD, s, sizeof(s)) ) ...;
+ *  ...    }
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <string.h>
+
+#include "..\config.h"
+
+#include "pBController.h"
+#include "pBChannel.h"
+
+#include "..\common\pBCommon.h"
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+                                        // channels lines storage
+char  aChannelTx[CHANNELS][CHANNEL_TX_ITEMS * CHANNEL_LINE_SIZE];
+char  aChannelRx[CHANNELS][CHANNEL_RX_ITEMS * CHANNEL_LINE_SIZE];
+
+TChannelQueue aTxQueues[CHANNELS];      // transmitter queues
+TChannelQueue aRxQueues[CHANNELS];      // receiver queues
+TChannelStat  aChannelStat[CHANNELS];
+
+                                        // port input request buffer
+char  sChannelIn[CHANNEL_TAG_SIZE + CHANNEL_LINE_SIZE];
+int   IsChannelListen = 0;              // input request is in the port queue
+int   nChannelNext = 0;                 // transmitter turn (round robin)
+
+// *****************************************************************************
+//  CHANNELS QUEUES (PRIVATE)
+// *****************************************************************************
+
+char *_channelLine( TChannelQueue *pq, int i ) {
+//
+//  Get *i*-th line of the queue (from the oldest one).
+//
+    return pq->pLines + ( (pq->nHead + i) % pq->nItems ) * CHANNEL_LINE_SIZE;
+}
+
+int _channelDropOldest( TChannelQueue *pq ) {
+//
+//  Drop the oldest line of the full queue (OVERFLOW_DROP_OLDEST).
+//  --------------------------------------------------------------
+//
+//  Returns:
+//
+//      1/0 - dropped or not (the queue isn't full or policy is reject).
+//
+    if( pq->nCount < pq->nItems || pq->nPolicy != OVERFLOW_DROP_OLDEST )
+        return 0;
+
+    pq->nHead = (pq->nHead + 1) % pq->nItems;
+    --pq->nCount;
+    return 1;
+}
+
+int _channelPut( TChannelQueue *pq, char *s, int n ) {
+//
+//  Put a line into the queue (it's cut to CHANNEL_LINE_SIZE).
+//  ----------------------------------------------------------
+//
+//  Returns:
+//
+//      1/0 - successfully or overflow.
+//
+    char *p;
+
+    if( pq->nCount >= pq->nItems )
+        return 0;
+
+    if( n > CHANNEL_LINE_SIZE-1 ) n = CHANNEL_LINE_SIZE-1;
+
+    p = _channelLine( pq, pq->nCount );
+    memcpy( p, s, n );
+    p[n] = '\0';
+
+    ++pq->nCount;
+    return 1;
+}
+
+void _channelFeed() {
+//
+//  Move lines from the channels into the port output queue.
+//  --------------------------------------------------------
+//  A line of each channel by turns, stops when the port queue is full.
+//
+    char s[CHANNEL_TAG_SIZE + CHANNEL_LINE_SIZE + SIZE_OFFSET];
+    TChannelQueue *pq;
+    int i, ch, n;
+
+    for( i=0; i<CHANNELS; i++ ) {
+        ch = (nChannelNext + i) % CHANNELS;
+        pq = &aTxQueues[ch];
+        if( !pq->nCount ) continue;
+
+    //  tag the line (channel 0 is not tagged)
+        n = 0;
+        if( ch != CHANNEL_CMD ) {
+            s[n++] = CHANNEL_TAG;
+            s[n++] = '0' + ch;
+        }
+        strcpy( s+n, _channelLine(pq, 0) );
+
+        if( !pBPush(s, 1, 0) )
+            break;
+
+        pq->nHead = (pq->nHead + 1) % pq->nItems;
+        --pq->nCount;
+        ++aChannelStat[ch].nTxItems;
+    }
+
+    nChannelNext = (nChannelNext + 1) % CHANNELS;
+}
+
+void _channelRoute( char *sLine ) {
+//
+//  Route received line into the receiver queue of its channel.
+//  -----------------------------------------------------------
+//  It's input request done callback (*pBPoll*).
+//
+    char *p = sLine, *pe;
+    int ch = CHANNEL_CMD;
+
+//  the line ends at "\r" of the peer delimeter ("\n\r"), its "\n" is left
+//  at the end of the line, "\n" of a "\r\n" peer comes at the beginning
+    while( *p == '\n' ) ++p;
+    pe = p + strlen(p);
+    while( pe > p && ( pe[-1] == '\n' || pe[-1] == '\r' ) )
+        *--pe = '\0';
+
+    if( p[0] == CHANNEL_TAG && p[1] >= '0' && p[1] < '0' + CHANNELS ) {
+        ch = p[1] - '0';
+        p += CHANNEL_TAG_SIZE;
+    }
+
+//  empty lines (bare delimeters) are skipped
+    if( *p ) {
+        if( _channelDropOldest(&aRxQueues[ch]) )
+            ++aChannelStat[ch].nRxDropped;
+        if( _channelPut(&aRxQueues[ch], p, strlen(p)) )
+            ++aChannelStat[ch].nRxItems;
+        else
+            ++aChannelStat[ch].nRxDropped;
+    }
+
+//  listen to the next line
+    IsChannelListen = 0;
+    _channelListen();
+}
+
+void _channelListen() {
+//
+//  Keep an input request in the port queue.
+//
+    int code;
+
+    if( IsChannelListen )
+        return;
+
+    code = pBInRequest( sChannelIn, sizeof(sChannelIn) );
+
+    if( code == PB_OK )
+        _channelRoute( sChannelIn );
+    else if( code != PB_ERR_OVERFLOW && code != PB_ERR_UNDEFINED && code < PB_OK )
+        IsChannelListen = 1;
+}
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+void pBChannelInit() {
+//
+//  Reset the channels.
+//  -------------------
+//  Queues are cleaned, port input request callback is taken by channels.
+//
+    int ch;
+
+    for( ch=0; ch<CHANNELS; ch++ ) {
+        aTxQueues[ch].pLines = aChannelTx[ch];
+        aTxQueues[ch].nItems = CHANNEL_TX_ITEMS;
+        aTxQueues[ch].nHead = aTxQueues[ch].nCount = 0;
+        aTxQueues[ch].nPolicy = OVERFLOW_REJECT;
+
+        aRxQueues[ch].pLines = aChannelRx[ch];
+        aRxQueues[ch].nItems = CHANNEL_RX_ITEMS;
+        aRxQueues[ch].nHead = aRxQueues[ch].nCount = 0;
+        aRxQueues[ch].nPolicy = OVERFLOW_REJECT;
+
+        memset( &aChannelStat[ch], 0, sizeof(TChannelStat) );
+    }
+
+    IsChannelListen = 0;
+    nChannelNext = 0;
+
+    pBSetHandlers( 0, _channelRoute );
+}
+
+int pBChannelPush( int nChannel, char *sLine ) {
+//
+//  Queue a line into the channel transmitter.
+//  ------------------------------------------
+//
+//  Arguments:
+//
+//      nChannel -- channel number (0..CHANNELS-1)
+//
+//      sLine -- line to send (without delimeters).
+//
+//  Returns:
+//
+//      1/0 - successfully or overflow (too long line as well).
+//
+    int n;
+
+    if( nChannel < 0 || nChannel >= CHANNELS || !sLine )
+        return 0;
+
+    n = strlen(sLine);
+    if( n && n <= CHANNEL_LINE_SIZE-1 && _channelDropOldest(&aTxQueues[nChannel]) )
+        ++aChannelStat[nChannel].nTxDropped;
+    if( !n || n > CHANNEL_LINE_SIZE-1 || !_channelPut(&aTxQueues[nChannel], sLine, n) ) {
+        ++aChannelStat[nChannel].nTxRejected;
+        return 0;
+    }
+
+    return 1;
+}
+
+int pBChannelRead( int nChannel, char *sBuffer, int nSize ) {
+//
+//  Take the oldest line received by the channel.
+//  ---------------------------------------------
+//
+//  Arguments:
+//
+//      nChannel -- channel number
+//
+//      sBuffer -- buffer pointer
+//
+//      nSize -- buffer size (the line is cut to it).
+//
+//  Returns:
+//
+//      1/0 - a line or nothing.
+//
+    TChannelQueue *pq;
+
+    if( nChannel < 0 || nChannel >= CHANNELS || nSize <= 0 )
+        return 0;
+
+    pq = &aRxQueues[nChannel];
+    if( !pq->nCount )
+        return 0;
+
+    strncpy( sBuffer, _channelLine(pq, 0), nSize-1 );
+    sBuffer[nSize-1] = '\0';
+
+    pq->nHead = (pq->nHead + 1) % pq->nItems;
+    --pq->nCount;
+
+    return 1;
+}
+
+int pBChannelPending( int nChannel ) {
+    if( nChannel < 0 || nChannel >= CHANNELS )
+        return 0;
+    return aRxQueues[nChannel].nCount;
+}
+
+int pBChannelPoll() {
+//
+//  *** CHANNELS LOOP STEP ***
+//  --------------------------
+//  Feeds the port output queue, keeps the input request and services the
+//  port once.
+//
+//  Returns:
+//
+//      Mask of happened events (PB_EVENT_..., see *pBPoll*).
+//
+    _channelFeed();
+    _channelListen();
+
+    return pBPoll();
+}
+
+void pBChannelStat( int nChannel, TChannelStat *pStat ) {
+    if( nChannel >= 0 && nChannel < CHANNELS )
+        *pStat = aChannelStat[nChannel];
+}
+
+void pBChannelSetOverflow( int nChannel, int nPolicy ) {
+//
+//  Set overflow policy of the channel queues.
+//  ------------------------------------------
+//  OVERFLOW_DROP_OLDEST keeps the freshest lines (telemetry samples), the
+//  oldest ones are dropped and counted, OVERFLOW_REJECT (default) rejects
+//  new lines. Channels don't block, OVERFLOW_BLOCK is taken as reject.
+//
+    if( nChannel < 0 || nChannel >= CHANNELS )
+        return;
+
+    aTxQueues[nChannel].nPolicy = aRxQueues[nChannel].nPolicy = nPolicy;
+}
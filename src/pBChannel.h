@@ -0,0 +1,70 @@
+#
+/*******************************************************************************
+ *  Port -B- Logical Channels header file
+ *  -------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBCHANNEL__
+#define __PBCHANNEL__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define CHANNELS                 4        // logical channels over port -B-
+#define CHANNEL_CMD              0        // commands (untagged lines)
+#define CHANNEL_TELEMETRY        1        // telemetry
+#define CHANNEL_LOG              2        // debug log
+#define CHANNEL_USER             3        // application defined
+
+#define CHANNEL_TAG              0x1E     // tag prefix (RS), followed by '0'+channel
+#define CHANNEL_TAG_SIZE         2        // tag size (bytes)
+
+#define CHANNEL_LINE_SIZE        128      // max line size (with terminator)
+#define CHANNEL_TX_ITEMS         8        // transmitter queue of a channel (lines)
+#define CHANNEL_RX_ITEMS         8        // receiver queue of a channel (lines)
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef struct {                          // lines queue of a channel (ring)
+    char *pLines;                         // lines storage (nItems * CHANNEL_LINE_SIZE)
+    int   nItems;                         // capacity (lines)
+    int   nHead;                          // the oldest line
+    int   nCount;                         // lines in the queue
+    int   nPolicy;                        // overflow policy (OVERFLOW_REJECT/DROP_OLDEST)
+} TChannelQueue;
+
+typedef struct {                          // channel counters
+    unsigned long nTxItems;               // lines handed to the port
+    unsigned long nTxRejected;            // lines rejected (queue overflow)
+    unsigned long nTxDropped;             // old lines dropped (OVERFLOW_DROP_OLDEST)
+    unsigned long nRxItems;               // lines routed to the channel
+    unsigned long nRxDropped;             // lines dropped (queue overflow, new or old ones)
+} TChannelStat;
+//
+//  Private --------------------------------------------------------------------
+//
+char *_channelLine        ( TChannelQueue *, int );
+int   _channelPut         ( TChannelQueue *, char *, int );
+int   _channelDropOldest  ( TChannelQueue * );
+void  _channelFeed        ( void );
+void  _channelRoute       ( char * );
+void  _channelListen      ( void );
+//
+//  Public (client interface) --------------------------------------------------
+//
+void  pBChannelInit       ( void );             // reset channels, take port request callbacks
+int   pBChannelPush       ( int, char * );      // queue a line into channel transmitter
+int   pBChannelRead       ( int, char *, int ); // take a line received by the channel
+int   pBChannelPending    ( int );              // lines waiting in channel receiver
+int   pBChannelPoll       ( void );             // service channels and port once
+void  pBChannelStat       ( int, TChannelStat * ); // get channel counters
+void  pBChannelSetOverflow( int, int );         // set channel queues overflow policy
+
+#endif
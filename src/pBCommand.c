@@ -0,0 +1,174 @@
+#
+/*******************************************************************************
+ *  Port -B- Commands Dispatcher implementation
+ *  -------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Commands table gets a line (received from the port, for instance) and
+ *  calls the handler of matched command. The table is sorted once by
+ *  *pBCommandInit*, so a line is dispatched by binary search (log of
+ *  commands number) instead of comparing it with every command. The line
+ *  isn't copied, a handler takes arguments as a pointer inside of it.
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBCommandInit(pTable, pCommands, nCommands, pDefault) - makes the table
+ *      with given commands array (it's sorted in place), *pDefault* handler
+ *      takes unknown lines (NULL - ignore them)
+ *
+ *    pBCommandDispatch(pTable, sLine) - finds the command and calls its
+ *      handler, returns command index or CMD_NOT_FOUND
+ *
+ *    pBCommandFind(pTable, sLine) - returns matched command or NULL.
+ *
+ *  Matching: a line matches the command if it starts with the name and the
+ *  name is followed by the end of line (CMD_EXACT, CMD_ARGS) or by a space
+ *  (CMD_ARGS only, rest of the line is arguments). The longest name wins
+ *  ("tr on" before "tr").
+ *
+ *  Sample:
+ *  -------
+ *
+ *  ...    TCommand commands[] = {
+ *  ...        { "exit", CMD_EXACT, OnExit },
+ *  ...        { "push", CMD_ARGS,  OnPush },
+ *  ...    };
+ *  ...    TCommandTable table;
+ *  ...    pBCommandInit(&table, commands, 2, OnUnknown);
+ *  ...    pBCommandDispatch(&table, s);
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pBCommand.h"
+
+// *****************************************************************************
+//  COMMANDS TABLE (PRIVATE)
+// *****************************************************************************
+
+int _cmpCommandNames( const void *p1, const void *p2 ) {
+//
+//  Compare commands by name (*qsort*).
+//
+    return strcmp( ((TCommand *)p1)->sName, ((TCommand *)p2)->sName );
+}
+
+int _matchCommand( TCommand *pCommand, char *sLine ) {
+//
+//  Check the line matches the command.
+//  -----------------------------------
+//
+//  Returns:
+//
+//      1/0 -- matched or not.
+//
+    char c;
+
+    if( strncmp(sLine, pCommand->sName, pCommand->nLength) )
+        return 0;
+
+    c = sLine[pCommand->nLength];
+
+    return ( c == '\0' || ( c == ' ' && pCommand->nMode == CMD_ARGS ) ) ? 1:0;
+}
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+void pBCommandInit( TCommandTable *pTable, TCommand *pCommands, int nCommands, TCommandHandler pDefault ) {
+//
+//  Make commands table.
+//  --------------------
+//  Should be ran once before dispatching.
+//
+//  Arguments:
+//
+//      pTable -- table to initialize
+//
+//      pCommands -- commands array (sorted by name in place)
+//
+//      nCommands -- commands counter
+//
+//      pDefault -- handler of unknown lines (or NULL).
+//
+    int i;
+
+    for( i=0; i<nCommands; i++ )
+        pCommands[i].nLength = strlen(pCommands[i].sName);
+
+    qsort( pCommands, nCommands, sizeof(TCommand), _cmpCommandNames );
+
+    pTable->pCommands = pCommands;
+    pTable->nCommands = nCommands;
+    pTable->pDefault = pDefault;
+}
+
+TCommand *pBCommandFind( TCommandTable *pTable, char *sLine ) {
+//
+//  Find the command matched by the line.
+//  -------------------------------------
+//  Binary search of the last name not greater than the line, then back
+//  to the longest name which is the line beginning.
+//
+//  Returns:
+//
+//      Command pointer or NULL.
+//
+    TCommand *pc = pTable->pCommands;
+    int lo = 0, hi = pTable->nCommands, mid;
+
+    while( lo < hi ) {
+        mid = (lo + hi) >> 1;
+        if( strcmp(pc[mid].sName, sLine) <= 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    while( --lo >= 0 && pc[lo].sName[0] == sLine[0] ) {
+        if( _matchCommand(&pc[lo], sLine) )
+            return &pc[lo];
+    }
+
+    return 0;
+}
+
+int pBCommandDispatch( TCommandTable *pTable, char *sLine ) {
+//
+//  Dispatch the line to the command handler.
+//  -----------------------------------------
+//
+//  Arguments:
+//
+//      pTable -- commands table
+//
+//      sLine -- command line (received data buffer).
+//
+//  Returns:
+//
+//      Command index or CMD_NOT_FOUND.
+//
+    TCommand *pc;
+    char *sArgs;
+
+    if( !(pc = pBCommandFind(pTable, sLine)) ) {
+        if( pTable->pDefault ) (*pTable->pDefault)( sLine, sLine );
+        return CMD_NOT_FOUND;
+    }
+
+//  arguments follow the name
+    sArgs = sLine + pc->nLength;
+    while( *sArgs == ' ' ) ++sArgs;
+
+    (*pc->pHandler)( sLine, sArgs );
+
+    return (pc - pTable->pCommands);
+}
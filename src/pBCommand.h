@@ -0,0 +1,53 @@
+#
+/*******************************************************************************
+ *  Port -B- Commands Dispatcher header file
+ *  ----------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBCOMMAND__
+#define __PBCOMMAND__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define CMD_EXACT                0        // command line should be equal to the name
+#define CMD_ARGS                 1        // arguments are allowed after the name
+
+#define CMD_NOT_FOUND           -1        // dispatch status: no command matched
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef void (*TCommandHandler)( char *, char * ); // (command line, arguments)
+
+typedef struct {                          // command
+    char *sName;                          // name (verb, may contain spaces)
+    int   nMode;                          // CMD_EXACT/CMD_ARGS
+    TCommandHandler pHandler;             // command handler
+    int   nLength;                        // name length (by *pBCommandInit*)
+} TCommand;
+
+typedef struct {                          // commands table
+    TCommand *pCommands;                  // commands (sorted by name)
+    int   nCommands;                      // commands counter
+    TCommandHandler pDefault;             // handler of unknown lines (or NULL)
+} TCommandTable;
+//
+//  Private --------------------------------------------------------------------
+//
+int   _cmpCommandNames    ( const void *, const void * );
+int   _matchCommand       ( TCommand *, char * );
+//
+//  Public (client interface) --------------------------------------------------
+//
+void  pBCommandInit       ( TCommandTable *, TCommand *, int, TCommandHandler );
+int   pBCommandDispatch   ( TCommandTable *, char * );
+TCommand *pBCommandFind   ( TCommandTable *, char * );
+
+#endif
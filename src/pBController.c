@@ -17,13 +17,31 @@
  *      run first before any usages, arguments points type of IRQ mode (1/0,
  *      EIRC/EITR, receiver/transmiter, enable/disable)
  *
+ *    pBInitEx(IsEIRCEnable, IsEITREnable, pMemory) - the same as *pBInit*,
+ *      argument *pMemory* points caller provided storage and capacities of the
+ *      transmitter queue, receiver queue and trace log (TPortMemory), null
+ *      pointers or sizes take static defaults (OUTPUT_SIZE, MAX_INPUT_ITEMS_COUNTER,
+ *      LOGGER_SIZE), a trace log smaller than LOGGER_SIZE fails; *pBInit*
+ *      goes back to the defaults; with PB_EXTERNAL_QUEUES the static queues
+ *      and trace log are not allocated, all of them should be given
+ *
  *    pBTerm() - port default settings (termination), run last after any usages
  *
  *    pBOutRequest(fmt, ...) - queuering an output request (basic method),
  *      arguments fully compatible with *printf*, we can parse data
  *      by format string with any provided usages (%c, %s, %d, %x, %b ...),
  *      the function pushes a new item in the port's queue and starts
- *      transmitting from the first queue position
+ *      transmitting from the first queue position, with PB_LIGHT_FORMAT
+ *      the text is made by the bounded formatter (see pBFormat.c), it's
+ *      cut to the item size and supports %c %s %d %i %u %x %X %o %b %%
+ *      with '-', '0', '+', ' ' and '#' flags, width, precision and 'l'
+ *
+ *    pBDeferRequest(fmt, ...) - the same as *pBOutRequest*, but the text
+ *      is rendered by bytes at transmit time: the queue keeps a mark and a
+ *      record of the format pointer and arguments (DEFER_ITEMS), so the
+ *      format and %s strings should live up to the request is sent, formats
+ *      with float, %s width or more than DEFER_ARGS arguments are formatted
+ *      at once (PB_DEFERRED)
  *
  *    pBPush(sItem, IsNewLine, IsLog) - another way to push request (we can separate
  *      off queuering and transmitting steps by way of anticipatory filling
@@ -31,6 +49,76 @@
  *      pushes standard line delimeters ("\n\r") into request body, *IsLog*
  *      implemented to make logging, queue is an ordered list (FIFO)
  *
+ *    pBPushv(pParts, nParts) - pushes one request gathered from *nParts*
+ *      parts (TOutPart, data and size, negative size - a string), parts are
+ *      copied one after another into the queue item with a single overflow
+ *      check and line delimeters at the end, returns 1/0 (successfully or
+ *      overflow), so a message of header, payload and trailer is never
+ *      interleaved with other pushes
+ *
+ *    pBTxFree() - returns free space of the output queue (bytes), the space
+ *      reserved by *pBReserve* is excluded (PB_SLAB_QUEUE: bytes of free
+ *      pool items of all the size classes, a single item may not fit it)
+ *
+ *    pBReserve(nSize) - reserves output queue space for an item of *nSize*
+ *      bytes, the next *pBPush* of an item not longer takes the reservation,
+ *      longer ones can't use its space, returns 1/0 (reserved or overflow),
+ *      zero size cancels the reservation
+ *
+ *    pBSetLowWatermark(nLevel, pHandler) - registers *pHandler* callback,
+ *      it's called with the free space when the output queue drains below
+ *      *nLevel* bytes (once per crossing), NULL handler disables it
+ *
+ *    pBSetOverflow(nPolicy, nTimeout) - sets what a push does when the output
+ *      queue is full: OVERFLOW_REJECT (returns overflow, default),
+ *      OVERFLOW_DROP_OLDEST (drops the oldest items not being sent up to the
+ *      new one fits, a producer never waits), OVERFLOW_BLOCK (waits for the
+ *      transmitter up to *nTimeout*, the push calls *pBSend* meanwhile, not
+ *      for interrupt handlers); an item the empty queue doesn't fit is
+ *      rejected at once, nothing is dropped or waited for
+ *
+ *    pBGetOverflow(pStat, IsReset) - copies counters of dropped and rejected
+ *      items and bytes and blocked pushes (TOverflowStat), *IsReset* (1/0)
+ *      cleans them after
+ *
+ *    pBSetAdaptive(nHigh, nLow, nWindow) - adaptive interrupts mode: when
+ *      a load window (*nWindow* cycles) holds *nHigh* bytes or more, enabled
+ *      EIRC/EITR are masked and *pBPoll* takes bytes in batches (PB_ADAPT_BATCH),
+ *      after PB_ADAPT_QUIET windows of *nLow* bytes or less the interrupts
+ *      are enabled again, phases are switched between requests, negative
+ *      *nHigh* turns the mode off (PB_ADAPTIVE_IRQ)
+ *
+ *    pBGetAdaptive(pStat, IsReset) - copies current phase and counters of
+ *      switches, windows and polled bytes (TAdaptStat)
+ *
+ *    pBSetFlow(nMode, nHigh, nLow) - flow control: FLOW_XONXOFF sends XOFF
+ *      to the peer when *nHigh* bytes are held (taken from RXD while the
+ *      transmitter is busy or waited for, a push is blocked or there's no
+ *      input request, FLOW_HOLD_SIZE at most) and XON when *nLow* or less
+ *      are left, an XOFF received pauses the transmitter up to XON;
+ *      FLOW_RTSCTS calls the flow hook instead (Port B has no modem lines);
+ *      FLOW_NONE turns it off (PB_FLOW_CONTROL)
+ *
+ *    pBSetFlowHook(pHandler) - sets RTS line handler of FLOW_RTSCTS mode,
+ *      called with 1/0 (peer may send or not)
+ *
+ *    pBGetFlow(pStat, IsReset) - copies current stop states, held bytes and
+ *      counters of XON/XOFF sent and taken and transmitter pauses (TFlowStat)
+ *
+ *    pBLastRequest(mode) - returns handle of the latest request queued by
+ *      *pBOutRequest*, *pBPush*... (MODE_TX) or *pBInRequest* (MODE_RX),
+ *      REQUEST_NONE if the latest one was rejected (overflow, port error)
+ *
+ *    pBStatus(hRequest) - returns request state: REQUEST_QUEUED,
+ *      REQUEST_ACTIVE (being sent or received), REQUEST_FINISHED (done,
+ *      cancelled or dropped) or REQUEST_UNKNOWN
+ *
+ *    pBCancel(hRequest) - removes the queued request (not active one),
+ *      returns 1/0 (cancelled or not)
+ *
+ *    pBFlushTx(), pBFlushRx() - drop all queued output (input) requests but
+ *      the active one, the port isn't reset, return number of dropped
+ *
  *    pBSend(start) - call to port transmitter, sends currently pointed
  *      byte through RXD register, argument *start* (1/0) specifies visibility usage
  *      only (1 - puts new line '\n' before any item, designed for IRQ
@@ -43,11 +131,37 @@
  *      allowed and pointed to take one symbol only, pressing *Enter*
  *      for instance)
  *
+ *    pBInRequestEx(sItem, nMaxSize, pOptions) - the same for binary data
+ *      (PB_RX_MODES): every byte is kept (NUL included, no *Enter*), the
+ *      request is done after *nCount* bytes (IN_COUNT), by a byte of the
+ *      *sDelimiters* set (IN_DELIMITERS, kept in the data), when the line
+ *      is idle for *nGapChars* character times (IN_GAP, the peer held by
+ *      flow control doesn't count) or when the buffer is full; *nReceived*
+ *      and *nEnd* (IN_END_...) of the options are set at the end, the
+ *      options are kept by the caller up to it
+ *
  *    pBReceive(start) - call to port receiver, takes a byte from the RXD
  *      register, argument *start* (1/0) specifies for compatibility issue
  *      with *pBSend*, returns finalization code (1/0) or an error as a
  *      negative value (see pBCommon.h, "Callback status code")
  *
+ *    pBPoll() - services the port once: transmitter and receiver by turns
+ *      (a byte each, no waiting), requests done callbacks and one of user
+ *      tasks, returns mask of events happened (PB_EVENT_...), designed to be
+ *      called in the application loop instead of *pBSend* and *pBReceive*;
+ *      the turns are taken between requests, the port is half-duplex: an
+ *      item being sent (received) keeps the other direction waiting up to
+ *      its end (with PB_FLOW_CONTROL bytes coming meanwhile are held and the
+ *      peer is stopped, see *pBSetFlow*)
+ *
+ *    pBSetHandlers(pTxDone, pRxDone) - registers callbacks called by *pBPoll*
+ *      when an output request (NULL argument) or an input request (its
+ *      buffer) is done
+ *
+ *    pBAddTask(pTask, pArg), pBRemoveTask(pTask) - registers (unregisters)
+ *      lightweight user task, *pBPoll* calls one task per step (round robin),
+ *      returns 1/0 (successfully or not)
+ *
  *    pBIsIRQEnabled(mode) - returns set-point IRQ state (1/0, enable/disable),
  *      argument *mode* is type of line (1/0, EIRC/EITR, receiver or
  *      transmitter)
@@ -55,6 +169,41 @@
  *    pBGetchar() - gets *stdin* character (DEBUG), provided for IRQ
  *      handling
  *
+ *    pBGetErrors(pErrors, IsReset) - copies line errors counters (parity,
+ *      framing, overrun, discarded lines) into *pErrors*, *IsReset* (1/0)
+ *      cleans the counters after (PB_ERROR_RECOVERY)
+ *
+ *    pBGetPoolStat(pClasses) - copies occupancy of the output items pool
+ *      size classes (item size, count, used, max used, failures) into
+ *      *pClasses* array, returns number of classes (PB_SLAB_QUEUE)
+ *
+ *    pBGetLatency(IsIRQ, nKind, pLatency, IsReset) - copies log2 histogram
+ *      (cycles) of requests latency: output queued to the first/last byte
+ *      sent (LATENCY_TX_WAIT/TX_DONE), input queued to the first byte and the
+ *      first byte to done (LATENCY_RX_WAIT/RX_DONE), in IRQ or polled mode,
+ *      returns number of requests (PB_LATENCY)
+ *
+ *    pBSetIdle(pHandler) - sets idle strategy called while waiting for the
+ *      port (after PB_IDLE_SPINS passes), it sleeps up to the next interrupt
+ *      (*wait* instruction by default), NULL handler keeps spinning, returns
+ *      previous handler; the receiver (and a push blocked by OVERFLOW_BLOCK)
+ *      waits idle only with EIRC enabled (a byte wakes the CPU up), polled
+ *      one always spins
+ *
+ *    pBIdle(pSpins) - a pass of a waiting loop (spins, then goes idle),
+ *      *pSpins* is the loop passes counter, returns passes it's counted for
+ *
+ *    pBSelfTest(pResults) - loopback self-test and link benchmark, streams
+ *      a pattern through *TXD* and *RXD* with *CNR->LOOP* at every speed of
+ *      *RS232_Speeds*, keeps bytes/s, cycles per byte and errors counters
+ *      into *pResults* (TSelfTest, a speed each), returns number of errors
+ *      (PB_SELF_TEST)
+ *
+ *    pBTraceStart(pMemory, nSize), pBTraceStop() - records registers
+ *      accesses with cycle stamps, interrupts and client calls into the given
+ *      memory, the image is replayed through the driver on the host by
+ *      *pBReplayRun* (PB_REGISTER_TRACE, PB_REGISTER_REPLAY, see pBTrace.c)
+ *
  *    pBPrintf(log) - puts *stdout* messages log (DEBUG), provided for IRQ
  *      handling.
  *
@@ -91,12 +240,27 @@
  *  ... // the input request was done, command was received
  *  ...        if( code == PB_OK ) ...;
  *  ...    }
+ *  ... // or let the driver run the loop ('OnLine' is input request callback)
+ *  ...    pBSetHandlers(0, OnLine);
+ *  ...    while( events ) pBPoll();
  *  ... // restore PMON exceptions handler (XXX)
  *  ...    DeinitExcept();
  *  ... // terminate port -B-
  *  ...    pBTerm();
  *
- *  Assembly: see '..\pBController\start.c' example.
+ *  Assembly: see '..\pBController\start.c' example. With PB_FAST_TEXT the
+ *  port ready checks, *pBSend*, *pBReceive* and their per byte helpers go
+ *  into .fasttext section, ROM layouts copy it into RAM at startup (see
+ *  standalone_romrun.ld), the port ISR of the application should be put
+ *  there too (#pragma ghs section text=".fasttext"). With PB_HOT_STATE the
+ *  queue pointers and counters, port mode, timeout and registers base are
+ *  fields of one aligned block (*port_hot*) in the small data area, .sdata
+ *  (gp-relative) or .zdata with PB_HOT_ZDA, *isr_pb_state* goes next to it,
+ *  *BaseAddress* is kept for the application ISR, the old variable names
+ *  are macros for the fields with PB_PORT_INTERNALS only. Host (Linux gateway)
+ *  build with several pushing threads: see pBHost.c, the driver is called
+ *  by its service thread only. Registers model on a pty for serial tools
+ *  (pacing at the line speed on/off): see pBPty.c.
  *
  *  v 1.03, 15/01/2010, ichar.
  *
@@ -108,7 +272,14 @@
 
 #include "..\config.h"
 
+#define PB_PORT_INTERNALS               // hot state names (PB_HOT_STATE)
 #include "pBController.h"
+#ifdef PB_LIGHT_FORMAT
+#include "pBFormat.h"
+#endif
+#if defined(PB_REGISTER_TRACE) || defined(PB_REGISTER_REPLAY)
+#include "pBTrace.h"
+#endif
 
 #include "..\common\pBCommon.h"
 #include "..\common\pBIRQ.h"
@@ -121,15 +292,46 @@ unsigned char *BaseAddress;             // registers area base pointer
 unsigned char  pb_cnr_saved;            // saved *CNR* register
 unsigned char  pb_ier_saved;            // saved *IER* register
 
+#ifdef PB_HOT_STATE
+                                        // hot state block, gp-relative (.sdata)
+                                        // or zero page (.zdata, PB_HOT_ZDA) access
+#ifdef PB_HOT_ZDA
+#pragma ghs startzda
+#else
+#pragma ghs startsda
+#endif
+#pragma alignvar (8)
+TPortHot port_hot = { 0, 0, 0, 0, 0, 0, 0, MODE_NONE, DEFAULT_TIMEOUT };
 unsigned char  isr_pb_state;            // port interrupt reason (*ISR_PB*)
+#ifdef PB_HOT_ZDA
+#pragma ghs endzda
+#else
+#pragma ghs endsda
+#endif
+#else
+unsigned char  isr_pb_state;            // port interrupt reason (*ISR_PB*)
+#endif
 
 #ifdef PB_USE_LOGGER
+#ifndef PB_EXTERNAL_QUEUES
 char  msg[LOGGER_SIZE];                 // trace messages log
+char *pLogger = msg;                    // current trace messages log
+#else
+char *pLogger = 0;
+#endif
 #endif
 
+#ifndef PB_HOT_STATE
 int   port_mode = MODE_NONE;            // port direction mode
+int   nPortTimeout = DEFAULT_TIMEOUT;   // ready state waiting timeout (no IRQ)
+#endif
 unsigned char  rx;                      // auxiliary
 
+#ifdef PB_ERROR_RECOVERY
+int   rx_state = RX_STATE_DATA;         // receiver line state
+TPortErrors port_errors;                // line errors counters
+#endif
+
 // *****************************************************************************
 //  RS232 PORT -B- SPECIFICATIONS
 // *****************************************************************************
@@ -147,21 +349,126 @@ char *RS232_SpeedsStr[2][3] = {
 //  DATA INPUT QUEUE (INPUT REQUESTS)
 // *****************************************************************************
                                         // input queue and pointers (FIFO)
-TInItem aInItemsQueue[MAX_INPUT_ITEMS_COUNTER], *pInItemsQueue, *pInNext;
-TInItem null_in_item = { 0, 0 };
+#ifndef PB_EXTERNAL_QUEUES
+TInItem aInItemsQueue[MAX_INPUT_ITEMS_COUNTER];
+TInItem *pInQueueBase = aInItemsQueue;  // queue storage
+int   nInQueueSize = MAX_INPUT_ITEMS_COUNTER;
+#else
+TInItem *pInQueueBase = 0;
+int   nInQueueSize = 0;
+#endif
+#ifndef PB_HOT_STATE
+TInItem *pInItemsQueue, *pInNext;
 int   nInItems = 0;                     // input items counter
+#endif
+TInItem null_in_item = { 0, 0, 0, 0 };
+unsigned long nInSeq = 0;               // input items pushed (request handles)
+TRequest hInLast = REQUEST_NONE;        // the latest request (NONE - it's rejected)
 
 // *****************************************************************************
 //  DATA OUTPUT QUEUE (OUTPUT REQUESTS)
 // *****************************************************************************
                                         // output queue and pointers (FIFO)
-char  aOutItemsQueue[OUTPUT_SIZE] = "\0", *pOutItemsQueue, *pOutNext;
+#ifndef PB_EXTERNAL_QUEUES
+char  aOutItemsQueue[OUTPUT_SIZE] = "\0";
+char *pOutQueueBase = aOutItemsQueue;   // queue storage
+int   nOutQueueSize = OUTPUT_SIZE;
+#else
+char *pOutQueueBase = 0;
+int   nOutQueueSize = 0;
+#endif
+#ifndef PB_HOT_STATE
+char *pOutItemsQueue, *pOutNext;
 int   nOutItems = 0;                    // output items counter
+#endif
+                                        // output items numbers (request handles)
+unsigned long nOutSeq = 0;              // the next pushed item
+TRequest hOutLast = REQUEST_NONE;       // the latest request (NONE - it's rejected)
+unsigned long nOutSeqDone = 0;          // current item (items before are finished)
+TSeqRange aOutHoles[REQUEST_HOLES];     // items removed after current one (sorted)
+int   nOutHoles = 0;
+
+#ifdef PB_SLAB_QUEUE
+                                        // output items pool (free lists by size classes)
+TSlabClass aSlabClasses[SLAB_CLASSES];
+int   aSlabSizes[SLAB_CLASSES] = { SLAB_SIZE_SMALL, SLAB_SIZE_MEDIUM, SLAB_SIZE_LARGE };
+int   aSlabShares[SLAB_CLASSES] = SLAB_SHARES;
+TOutItem *pOutHead, *pOutTail;          // queue of items (FIFO)
+char  null_out_item[] = "";
+#endif
+
+int   nOutReserved = 0;                 // reserved space (bytes, data and terminator)
+                                        // overflow policy and counters
+int   nOutPolicy = OVERFLOW_REJECT, nOutBlockTimeout = DEFAULT_TIMEOUT;
+TOverflowStat out_overflow;
+                                        // low watermark (drain) callback
+TWatermarkHandler pOutWatermarkHandler = 0;
+int   nOutWatermark = 0, IsOutWatermarkArmed = 0;
+int   IsOutWatermarkPending = 0;        // crossed, the handler is called out of termination
+
+#ifdef PB_SLAB_QUEUE
+TOutItem *pOutReserved = 0;             // reserved item
+TOutItem *pOutOpened = 0;               // item being filled (*_openOutItem*)
+#endif
 
 #ifdef PB_STATISTICS
 int   nMaxOutItems, nMaxOutQueueSize, nMaxOutItemSize;
 #endif
 
+#ifdef PB_LATENCY
+TLatency aLatency[2][LATENCY_KINDS];    // histograms [polled/IRQ][kind]
+TOutStamp aOutStamps[LATENCY_ITEMS];    // output items push times (FIFO)
+int   nOutStampHead = 0, nOutStamps = 0;
+unsigned long nOutFirst;                // current item first byte time
+int   IsOutFirst = 0;
+#endif
+
+#ifdef PB_DEFERRED
+                                        // deferred output requests (FIFO)
+TDeferRecord aDeferRecords[DEFER_ITEMS];
+int   nDeferHead = 0, nDeferRecords = 0;
+char *pDeferFormat = 0;                 // rendered format position (NULL - not started)
+char *pDeferText = 0;                   // rendered conversion text (NULL - format)
+int   nDeferArg = 0;                    // next argument
+char  sDeferConv[DEFER_CONV_SIZE];      // rendered conversion
+#endif
+
+// *****************************************************************************
+//  EVENTS LOOP (HANDLERS AND USER TASKS)
+// *****************************************************************************
+
+TRequestHandler pTxDoneHandler = 0;     // output request done callback
+TRequestHandler pRxDoneHandler = 0;     // input request done callback
+
+TIdleHandler pIdleHandler = _idleWait;  // idle strategy (NULL - spin)
+
+TTask aTasks[PB_MAX_TASKS];             // user tasks
+int   nTasks = 0, nNextTask = 0;
+int   nPollTurn = 0;                    // which direction goes first
+
+#ifdef PB_ADAPTIVE_IRQ
+                                        // adaptive interrupts mode (0 - off)
+int   nAdaptHigh = 0, nAdaptLow = ADAPT_LOW_BYTES;
+unsigned long nAdaptWindow = ADAPT_WINDOW;
+unsigned long nAdaptStart = 0;          // current window beginning (cycles)
+unsigned long nAdaptBytes = 0;          // bytes of current window
+int   nAdaptQuiet = 0;                  // quiet windows in polled phase
+int   nAdaptIER = 0;                    // interrupts masked in polled phase (EIRC | EITR << 1)
+TAdaptStat adapt_stat;
+#endif
+
+#ifdef PB_FLOW_CONTROL
+                                        // flow control (FLOW_NONE - off)
+int   nFlowMode = FLOW_NONE, nFlowHigh = FLOW_HIGH, nFlowLow = FLOW_LOW;
+TFlowHandler pFlowHandler = 0;          // RTS/CTS board hook
+unsigned char aFlowHold[FLOW_HOLD_SIZE]; // bytes taken from *RXD* for the receiver (FIFO)
+int   nFlowHoldHead = 0;
+unsigned char nFlowOut = 0;             // XON/XOFF to be sent (0 - none)
+unsigned long nFlowTime = 0;            // XON sent or XON/XOFF taken (cycles, IN_GAP starts again)
+int   IsFlowPaused = 0;                 // transmitter was paused (the next byte goes as the first one)
+TFlowStat flow_stat;
+#endif
+
 // *****************************************************************************
 //  PORT STATE CONTROL (PROTECTED)
 // *****************************************************************************
@@ -175,9 +482,9 @@ void SetPortSpeed( int Speed ) {
 //      Speed -- speed value {0,1,2}.
 //
 #ifdef PB_CLEAN_REGISTER
-    BaseAddress[PB_CNR] &= ~0x07;          // clean&set *SPEED* and *E_P(ready)*
+    PB_WRITE( PB_CNR, PB_READ(PB_CNR) & ~0x07 );         // clean&set *SPEED* and *E_P(ready)*
 #endif
-    BaseAddress[PB_CNR] |= ((Speed & 0x06) | 0x01);
+    PB_WRITE( PB_CNR, PB_READ(PB_CNR) | ((Speed & 0x06) | 0x01) );
 }
 
 void SetPortLoop( char IsLoop ) {
@@ -189,9 +496,9 @@ void SetPortLoop( char IsLoop ) {
 //      IsLoop -- 1/0.
 //
 #ifdef PB_CLEAN_REGISTER
-    BaseAddress[PB_CNR] &= ~(0x08 | 0x01); // clean&set *LOOP* and *E_P(ready)*
+    PB_WRITE( PB_CNR, PB_READ(PB_CNR) & ~(0x08 | 0x01) ); // clean&set *LOOP* and *E_P(ready)*
 #endif
-    BaseAddress[PB_CNR] |= ( (IsLoop ? 0x08:0x00) | 0x01 );
+    PB_WRITE( PB_CNR, PB_READ(PB_CNR) | ( (IsLoop ? 0x08:0x00) | 0x01 ) );
 }
 
 void SetPortParity( int Parity ) {
@@ -203,9 +510,9 @@ void SetPortParity( int Parity ) {
 //      Parity -- 1/0 (even/odd).
 //
 #ifdef PB_CLEAN_REGISTER
-    BaseAddress[PB_CNR] &= ~(0x10 | 0x01); // clean&set *TP* and *E_P(ready)*
+    PB_WRITE( PB_CNR, PB_READ(PB_CNR) & ~(0x10 | 0x01) ); // clean&set *TP* and *E_P(ready)*
 #endif
-    BaseAddress[PB_CNR] |= ( (Parity ? 0x10:0x00) | 0x01 );
+    PB_WRITE( PB_CNR, PB_READ(PB_CNR) | ( (Parity ? 0x10:0x00) | 0x01 ) );
 }
 
 void SetIRQStatus( int mode, int IsEnable ) {
@@ -220,9 +527,9 @@ void SetIRQStatus( int mode, int IsEnable ) {
 //
 #ifdef PB_USE_PORT_INTERRUPTS
     if( IsEnable )
-        BaseAddress[PB_IER] |= (mode ? 0x02:0x01);
+        PB_WRITE( PB_IER, PB_READ(PB_IER) | (mode ? 0x02:0x01) );
     else
-        BaseAddress[PB_IER] &= (mode ? 0xFD:0xFE);
+        PB_WRITE( PB_IER, PB_READ(PB_IER) & (mode ? 0xFD:0xFE) );
 #endif
 }
 
@@ -238,7 +545,7 @@ int GetIRQStatus( int mode ) {
 //
 //      IRQ status (a byte).
 //
-    return (BaseAddress[PB_IER] & (mode ? 0x02:0x01));
+    return (PB_READ(PB_IER) & (mode ? 0x02:0x01));
 }
 
 void SetPortRegister( int Register, unsigned char Value ) {
@@ -251,7 +558,7 @@ void SetPortRegister( int Register, unsigned char Value ) {
 //
 //      Value -- state (byte).
 //
-    BaseAddress[Register] = Value;
+    PB_WRITE( Register, Value );
 }
 
 unsigned char GetPortRegister( int Register, int IsLog ) {
@@ -268,16 +575,21 @@ unsigned char GetPortRegister( int Register, int IsLog ) {
 //
 //      Register state value (byte).
 //
-    rx = BaseAddress[Register];
+    rx = PB_READ(Register);
 
 #ifdef PB_USE_LOGGER
     if( IsLog )
-        logger( msg, 1, "... REGISTER[%x]: %d\n", Register, rx );
+        logger( pLogger, 1, "... REGISTER[%x]: %d\n", Register, rx );
 #endif
 
     return rx;
 }
 
+//  transmit/receive path placed in RAM (see standalone_romrun.ld)
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=".fasttext"
+#endif
+
 int GetPortErrorMask( unsigned char status ) {
 //
 //  Checks and returns port *error* bits (*ISR->ERP, ERF, OV*).
@@ -296,7 +608,7 @@ int GetPortErrorMask( unsigned char status ) {
     if( status )
         return (status & TX_ERROR_MASK);
 
-    return (BaseAddress[PB_STATUS] & TX_ERROR_MASK);
+    return (PB_READ(PB_STATUS) & TX_ERROR_MASK);
 }
 
 int IsTXPortReady( int Timeout ) {
@@ -312,11 +624,13 @@ int IsTXPortReady( int Timeout ) {
 //
 //      1/0 -- ready or not.
 //
+    int spins = 0;
+
     if( !Timeout ) return ( !(isr_pb_state & TXRDY) ? 1:0 );
 
-    while( ( BaseAddress[PB_STATUS] & TXRDY ) )
+    while( ( PB_READ(PB_STATUS) & TXRDY ) )
      {
-        if( !( --Timeout ) )
+        if( ( Timeout -= pBIdle(&spins) ) <= 0 )
             return 0;
      }
 
@@ -336,17 +650,27 @@ int IsRXPortReady( int Timeout ) {
 //
 //      1/0 -- ready or not.
 //
+    int spins = 0, IsIdle;
+
     if( !Timeout ) return ( (isr_pb_state & RXRDY) ? 1:0 );
 
-    while( !( BaseAddress[PB_STATUS] & RXRDY ) )
+//  goes idle only if a byte wakes the CPU up (EIRC), masked receiver
+//  (polled mode or phase) would be overrun while the CPU waits for a tick
+    IsIdle = GetIRQStatus(PB_EIRC);
+
+    while( !( PB_READ(PB_STATUS) & RXRDY ) )
      {
-        if( !( --Timeout ) )
+        if( ( Timeout -= ( IsIdle ? pBIdle(&spins) : 1 ) ) <= 0 )
             return 0;
      }
 
     return 1;
 }
 
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=default
+#endif
+
 // *****************************************************************************
 //  SERVER CONTROL (PRIVATE)
 // *****************************************************************************
@@ -355,10 +679,17 @@ void _setBase() {
 //
 //  Set registers base address
 //
+#ifdef PB_REGISTER_MODEL
+    BaseAddress = pBModelRegisters();
+#else
     BaseAddress = (void *)DEF_RS_BASE_ADDRESS_B;
 #ifdef MIPSBE
     BaseAddress +=3;
 #endif
+#endif
+#ifdef PB_HOT_STATE
+    port_hot.pBase = BaseAddress;
+#endif
 }
 
 void _initInItemsQueue() {
@@ -367,9 +698,9 @@ void _initInItemsQueue() {
 //  -------------------------
 //
     int i;
-    for( i=0; i<MAX_INPUT_ITEMS_COUNTER; i++ )
-        aInItemsQueue[i] = null_in_item;
-    pInItemsQueue = &aInItemsQueue[0];
+    for( i=0; i<nInQueueSize; i++ )
+        pInQueueBase[i] = null_in_item;
+    pInItemsQueue = &pInQueueBase[0];
     pInNext = pInItemsQueue;
     nInItems = 0;
 }
@@ -379,10 +710,26 @@ void _initOutItemsQueue() {
 //  Initialize transmitter queue
 //  ----------------------------
 //
-    aOutItemsQueue[0] = '\0';
-    pOutItemsQueue = &aOutItemsQueue[0];
+#ifdef PB_SLAB_QUEUE
+    _initOutItemsPool();
+    pOutHead = pOutTail = pOutReserved = 0;
+    pOutItemsQueue = pOutNext = null_out_item;
+#else
+    pOutQueueBase[0] = '\0';
+    pOutItemsQueue = &pOutQueueBase[0];
     pOutNext = pOutItemsQueue;
+#endif
     nOutItems = 0;
+    nOutReserved = 0;
+    IsOutWatermarkArmed = IsOutWatermarkPending = 0;
+//  requests queued before are finished
+    nOutSeqDone = nOutSeq;
+    nOutHoles = 0;
+
+#ifdef PB_DEFERRED
+    nDeferHead = nDeferRecords = 0;
+    pDeferFormat = pDeferText = 0;
+#endif
 
 #ifdef PB_STATISTICS
     nMaxOutItems = 0;
@@ -391,232 +738,460 @@ void _initOutItemsQueue() {
 #endif
 }
 
-void _initPortBController() {
-//
-//  Check port "B" state and initialize it to work.
-//  -----------------------------------------------
-//
-//  Returns:
-//
-//      NONE (successfully) or NEGATIVE QUANTITY (error).
-//
-    pb_cnr_saved = BaseAddress[PB_CNR];
-
-    SetPortParity(1);           // set 'even' parity control
-    SetPortLoop(0);             // disable LOOP
-    SetPortSpeed(SPEED_38400);  // set speed
-
-    port_mode = MODE_NONE;
-}
+#ifdef PB_SLAB_QUEUE
 
-void _termPortBController() {
+void _initOutItemsPool() {
 //
-//  Terminate port "B".
-//  -------------------
-//  Shift the queue and set current data pointer to the next queue item.
+//  Initialize output items pool.
+//  -----------------------------
+//  Carves the transmitter queue storage into size classes (SLAB_SHARES)
+//  and links items of every class into its free list.
 //
-    TInItem *pr;
-    char *ps;
-
-#ifndef PB_RING_QUEUE
-    int i;
-#endif
+    TSlabClass *pc;
+    TOutItem *pi;
+    char *p = pOutQueueBase;
+    int c, i, nStep, nShare, nAvail;
 
-#ifdef PB_USE_PORT_INTERRUPTS
-    DisableInt();
-#endif
+//  align the storage beginning
+    while( (unsigned long)p & (sizeof(void *)-1) ) ++p;
+    nAvail = nOutQueueSize - (p - pOutQueueBase);
 
-    if( port_mode == MODE_TX ) {
-    //  keep the queue beginning
-        ps = &aOutItemsQueue[0];
-    //  check the last item in the queue
-        if( nOutItems <= 1 ) {
-        //  continue at the beggining
-            pOutItemsQueue = pOutNext = ps;
-        //  set items counter
-            nOutItems = 0;
-        }
-        else {
-        //  check overstep the boundaries
-            if( pOutNext > pOutItemsQueue ) {
+    for( c=0; c<SLAB_CLASSES; c++ ) {
+        pc = &aSlabClasses[c];
+        nStep = sizeof(TOutItem) + aSlabSizes[c];
+        nShare = (nAvail / 100) * aSlabShares[c];
 
-#ifdef PB_RING_QUEUE
-            //  continue at the next of the queue
-                ++pOutItemsQueue;
-#else
-            //  shift the queue (*pop* off current item, FIFO)
-                strshift(ps, ++pOutItemsQueue, pOutNext);
-            //  set the next offset
-                pOutNext = ps + ( pOutNext - pOutItemsQueue );
-            //  continue at first of the queue
-                pOutItemsQueue = ps;
-#endif
+        pc->nItemSize = aSlabSizes[c];
+        pc->nCount = nShare / nStep;
+        pc->nUsed = pc->nMaxUsed = pc->nFailed = 0;
+        pc->pFree = 0;
 
-            }
-        //  set items counter
-            --nOutItems;
+        for( i=0; i<pc->nCount; i++, p += nStep ) {
+            pi = (TOutItem *)p;
+            pi->pData = p + sizeof(TOutItem);
+            pi->nClass = c;
+            pi->pNext = pc->pFree;
+            pc->pFree = pi;
         }
-    //  clean the queue
-        if( pOutNext == pOutItemsQueue ) aOutItemsQueue[0] = '\0';
     }
-    else if( port_mode == MODE_RX ) {
-    //  keep the queue beginning
-        pr = &aInItemsQueue[0];
-    //  check overstep the boundaries
-        if( nInItems <= 1 ) {
-        //  continue at the beggining
-            pInItemsQueue = pInNext = pr;
-        //  set items counter
-            nInItems = 0;
-        }
-        else {
-        //  check overstep the boundaries
-            if( pInNext > pInItemsQueue ) {
-
-#ifdef PB_RING_QUEUE
-            //  continue at the next of the queue
-                ++pInItemsQueue;
-#else
-            //  shift input queue (*pop* off current item, FIFO)
-                for( i=0; i<nInItems; i++ )
-                    aInItemsQueue[i] = aInItemsQueue[i+1];
-                aInItemsQueue[i] = null_in_item;
-                pInItemsQueue = pr;
-#endif
+}
 
-            }
-        //  set input items counter
-            --nInItems;
+TOutItem *_allocOutItem( int nSize ) {
+//
+//  Allocate output item.
+//  ---------------------
+//  Takes the item from the least fitting size class, or from the next one
+//  if the class is exhausted.
+//
+//  Arguments:
+//
+//      nSize -- item data size (bytes).
+//
+//  Returns:
+//
+//      Item pointer or NULL (overflow).
+//
+    TSlabClass *pc;
+    TOutItem *pi;
+    int c, first = -1;
+
+    for( c=0; c<SLAB_CLASSES; c++ ) {
+        pc = &aSlabClasses[c];
+        if( pc->nItemSize < nSize )
+            continue;
+        if( first < 0 ) first = c;
+        if( (pi = pc->pFree) ) {
+            pc->pFree = pi->pNext;
+            pi->pNext = 0;
+            if( ++pc->nUsed > pc->nMaxUsed ) pc->nMaxUsed = pc->nUsed;
+            return pi;
         }
     }
 
-    port_mode = MODE_NONE;
-
-#ifdef PB_USE_PORT_INTERRUPTS
-    EnableInt();
-#endif
+    if( first >= 0 ) ++aSlabClasses[first].nFailed;
+    return 0;
 }
 
-void _saveIERState() {
+void _freeOutItem( TOutItem *pi ) {
 //
-//  Save current IER state and disable port interrupts.
-//  ---------------------------------------------------
+//  Release output item (back to the free list of its class).
+//  ---------------------------------------------------------
 //
-//  save IRQ state
-    pb_ier_saved = BaseAddress[PB_IER];
-//  disable interrupts on receiver\transmitter
-    if( pb_ier_saved ) BaseAddress[PB_IER] = '\0';
+    TSlabClass *pc = &aSlabClasses[pi->nClass];
+
+    pi->pNext = pc->pFree;
+    pc->pFree = pi;
+    --pc->nUsed;
 }
 
-void _restoreIERState() {
+#endif
+
+int _getOutQueueUsed() {
 //
-//  Restore IER state.
-//  ------------------
+//  Get occupied space of the transmitter queue (bytes).
+//  ----------------------------------------------------
 //
-    if( BaseAddress[PB_IER] != pb_ier_saved ) BaseAddress[PB_IER] = pb_ier_saved;
+#ifdef PB_SLAB_QUEUE
+    int c, n = 0;
+    for( c=0; c<SLAB_CLASSES; c++ )
+        n += aSlabClasses[c].nUsed * aSlabClasses[c].nItemSize;
+    return n;
+#else
+    return (pOutNext - pOutQueueBase);
+#endif
 }
 
-void _delay( unsigned int Timeout ) {
-    volatile int t = Timeout;
-    while(--t) ;
+int _getOutQueueSize() {
+//
+//  Get capacity of the transmitter queue (bytes).
+//  ----------------------------------------------
+//
+#ifdef PB_SLAB_QUEUE
+    int c, n = 0;
+    for( c=0; c<SLAB_CLASSES; c++ )
+        n += aSlabClasses[c].nCount * aSlabClasses[c].nItemSize;
+    return n;
+#else
+    return nOutQueueSize;
+#endif
 }
 
-// *****************************************************************************
-//  CLIENT INTERFACE (PUBLIC)
-// *****************************************************************************
-
-int pBInit( int IsEIRCEnable, int IsEITREnable ) {
+int _fitOutItem( int nSize, int IsReserved ) {
 //
-//  Initialize port -B- (set required operational state).
-//  -----------------------------------------------------
-//  Should be ran before any utilization.
+//  Check the new item fits the queue.
+//  ----------------------------------
+//  The pool item is taken for it (PB_SLAB_QUEUE). Only the item taking the
+//  reservation may use the reserved space, the others fit the rest.
 //
 //  Arguments:
 //
-//      IsEIRCEnable -- 1/0, receiver interrupts mode (enable/disable)
+//      nSize -- item size with delimeters (bytes), without terminator.
 //
-//      IsEITREnable -- 1/0, transmitter interrupts mode (enable/disable).
+//      IsReserved -- 1/0, the item takes the reservation or not.
 //
 //  Returns:
 //
-//      NONE (successfully) or error status (not ready).
+//      1/0 - fits or not.
 //
+#ifdef PB_SLAB_QUEUE
+    TOutItem *pi;
 
-//  set registers area pointer
-    _setBase();
-
-#ifdef PB_USE_LOGGER
-    logger( msg, 0, "" );
+//  take an item from the pool (data and terminator), reserved one if given
+    if( IsReserved ) {
+        pi = pOutReserved;
+        pOutReserved = 0;
+    }
+    else if( !(pi = _allocOutItem(nSize + 1)) )
+        return 0;
+    pOutOpened = pi;
+    return 1;
+#else
+    return ( nSize + 1 + _getOutQueueUsed() + ( IsReserved ? 0 : nOutReserved ) <= nOutQueueSize ) ? 1:0;
 #endif
-
-//  make default settings
-    _initPortBController();
-
-//  initialize receiver queue
-    _initInItemsQueue();
-
-//  initialize transmitter queue
-    _initOutItemsQueue();
-
-//  enable or disable IRQ
-    pBEnableIRQ( IsEIRCEnable, IsEITREnable );
-
-//  check port ready state
-    return (GetPortErrorMask(0) ? 0:1);
 }
 
-void pBTerm() {
+int _fitEmptyOutQueue( int nSize, int IsReserved ) {
 //
-//  Terminate port -B- (set default state).
-//  ---------------------------------------
-//  Should be ran after any utilization.
+//  Check the new item fits the empty queue.
+//  ----------------------------------------
+//  Nothing is dropped or waited for the item which never fits (data and
+//  terminator): the queue storage (PB_SLAB_QUEUE: any size class) is less,
+//  the reserved space is left out for the item not taking it.
 //
-    pBDisableIRQ( 0,0 );
-
-#ifdef PB_USE_LOGGER
-#ifdef PB_STATISTICS
-    logger( msg, 1, "--> PORT -B- QUEUE STATISTICS:\n" );
-    logger( msg, 1, "    queue size:     %d\n", OUTPUT_SIZE );
-    logger( msg, 1, "    max queue size: %d\n", nMaxOutQueueSize );
-    logger( msg, 1, "    max items:      %d\n", nMaxOutItems );
-    logger( msg, 1, "    max item size:  %d\n", nMaxOutItemSize );
+//  Returns:
+//
+//      1/0 - fits or not.
+//
+#ifdef PB_SLAB_QUEUE
+    int c, n;
 #endif
-    logger( msg, 2, "" );
+
+    if( nSize > MAX_OUTPUT_ITEM_SIZE )
+        return 0;
+    if( IsReserved )
+        return 1;
+
+#ifdef PB_SLAB_QUEUE
+    for( c=0; c<SLAB_CLASSES; c++ ) {
+        n = aSlabClasses[c].nCount - ( pOutReserved && pOutReserved->nClass == c ? 1:0 );
+        if( n > 0 && aSlabClasses[c].nItemSize >= nSize + 1 )
+            return 1;
+    }
+    return 0;
+#else
+    return ( nSize + 1 + nOutReserved <= nOutQueueSize ) ? 1:0;
 #endif
 }
 
-int pBInRequest( char *sItem, int nMaxSize ) {
+void _nextOutSeq() {
 //
-//  Asynchronous Data Receiving from the port -B-.
-//  ----------------------------------------------
-//  Arguments:
+//  Current output item is removed, take number of the next one.
 //
-//      sItem -- input buffer pointer
+    unsigned long nSeq = nOutSeqDone + 1;
+
+    while( nOutHoles && aOutHoles[0].nFirst <= nSeq ) {
+        if( aOutHoles[0].nLast >= nSeq ) nSeq = aOutHoles[0].nLast + 1;
+        memmove( aOutHoles, aOutHoles + 1, --nOutHoles * sizeof(TSeqRange) );
+    }
+    nOutSeqDone = nSeq;
+}
+
+int _addOutHole( unsigned long nSeq ) {
 //
-//      nMaxSize -- max size limits.
+//  Keep number of an output item removed after current one.
+//  --------------------------------------------------------
+//  Numbers are kept as ranges, adjacent ones are merged.
 //
 //  Returns:
 //
-//      NONE (successfully continued) or error callback code.
+//      1/0 - successfully or no room (REQUEST_HOLES).
 //
-    int code = 0;
-    int errors;
+    TSeqRange *ph;
+    int i;
 
-    if( !sItem && nMaxSize != 0 )
+    for( i=0; i<nOutHoles && aOutHoles[i].nLast + 1 < nSeq; i++ ) ;
+
+    ph = &aOutHoles[i];
+    if( i < nOutHoles && ph->nLast + 1 == nSeq ) {
+    //  extend the range up, merge with the next one
+        ph->nLast = nSeq;
+        if( i+1 < nOutHoles && ph[1].nFirst == nSeq + 1 ) {
+            ph->nLast = ph[1].nLast;
+            memmove( ph + 1, ph + 2, (--nOutHoles - i - 1) * sizeof(TSeqRange) );
+        }
+    }
+    else if( i < nOutHoles && ph->nFirst == nSeq + 1 )
+        ph->nFirst = nSeq;
+    else {
+        if( nOutHoles >= REQUEST_HOLES )
+            return 0;
+        memmove( ph + 1, ph, (nOutHoles++ - i) * sizeof(TSeqRange) );
+        ph->nFirst = ph->nLast = nSeq;
+    }
+    return 1;
+}
+
+int _getOutItemIndex( unsigned long nSeq ) {
+//
+//  Get queue position of the output item by its number.
+//  ----------------------------------------------------
+//
+//  Returns:
+//
+//      Position (0 - current item) or -1 (the item isn't in the queue).
+//
+    int i, n;
+
+    if( nSeq - nOutSeqDone >= nOutSeq - nOutSeqDone )
+        return -1;
+
+    n = (int)(nSeq - nOutSeqDone);
+    for( i=0; i<nOutHoles && aOutHoles[i].nFirst <= nSeq; i++ ) {
+        if( aOutHoles[i].nLast >= nSeq )
+            return -1;
+        n -= (int)(aOutHoles[i].nLast - aOutHoles[i].nFirst + 1);
+    }
+    return n;
+}
+
+unsigned long _getOutItemSeq( int nIndex ) {
+//
+//  Get number of the output item by its queue position.
+//
+    unsigned long nSeq = nOutSeqDone;
+    int i = 0;
+
+    while( nIndex-- > 0 ) {
+        ++nSeq;
+        for( ; i<nOutHoles && aOutHoles[i].nFirst <= nSeq; i++ )
+            if( aOutHoles[i].nLast >= nSeq ) nSeq = aOutHoles[i].nLast + 1;
+    }
+    return nSeq;
+}
+
+int _removeOutItem( int nIndex ) {
+//
+//  Remove the output item from the queue.
+//  --------------------------------------
+//  Current item can't be removed if its bytes are being sent.
+//
+//  Arguments:
+//
+//      nIndex -- queue position (0 - current item).
+//
+//  Returns:
+//
+//      Removed item size (bytes) or 0 (not removed).
+//
+    int i, n = 0, IsRemovable;
+#ifdef PB_SLAB_QUEUE
+    TOutItem *pi, *pp = 0;
+#else
+    char *p;
+#endif
+
+#ifdef PB_USE_PORT_INTERRUPTS
+    DisableInt();
+#endif
+
+    IsRemovable = ( nIndex >= 0 && nIndex < nOutItems && ( nIndex || port_mode != MODE_TX ) );
+
+//  keep the number (the items after current one are numbered out of order)
+    if( IsRemovable && nIndex )
+        IsRemovable = _addOutHole( _getOutItemSeq(nIndex) );
+    else if( IsRemovable )
+        _nextOutSeq();
+
+    if( IsRemovable ) {
+
+#ifdef PB_SLAB_QUEUE
+    //  unlink the item and release it
+        for( i=0, pi=pOutHead; i<nIndex; i++ ) {
+            pp = pi;
+            pi = pi->pNext;
+        }
+        n = strsize(pi->pData) + 1;
+        if( pp )
+            pp->pNext = pi->pNext;
+        else
+            pOutHead = pi->pNext;
+        if( pOutTail == pi ) pOutTail = pp;
+        _freeOutItem( pi );
+        if( !nIndex ) pOutItemsQueue = pOutHead ? pOutHead->pData : null_out_item;
+        --nOutItems;
+#else
+    //  shift the rest of the queue down over the item
+        for( i=0, p=pOutItemsQueue; i<nIndex; i++ )
+            p += strsize(p) + 1;
+        n = strsize(p) + 1;
+        strshift( p, p + n, pOutNext );
+        pOutNext -= n;
+        if( !--nOutItems )
+            pOutItemsQueue = pOutNext = pOutQueueBase;
+        if( pOutNext == pOutItemsQueue ) pOutQueueBase[0] = '\0';
+#endif
+    }
+
+#ifdef PB_USE_PORT_INTERRUPTS
+    EnableInt();
+#endif
+
+    return n;
+}
+
+int _dropOutItem() {
+//
+//  Drop the oldest output item which isn't being sent (OVERFLOW_DROP_OLDEST).
+//  --------------------------------------------------------------------------
+//
+//  Returns:
+//
+//      Dropped item size (bytes) or 0 (nothing to drop).
+//
+    return _removeOutItem( port_mode == MODE_TX ? 1:0 );
+}
+
+int _removeInItem( int nIndex ) {
+//
+//  Remove the input request from the queue.
+//  ----------------------------------------
+//  Current request can't be removed if its bytes are being received.
+//
+//  Returns:
+//
+//      1/0 - removed or not.
+//
+    int i, IsDone = 0;
+
+#ifdef PB_USE_PORT_INTERRUPTS
+    DisableInt();
+#endif
+
+    if( nIndex >= 0 && nIndex < nInItems && ( nIndex || port_mode != MODE_RX ) ) {
+    //  shift the later requests down over it
+        for( i=nIndex; i<nInItems-1; i++ )
+            *_getInItem(i) = *_getInItem(i+1);
+        *_getInItem(i) = null_in_item;
+        if( !--nInItems )
+            pInItemsQueue = pInNext = pInQueueBase;
+        else
+            pInNext = _getInItem(nInItems);
+        IsDone = 1;
+    }
+
+#ifdef PB_USE_PORT_INTERRUPTS
+    EnableInt();
+#endif
+
+    return IsDone;
+}
+
+TInItem *_getInItem( int nIndex ) {
+//
+//  Get input request by its queue position (the ring wraps around the end).
+//
+#ifdef PB_RING_QUEUE
+    return pInQueueBase + ( (pInItemsQueue - pInQueueBase) + nIndex ) % nInQueueSize;
+#else
+    return pInItemsQueue + nIndex;
+#endif
+}
+
+int _pushInItem( char *sItem, int nMaxSize, TInOptions *pOptions ) {
+//
+//  Push input request in the queue and receive the first byte.
+//  -----------------------------------------------------------
+//
+//  Arguments:
+//
+//      sItem -- input buffer pointer
+//
+//      nMaxSize -- max size limits
+//
+//      pOptions -- binary request options (NULL - text line).
+//
+//  Returns:
+//
+//      NONE (successfully continued) or error callback code.
+//
+    int code = 0;
+#ifndef PB_ERROR_RECOVERY
+    int errors;
+#endif
+
+    hInLast = REQUEST_NONE;
+
+    if( !sItem && nMaxSize != 0 )
         return PB_ERR_UNDEFINED;
 
-//  check port state
+//  check port state (PB_ERROR_RECOVERY: the receiver recovers the line)
+#ifndef PB_ERROR_RECOVERY
     if((errors = GetPortErrorMask(0)))
         return errors;
+#endif
 
 //  check *item* overflow
-    if( nInItems >= MAX_INPUT_ITEMS_COUNTER )
+    if( nInItems >= nInQueueSize )
         return PB_ERR_OVERFLOW;
 
 //  push *item* in the queue
-    (*pInNext).pItem = sItem;
-    (*pInNext).nMaxSize = (nMaxSize > 0 ? nMaxSize:0);
+    (*pInNext).pItem = (*pInNext).pBuffer = sItem;
+    (*pInNext).nMaxSize = (*pInNext).nSize = (nMaxSize > 0 ? nMaxSize:0);
+    (*pInNext).nSeq = nInSeq++;
+    hInLast = REQUEST_HANDLE((*pInNext).nSeq, 1);
+#ifdef PB_LATENCY
+    (*pInNext).nQueued = _getCycles();
+    (*pInNext).nFirst = 0;
+#endif
+#ifdef PB_RX_MODES
+    (*pInNext).pOptions = pOptions;
+    (*pInNext).nLast = 0;
+    (*pInNext).nGap = ( pOptions && (pOptions->nMode & IN_GAP) ) ? pOptions->nGapChars * _charCycles() : 0;
+#endif
     ++pInNext;
+#ifdef PB_RING_QUEUE
+    if( pInNext == pInQueueBase + nInQueueSize ) pInNext = pInQueueBase;
+#endif
 
     ++nInItems;
 
@@ -625,126 +1200,1956 @@ int pBInRequest( char *sItem, int nMaxSize ) {
     return (code ? code : PB_ERR_NONE);
 }
 
-int pBPush( char *sItem, int IsNewLine, int IsLog ) {
+char *_openOutItem( int nSize ) {
 //
-//  Push item in the output queue.
-//  ------------------------------
+//  Take queue space for a new item.
+//  --------------------------------
+//  The item not longer than the reservation takes it (see *pBReserve*), the
+//  longer one fits the rest of the queue. The filled item is put in the
+//  queue by *_closeOutItem*. If the queue is full, overflow policy is
+//  applied (see *pBSetOverflow*).
 //
 //  Arguments:
 //
-//      sItem -- output request string (queue item)
-//
-//      IsNewLine -- 1/0, insert new line/line feed
-//
-//      IsLog -- 1/0, debug logger
+//      nSize -- item size with delimeters (bytes), without terminator.
 //
 //  Returns:
 //
-//      1/0 - successfully or overflow.
+//      Item data pointer or NULL (overflow).
 //
-    int i, nSize;
-    char new_line[] = NEW_LINE;
+    int n, spins = 0, IsBlocked = 0, IsFit, IsReserved, Timeout = nOutBlockTimeout;
 
-#ifdef PB_USE_LOGGER
-#ifdef DEBUG
-    char *p;
-#endif
-#ifdef TRACE
-    logger( msg, 1, "... sItem: %s\n", sItem );
-#endif
-#endif
+    if( !pOutItemsQueue ) _initOutItemsQueue();
 
-    i = strsize(sItem);
+//  the reservation is for the item not longer than it
+    IsReserved = ( nOutReserved && nSize + 1 <= nOutReserved ) ? 1:0;
 
-#ifdef PB_NO_EMPTY_REQUEST
-//  check an empty request (given *item*)
-    if( i==0 || ( i==1 && ( strin(sItem[0], (char *)"\n\r\t\0") ) ) )
-        return 1;
+//  the item which never fits is rejected at once
+    IsFit = _fitEmptyOutQueue( nSize, IsReserved );
+
+    while( !IsFit || !_fitOutItem(nSize, IsReserved) ) {
+    //  drop the oldest items up to the new one fits
+        if( nOutPolicy == OVERFLOW_DROP_OLDEST && IsFit && (n = _dropOutItem()) ) {
+            ++out_overflow.nDroppedItems;
+            out_overflow.nDroppedBytes += n;
+            continue;
+        }
+    //  wait for the transmitter, it's called here as *pBPoll* does (goes
+    //  idle as the receiver does, only with EIRC enabled)
+        if( nOutPolicy == OVERFLOW_BLOCK && IsFit && nOutItems && Timeout > 0 ) {
+            if( !IsBlocked ) {
+                ++out_overflow.nBlocked;
+                IsBlocked = 1;
+            }
+#ifdef PB_FLOW_CONTROL
+        //  the receiver isn't called meanwhile (it may keep the port), the
+        //  bytes are held for it
+            if( nFlowMode ) {
+                _flowTake( 1 );
+                _flowSend();
+            }
 #endif
+            pBSend(0);
+            Timeout -= ( GetIRQStatus(PB_EIRC) ? pBIdle(&spins) : 1 );
+            continue;
+        }
+    //  the new item is rejected
+        ++out_overflow.nRejectedItems;
+        out_overflow.nRejectedBytes += nSize;
+        hOutLast = REQUEST_NONE;
+        return 0;
+    }
 
-//  XXX  DisableInt();  XXX
+//  the reservation was taken
+    if( IsReserved ) nOutReserved = 0;
 
-//  check *item* overflow
-    nSize = i + SIZE_OFFSET;
-    if( nSize > MAX_OUTPUT_ITEM_SIZE ||
-        nSize + strsize(aOutItemsQueue) > sizeof(aOutItemsQueue) )
-        return 0;
+#ifdef PB_SLAB_QUEUE
+    return pOutOpened->pData;
+#else
+    return pOutNext;
+#endif
+}
 
-//  push *item* in the queue
-    if( nSize > SIZE_OFFSET ) {
-        if( !pOutItemsQueue ) _initOutItemsQueue();
-    //  make string delimeters
-        if( IsNewLine && !endswith(sItem, new_line) )
-            stradd(sItem, new_line);
-    //  push it as the latest in the queue
-        pOutNext = strpush(pOutNext, sItem);
-        ++nOutItems;
+void _closeOutItem( char *pEnd, int nSize ) {
+//
+//  Put the item taken by *_openOutItem* in the queue as the latest.
+//  ----------------------------------------------------------------
+//
+//  Arguments:
+//
+//      pEnd -- position after the item terminator
+//
+//      nSize -- item size (statinfo).
+//
+#ifdef PB_SLAB_QUEUE
+    if( pOutTail )
+        pOutTail->pNext = pOutOpened;
+    else {
+        pOutHead = pOutOpened;
+        pOutItemsQueue = pOutOpened->pData;
     }
+    pOutTail = pOutOpened;
+    pOutOpened = 0;
+#else
+    pOutNext = pEnd;
+#endif
+    ++nOutItems;
+#ifdef PB_LATENCY
+    _stampOutItem();
+#endif
+    hOutLast = REQUEST_HANDLE(nOutSeq, 0);
+    ++nOutSeq;
+//  arm low watermark callback
+    if( pOutWatermarkHandler && _getOutQueueUsed() >= nOutWatermark )
+        IsOutWatermarkArmed = 1;
 
 #ifdef PB_STATISTICS
 //  statinfo
     if( nOutItems > nMaxOutItems ) nMaxOutItems = nOutItems;
+#ifndef PB_SLAB_QUEUE
     if( pOutNext > pOutItemsQueue + nMaxOutQueueSize ) nMaxOutQueueSize = pOutNext - pOutItemsQueue;
-    if( nSize > nMaxOutItemSize ) nMaxOutItemSize = nSize;
-#endif
-
-//  XXX  EnableInt();  XXX
-
-#ifdef DEBUG
-#ifdef PB_USE_LOGGER
-//  log *item* if needed
-    if( IsLog ) {
-        p = pOutNext;
-        logger( msg, 1, "... QUEUE, items: %d, pOutItemsQueue: %x, pOutNext: %x\n", nOutItems, pOutItemsQueue, p );
-        for( i=0; i<nOutItems; i++ ) {
-            p = strpop(p);
-            logger( msg, 1, "%s", p );
-        }
-    }
 #endif
+    if( nSize > nMaxOutItemSize ) nMaxOutItemSize = nSize;
 #endif
-
-    return 1;
 }
 
-int pBOutRequest( char *fmt, ... ) {
+void _initPortBController() {
 //
-//  Asynchronous Data Transmitting to the port -B-.
+//  Check port "B" state and initialize it to work.
 //  -----------------------------------------------
-//  Arguments list is compatible with *printf*.
 //
 //  Returns:
 //
-//      NONE (successfully continued) or error callback code.
+//      NONE (successfully) or NEGATIVE QUANTITY (error).
 //
-    va_list args;
-    char sItem[MAX_OUTPUT_ITEM_SIZE];
-    int code = 0;
-    int errors;
+    pb_cnr_saved = PB_READ(PB_CNR);
 
-//  check port state
-    if((errors = GetPortErrorMask(0)))
-        return errors;
+    SetPortParity(1);           // set 'even' parity control
+    SetPortLoop(0);             // disable LOOP
+    SetPortSpeed(SPEED_38400);  // set speed
 
-//  get formatted string to push it in the queue
-    va_start(args, fmt);
-    vsprintf(sItem, fmt, args);
+    port_mode = MODE_NONE;
+}
 
-    if( !pBPush(sItem, 1, 0) ) return PB_ERR_OVERFLOW;
+void _termPortBController() {
+//
+//  Terminate port "B".
+//  -------------------
+//  Shift the queue and set current data pointer to the next queue item.
+//
+    TInItem *pr;
 
-#ifdef DEBUG
-#ifdef PB_USE_LOGGER
-    logger( msg, 1, "... QUEUE, items: %d, current size: %d\n%s", nOutItems, strsize(aOutItemsQueue), aOutItemsQueue );
+#ifdef PB_SLAB_QUEUE
+    TOutItem *pi;
+#else
+    char *ps;
+#endif
+
+#ifndef PB_RING_QUEUE
+    int i;
+#endif
+
+#ifdef PB_USE_PORT_INTERRUPTS
+    DisableInt();
+#endif
+
+    if( port_mode == MODE_TX ) {
+        _nextOutSeq();
+#ifdef PB_SLAB_QUEUE
+    //  *pop* off current item (FIFO) and release it
+        if( (pi = pOutHead) ) {
+            if( !(pOutHead = pi->pNext) ) pOutTail = 0;
+            _freeOutItem( pi );
+        }
+        pOutItemsQueue = pOutHead ? pOutHead->pData : null_out_item;
+        if( nOutItems ) --nOutItems;
+#else
+    //  keep the queue beginning
+        ps = &pOutQueueBase[0];
+    //  check the last item in the queue
+        if( nOutItems <= 1 ) {
+        //  continue at the beggining
+            pOutItemsQueue = pOutNext = ps;
+        //  set items counter
+            nOutItems = 0;
+        }
+        else {
+        //  check overstep the boundaries
+            if( pOutNext > pOutItemsQueue ) {
+
+#ifdef PB_RING_QUEUE
+            //  continue at the next of the queue
+                ++pOutItemsQueue;
+#else
+            //  shift the queue (*pop* off current item, FIFO)
+                strshift(ps, ++pOutItemsQueue, pOutNext);
+            //  set the next offset
+                pOutNext = ps + ( pOutNext - pOutItemsQueue );
+            //  continue at first of the queue
+                pOutItemsQueue = ps;
 #endif
+
+            }
+        //  set items counter
+            --nOutItems;
+        }
+    //  clean the queue
+        if( pOutNext == pOutItemsQueue ) pOutQueueBase[0] = '\0';
 #endif
+    //  check the queue drained below low watermark (the handler may push,
+    //  it's called when the port is released, see *_notifyOutWatermark*)
+        if( IsOutWatermarkArmed && _getOutQueueUsed() < nOutWatermark ) {
+            IsOutWatermarkArmed = 0;
+            IsOutWatermarkPending = 1;
+        }
+    }
+    else if( port_mode == MODE_RX ) {
+    //  keep the queue beginning
+        pr = &pInQueueBase[0];
+    //  check overstep the boundaries
+        if( nInItems <= 1 ) {
+        //  continue at the beggining
+            pInItemsQueue = pInNext = pr;
+        //  set items counter
+            nInItems = 0;
+        }
+        else {
+#ifdef PB_RING_QUEUE
+        //  continue at the next of the queue (wraps around the end)
+            if( ++pInItemsQueue == pr + nInQueueSize ) pInItemsQueue = pr;
+#else
+        //  check overstep the boundaries
+            if( pInNext > pInItemsQueue ) {
+            //  shift input queue (*pop* off current item, FIFO)
+                for( i=0; i<nInItems-1; i++ )
+                    pInQueueBase[i] = pInQueueBase[i+1];
+                pInQueueBase[i] = null_in_item;
+                pInItemsQueue = pr;
+                --pInNext;
+            }
+#endif
+        //  set input items counter
+            --nInItems;
+        }
+    }
+
+    port_mode = MODE_NONE;
+
+#ifdef PB_USE_PORT_INTERRUPTS
+    EnableInt();
+#endif
+}
+
+void _notifyOutWatermark() {
+//
+//  Call the low watermark handler latched by *_termPortBController*: the
+//  port is released and interrupts are enabled, so the handler may push
+//  new items (and start the transmitter again).
+//
+    if( IsOutWatermarkPending ) {
+        IsOutWatermarkPending = 0;
+        if( pOutWatermarkHandler ) (*pOutWatermarkHandler)( pBTxFree() );
+    }
+}
+
+void _saveIERState() {
+//
+//  Save current IER state and disable port interrupts.
+//  ---------------------------------------------------
+//
+//  save IRQ state
+    pb_ier_saved = PB_READ(PB_IER);
+//  disable interrupts on receiver\transmitter
+    if( pb_ier_saved ) PB_WRITE( PB_IER, '\0' );
+}
+
+void _restoreIERState() {
+//
+//  Restore IER state.
+//  ------------------
+//
+    if( PB_READ(PB_IER) != pb_ier_saved ) PB_WRITE( PB_IER, pb_ier_saved );
+}
+
+void _delay( unsigned int Timeout ) {
+    volatile int t = Timeout;
+    int spins = 0;
+    while( ( t -= pBIdle(&spins) ) > 0 ) ;
+}
+
+void _idleWait() {
+//
+//  Default idle strategy: sleep up to the next interrupt (port or timer).
+//
+#if defined(PB_REGISTER_MODEL)
+    pBModelIdle();
+#elif defined(PB_REGISTER_REPLAY)
+#elif defined(__mips__) || defined(__mips)
+    __asm__ __volatile__( "wait" );
+#endif
+}
+
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=".fasttext"
+#endif
+
+unsigned long _getCycles() {
+//
+//  Get CPU cycles counter (CP0 *Count*, model time with PB_REGISTER_MODEL,
+//  recorded time with PB_REGISTER_REPLAY).
+//
+#if defined(PB_REGISTER_MODEL)
+    return pBModelTime();
+#elif defined(PB_REGISTER_REPLAY)
+    return pBReplayTime();
+#elif defined(__mips__) || defined(__mips)
+    unsigned long count;
+    __asm__ __volatile__( "mfc0 %0, $9" : "=r"(count) );
+    return count * PB_COUNT_RATE;
+#else
+    return 0;
+#endif
+}
+
+unsigned long _charTime() {
+//
+//  Character time at 115200 by the clock of *_getCycles* (model ticks with
+//  PB_REGISTER_MODEL, recorded cycles with PB_REGISTER_REPLAY).
+//
+#if defined(PB_REGISTER_MODEL)
+    return pBModelCharTime();
+#elif defined(PB_REGISTER_REPLAY)
+    return pBReplayCharTime();
+#else
+    return (unsigned long)PB_CPU_HZ / 115200 * CHAR_BITS;
+#endif
+}
+
+#ifdef PB_DEFERRED
+
+char *_deferSpec( char *p, int *pConv, int *pIsLong ) {
+//
+//  Parse a conversion of deferred request format.
+//  ----------------------------------------------
+//  Supported: flags, width and precision (up to DEFER_MAX_WIDTH), 'h'/'l'
+//  size and %d %i %u %x %X %o %c, %s without width, %% (and %b with
+//  PB_LIGHT_FORMAT).
+//
+//  Arguments:
+//
+//      p -- conversion beginning ('%').
+//
+//  Returns:
+//
+//      Position after the conversion or NULL (it can't be deferred).
+//
+    char *ps = p;
+    int nWidth = 0, nPrecision = 0, IsPrecision = 0;
+
+    for( ++p; *p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0'; p++ ) ;
+    for( ; *p >= '0' && *p <= '9'; p++ ) nWidth = nWidth*10 + (*p - '0');
+    if( *p == '.' ) {
+        IsPrecision = 1;
+        for( ++p; *p >= '0' && *p <= '9'; p++ ) nPrecision = nPrecision*10 + (*p - '0');
+    }
+
+    *pIsLong = 0;
+    if( *p == 'l' ) {
+        *pIsLong = 1;
+        ++p;
+    }
+    else if( *p == 'h' )
+        ++p;
+
+    *pConv = *p;
+
+    if( nWidth > DEFER_MAX_WIDTH || nPrecision > DEFER_MAX_WIDTH || p - ps >= DEFER_SPEC_SIZE-1 )
+        return 0;
+
+    switch( *p ) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            return p+1;
+#ifdef PB_LIGHT_FORMAT
+        case 'b':
+            return p+1;
+#endif
+        case 's':
+            return ( nWidth || IsPrecision ) ? 0 : p+1;
+        case '%':
+            return ( p == ps+1 ) ? p+1 : 0;
+    }
+    return 0;
+}
+
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=default
+#endif
+
+int _scanDeferFormat( char *fmt ) {
+//
+//  Check the format can be deferred.
+//  ---------------------------------
+//
+//  Returns:
+//
+//      Arguments number or -1 (unsupported conversion or too many arguments).
+//
+    char *p = fmt;
+    int nConv, IsLong, n = 0;
+
+    while( (p = strchr(p, '%')) ) {
+        if( !(p = _deferSpec(p, &nConv, &IsLong)) )
+            return -1;
+        if( nConv != '%' && ++n > DEFER_ARGS )
+            return -1;
+    }
+    return n;
+}
+
+void _takeDeferArgs( TDeferRecord *pr, va_list args ) {
+//
+//  Keep the arguments of a deferred request (format is checked already).
+//
+    char *p = pr->pFormat;
+    int nConv, IsLong, n = 0;
+
+    while( (p = strchr(p, '%')) ) {
+        p = _deferSpec( p, &nConv, &IsLong );
+        switch( nConv ) {
+            case '%':
+                break;
+            case 's':
+                pr->aArgs[n++].s = va_arg( args, char * );
+                break;
+            case 'd': case 'i': case 'c':
+                pr->aArgs[n++].l = IsLong ? va_arg( args, long ) : (long)va_arg( args, int );
+                break;
+            default:
+                pr->aArgs[n++].u = IsLong ? va_arg( args, unsigned long ) : (unsigned long)va_arg( args, unsigned int );
+        }
+    }
+}
+
+void _releaseDeferRecords() {
+//
+//  Release records of dropped and cancelled deferred requests.
+//
+    while( nDeferRecords && (long)(aDeferRecords[nDeferHead].nSeq - nOutSeqDone) < 0 ) {
+        nDeferHead = (nDeferHead + 1) % DEFER_ITEMS;
+        --nDeferRecords;
+    }
+}
+
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=".fasttext"
+#endif
+
+int _isDeferItem() {
+//
+//  Check the current output item is a deferred request.
+//
+    _releaseDeferRecords();
+    return ( nDeferRecords && aDeferRecords[nDeferHead].nSeq == nOutSeqDone ) ? 1:0;
+}
+
+unsigned char _deferByte() {
+//
+//  Get current byte of the deferred request (rendered by conversions).
+//  -------------------------------------------------------------------
+//  The byte is taken by *_deferNext*. When the request is over, its record
+//  is released and current data pointer is moved to the item terminator.
+//
+//  Returns:
+//
+//      Current byte or '\0' (request is over).
+//
+    TDeferRecord *pr = &aDeferRecords[nDeferHead];
+    TDeferArg *pa;
+    char sSpec[DEFER_SPEC_SIZE];
+    char *p;
+    int nConv, IsLong;
+
+    if( !pDeferFormat ) {
+        pDeferFormat = pr->pFormat;
+        pDeferText = 0;
+        nDeferArg = 0;
+    }
+
+    for( ;; ) {
+    //  conversion text (string argument)
+        if( pDeferText ) {
+            if( *pDeferText ) return *pDeferText;
+            pDeferText = 0;
+        }
+    //  format text
+        if( *pDeferFormat && *pDeferFormat != '%' )
+            return *pDeferFormat;
+    //  format is over, line delimeters follow
+        if( !*pDeferFormat ) {
+            if( !pr->IsNewLine ) break;
+            pr->IsNewLine = 0;
+            pDeferText = (char *)NEW_LINE;
+            continue;
+        }
+    //  render the next conversion
+        p = _deferSpec( pDeferFormat, &nConv, &IsLong );
+        if( nConv == '%' )
+            pDeferText = (char *)"%";
+        else {
+            pa = &pr->aArgs[nDeferArg++];
+            memcpy( sSpec, pDeferFormat, p - pDeferFormat );
+            sSpec[p - pDeferFormat] = '\0';
+            if( nConv == 's' )
+                pDeferText = pa->s ? pa->s : (char *)"(null)";
+            else {
+#ifdef PB_LIGHT_FORMAT
+            //  bounded and reentrant, safe in the transmitter interrupt
+                if( nConv == 'd' || nConv == 'i' || nConv == 'c' ) {
+                    if( IsLong ) pBFormat( sDeferConv, DEFER_CONV_SIZE, sSpec, pa->l );
+                    else pBFormat( sDeferConv, DEFER_CONV_SIZE, sSpec, (int)pa->l );
+                }
+                else {
+                    if( IsLong ) pBFormat( sDeferConv, DEFER_CONV_SIZE, sSpec, pa->u );
+                    else pBFormat( sDeferConv, DEFER_CONV_SIZE, sSpec, (unsigned int)pa->u );
+                }
+#else
+                if( nConv == 'd' || nConv == 'i' || nConv == 'c' ) {
+                    if( IsLong ) sprintf( sDeferConv, sSpec, pa->l );
+                    else sprintf( sDeferConv, sSpec, (int)pa->l );
+                }
+                else {
+                    if( IsLong ) sprintf( sDeferConv, sSpec, pa->u );
+                    else sprintf( sDeferConv, sSpec, (unsigned int)pa->u );
+                }
+#endif
+                pDeferText = sDeferConv;
+            }
+        }
+        pDeferFormat = p;
+    }
+
+//  the request is over: release the record, move to the item terminator
+    nDeferHead = (nDeferHead + 1) % DEFER_ITEMS;
+    --nDeferRecords;
+    pDeferFormat = 0;
+    ++pOutItemsQueue;
+
+    return '\0';
+}
+
+void _deferNext() {
+//
+//  Take current byte of the deferred request (see *_deferByte*).
+//
+    if( pDeferText )
+        ++pDeferText;
+    else
+        ++pDeferFormat;
+}
+
+#endif
+
+#ifdef PB_LATENCY
+
+void _addLatency( int nKind, int IsIRQ, unsigned long nCycles ) {
+//
+//  Add request latency into the histogram (log2 bucket).
+//
+    TLatency *pl = &aLatency[IsIRQ ? 1:0][nKind];
+    int i = 0;
+
+#if defined(__GNUC__)
+    if( nCycles ) i = (int)(sizeof(long)*8 - 1) - __builtin_clzl(nCycles);
+#else
+    unsigned long v = nCycles;
+    while( v >>= 1 ) ++i;
+#endif
+    if( i >= LATENCY_BUCKETS ) i = LATENCY_BUCKETS-1;
+
+    ++pl->aBuckets[i];
+    if( !pl->nCount++ || nCycles < pl->nMin ) pl->nMin = nCycles;
+    if( nCycles > pl->nMax ) pl->nMax = nCycles;
+}
+
+void _stampOutItem() {
+//
+//  Keep push time of a new output item (if the stamps ring isn't full).
+//
+    TOutStamp *ps;
+
+    if( nOutStamps < LATENCY_ITEMS ) {
+        ps = &aOutStamps[(nOutStampHead + nOutStamps++) % LATENCY_ITEMS];
+        ps->nSeq = nOutSeq;
+        ps->nQueued = _getCycles();
+    }
+}
+
+void _doneOutItem( int IsIRQ ) {
+//
+//  Output item was sent, add its latency (if it was stamped).
+//
+    unsigned long t = _getCycles();
+    TOutStamp *ps;
+
+    while( nOutStamps ) {
+        ps = &aOutStamps[nOutStampHead];
+        if( (long)(ps->nSeq - nOutSeqDone) > 0 ) break;
+        if( ps->nSeq == nOutSeqDone ) {
+            if( IsOutFirst ) _addLatency( LATENCY_TX_WAIT, IsIRQ, nOutFirst - ps->nQueued );
+            _addLatency( LATENCY_TX_DONE, IsIRQ, t - ps->nQueued );
+        }
+        nOutStampHead = (nOutStampHead + 1) % LATENCY_ITEMS;
+        --nOutStamps;
+    }
+
+    IsOutFirst = 0;
+}
+
+#endif
+
+#ifdef PB_RX_MODES
+
+unsigned long _charCycles() {
+//
+//  Character time by *CNR->SPEED* (cycles of *_getCycles*).
+//
+    switch( PB_READ(PB_CNR) & 0x06 ) {
+        case SPEED_19200: return _charTime() * 6;
+        case SPEED_38400: return _charTime() * 3;
+    }
+    return _charTime();
+}
+
+int _isInDelimiter( TInOptions *po, unsigned char Data ) {
+    return ( (po->nMode & IN_DELIMITERS) && memchr(po->sDelimiters, Data, po->nDelimiters) ) ? 1:0;
+}
+
+int _receiveBinary( int IsIRQ ) {
+//
+//  Receive a byte of binary request (the port is ready).
+//  -----------------------------------------------------
+//
+//  Arguments:
+//
+//      IsIRQ -- 1/0, interrupts mode or not.
+//
+//  Returns:
+//
+//      PB_OK (the request was done) or NONE.
+//
+    TInItem *pr = pInItemsQueue;
+    TInOptions *po = (*pr).pOptions;
+    unsigned char Data;
+
+    Data = RX_READ();
+    if( IsIRQ ) isr_pb_state &= ~RXRDY;
+#ifdef PB_ADAPTIVE_IRQ
+    ++nAdaptBytes;
+    if( adapt_stat.IsPolled ) ++adapt_stat.nPolledBytes;
+#endif
+
+    if( po->nMode & IN_GAP ) (*pr).nLast = _getCycles();
+#ifdef PB_LATENCY
+    if( !(*pr).nFirst ) {
+        (*pr).nFirst = _getCycles();
+        _addLatency( LATENCY_RX_WAIT, IsIRQ, (*pr).nFirst - (*pr).nQueued );
+    }
+#endif
+
+    *((*pr).pItem++) = (char)Data;
+    --(*pr).nMaxSize;
+
+    if( _isInDelimiter(po, Data) )
+        return _doneInItem( IN_END_DELIMITER, IsIRQ );
+    if( (po->nMode & IN_COUNT) && (*pr).pItem - (*pr).pBuffer >= po->nCount )
+        return _doneInItem( IN_END_COUNT, IsIRQ );
+    if( (*pr).nMaxSize <= 0 )
+        return _doneInItem( IN_END_FULL, IsIRQ );
+
+    return PB_ERR_NONE;
+}
+
+int _checkInGap( int IsIRQ ) {
+//
+//  Check the inter-byte gap of current binary request (no byte is ready).
+//  ----------------------------------------------------------------------
+//  The request started to receive is done when the gap has elapsed since
+//  its last byte and no byte waits in *RXD*, the time the peer is held by
+//  flow control (PB_FLOW_CONTROL) doesn't count and its XON/XOFF starts
+//  the gap again. A damaged frame being skipped (PB_ERROR_RECOVERY) ends
+//  by the gap as well, the next bytes are received again.
+//
+//  Arguments:
+//
+//      IsIRQ -- 1/0, interrupts mode or not.
+//
+//  Returns:
+//
+//      PB_OK (the request was done) or NONE.
+//
+    TInItem *pr = pInItemsQueue;
+    TInOptions *po;
+
+    if( !nInItems || !(po = (*pr).pOptions) || !(po->nMode & IN_GAP) || !(*pr).nLast )
+        return PB_ERR_NONE;
+
+#ifdef PB_FLOW_CONTROL
+//  the peer is held by us (XOFF, RTS off or XON not gone yet) - the gap
+//  starts when it's let go or its XON/XOFF is taken
+    if( flow_stat.IsRxStopped || nFlowOut )
+        return PB_ERR_NONE;
+    if( (long)(nFlowTime - (*pr).nLast) > 0 )
+        (*pr).nLast = nFlowTime;
+#endif
+
+    if( _getCycles() - (*pr).nLast < (*pr).nGap )
+        return PB_ERR_NONE;
+
+//  a byte waits in *RXD* (the receiver wasn't read meanwhile) - no gap
+    if( PB_READ(PB_STATUS) & RXRDY )
+        return PB_ERR_NONE;
+
+#ifdef PB_ERROR_RECOVERY
+    if( rx_state == RX_STATE_DISCARD ) {
+        rx_state = RX_STATE_DATA;
+        (*pr).nLast = 0;
+        return PB_ERR_NONE;
+    }
+#endif
+
+    if( port_mode != MODE_RX || (*pr).pItem == (*pr).pBuffer )
+        return PB_ERR_NONE;
+
+    return _doneInItem( IN_END_GAP, IsIRQ );
+}
+
+int _doneInItem( int nEnd, int IsIRQ ) {
+//
+//  Finish current binary request: set the results, terminate the data
+//  if there is a room, shift the queue.
+//
+    TInItem *pr = pInItemsQueue;
+    TInOptions *po = (*pr).pOptions;
+
+    po->nReceived = (int)((*pr).pItem - (*pr).pBuffer);
+    po->nEnd = nEnd;
+    if( (*pr).nMaxSize > 0 ) *((*pr).pItem) = '\0';
+
+#ifdef PB_LATENCY
+    if( (*pr).nFirst )
+        _addLatency( LATENCY_RX_DONE, IsIRQ, _getCycles() - (*pr).nFirst );
+#endif
+    _termPortBController();
+
+    return PB_OK;
+}
+
+#endif
+
+#ifdef PB_FLOW_CONTROL
+
+void _flowReset() {
+//
+//  Drop held bytes, both directions go (the peer isn't told).
+//
+    nFlowHoldHead = 0;
+    nFlowOut = 0;
+    nFlowTime = 0;
+    IsFlowPaused = 0;
+    flow_stat.IsTxStopped = flow_stat.IsRxStopped = 0;
+    flow_stat.nHeld = 0;
+}
+
+int _flowTake( int Timeout ) {
+//
+//  Take a byte of *RXD* for the receiver (flow control).
+//  -----------------------------------------------------
+//  Called where the receiver may not read the port (the transmitter is
+//  busy or waited for, a push is blocked, no input request): the byte is
+//  held up to *pBReceive* takes it.
+//  XON/XOFF (FLOW_XONXOFF) stop and start the transmitter, they are not
+//  data. A full hold takes nothing, the peer should be stopped by then.
+//
+//  Arguments:
+//
+//      Timeout -- ready state waiting timeout.
+//
+//  Returns:
+//
+//      1/0 - a byte was taken or not.
+//
+    unsigned char Data;
+
+    if( flow_stat.nHeld >= FLOW_HOLD_SIZE || !IsRXPortReady( Timeout ) )
+        return 0;
+
+#ifdef PB_ERROR_RECOVERY
+//  the damaged byte is dropped, the line in progress is skipped
+    if( _recoverPortErrors(0, 1) )
+        return 0;
+#endif
+
+    Data = PB_READ(PB_RXHR);
+    isr_pb_state &= ~RXRDY;
+
+    if( nFlowMode == FLOW_XONXOFF && ( Data == FLOW_XOFF || Data == FLOW_XON ) ) {
+        nFlowTime = _getCycles();
+        if( (flow_stat.IsTxStopped = ( Data == FLOW_XOFF )) )
+            ++flow_stat.nXoffTaken;
+        else
+            ++flow_stat.nXonTaken;
+        return 1;
+    }
+
+    aFlowHold[(nFlowHoldHead + flow_stat.nHeld++) & (FLOW_HOLD_SIZE-1)] = Data;
+    if( flow_stat.nHeld > flow_stat.nMaxHeld ) flow_stat.nMaxHeld = flow_stat.nHeld;
+
+    _flowCheck();
+    return 1;
+}
+
+unsigned char _flowRead() {
+//
+//  Receiver data: the first held byte or *RXD*.
+//
+    unsigned char Data;
+
+    if( !flow_stat.nHeld )
+        return PB_READ(PB_RXHR);
+
+    Data = aFlowHold[nFlowHoldHead];
+    nFlowHoldHead = (nFlowHoldHead + 1) & (FLOW_HOLD_SIZE-1);
+    --flow_stat.nHeld;
+
+    _flowCheck();
+    return Data;
+}
+
+void _flowCheck() {
+//
+//  Stop or start the peer by held bytes (watermarks).
+//  --------------------------------------------------
+//  XOFF at *nFlowHigh* bytes, XON at *nFlowLow* (RTS by the hook). The
+//  byte goes at once if the transmitter is free, otherwise *pBSend* puts
+//  it ahead of the next data byte; the change back before it's gone
+//  cancels it (the peer hasn't been told).
+//
+    int IsStop;
+
+    if( nFlowMode == FLOW_NONE )
+        return;
+
+    if( !flow_stat.IsRxStopped && flow_stat.nHeld >= nFlowHigh )
+        IsStop = 1;
+    else if( flow_stat.IsRxStopped && flow_stat.nHeld <= nFlowLow )
+        IsStop = 0;
+    else
+        return;
+
+    flow_stat.IsRxStopped = IsStop;
+
+    if( nFlowMode == FLOW_RTSCTS ) {
+        if( pFlowHandler ) (*pFlowHandler)( IsStop ? 0:1 );
+        _flowSent( IsStop ? FLOW_XOFF : FLOW_XON );
+        return;
+    }
+
+    nFlowOut = ( nFlowOut ? 0 : IsStop ? FLOW_XOFF : FLOW_XON );
+    _flowSend();
+}
+
+void _flowSend() {
+//
+//  Send pending XON/XOFF if the transmitter has no data in progress.
+//
+    if( !nFlowOut || port_mode == MODE_TX || ( PB_READ(PB_STATUS) & TXRDY ) )
+        return;
+
+    PB_WRITE( PB_TXHR, nFlowOut );
+    _flowSent( nFlowOut );
+    nFlowOut = 0;
+}
+
+void _flowSent( unsigned char Data ) {
+//
+//  Count XON/XOFF sent (RTS turned), note the time the peer is let go.
+//
+    if( Data == FLOW_XOFF )
+        ++flow_stat.nXoffSent;
+    else {
+        ++flow_stat.nXonSent;
+        nFlowTime = _getCycles();
+    }
+}
+
+int _flowIsPaused() {
+//
+//  The peer stopped the transmitter (XOFF taken, CTS is off).
+//
+    if( nFlowMode == FLOW_XONXOFF )
+        return flow_stat.IsTxStopped;
+    if( nFlowMode == FLOW_RTSCTS && pFlowHandler )
+        return (*pFlowHandler)( -1 ) ? 0:1;
+    return 0;
+}
+
+#endif
+
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=default
+#endif
+
+int _recoverPortErrors( unsigned char status, int IsDamaged ) {
+//
+//  Recover the line after an error (*ISR->ERP, ERF, OV*).
+//  ------------------------------------------------------
+//  Counts errors by type, drops the damaged byte from *RXD* (it cleans
+//  error status) and, if the line is damaged, restarts the current input
+//  item and skips the rest of the line up to the next delimiter.
+//
+//  Arguments:
+//
+//      status -- port status (if zero, takes *STATUS* register)
+//
+//      IsDamaged -- 1/0, the line in progress is damaged or not.
+//
+//  Returns:
+//
+//      Error status (a byte), zero if no errors.
+//
+    int errors;
+
+    if( !(errors = GetPortErrorMask(status)) )
+        return 0;
+
+#ifdef PB_ERROR_RECOVERY
+    if( errors & ERR_PARITY  ) ++port_errors.nParity;
+    if( errors & ERR_FRAMING ) ++port_errors.nFraming;
+    if( errors & ERR_OVERRUN ) ++port_errors.nOverrun;
+
+//  drop the damaged byte, clean error status
+    rx = PB_READ(PB_RXHR);
+    isr_pb_state &= ~(TX_ERROR_MASK | RXRDY);
+
+//  restart the current input item, wait for the next delimiter
+    if( ( IsDamaged || port_mode == MODE_RX ) && nInItems ) {
+        if( rx_state == RX_STATE_DATA ) ++port_errors.nDiscarded;
+        (*pInItemsQueue).pItem = (*pInItemsQueue).pBuffer;
+        (*pInItemsQueue).nMaxSize = (*pInItemsQueue).nSize;
+        rx_state = RX_STATE_DISCARD;
+#ifdef PB_RX_MODES
+    //  binary request: up to a delimiter or the gap, fixed length one has no frame boundary
+        if( (*pInItemsQueue).pOptions ) {
+            (*pInItemsQueue).nLast = _getCycles();
+            if( !((*pInItemsQueue).pOptions->nMode & (IN_DELIMITERS | IN_GAP)) ) rx_state = RX_STATE_DATA;
+        }
+#endif
+    }
+#endif
+
+#ifdef DEBUG
+#ifdef PB_USE_LOGGER
+    logger( pLogger, 1, "... RECOVERY(%08b)\n", errors );
+#endif
+#endif
+
+    return errors;
+}
+
+#ifdef PB_ADAPTIVE_IRQ
+
+void _adaptReset() {
+//
+//  Start adaptive mode from the interrupts phase (new load window).
+//
+    nAdaptStart = _getCycles();
+    nAdaptBytes = 0;
+    nAdaptQuiet = 0;
+    nAdaptIER = 0;
+    adapt_stat.IsPolled = 0;
+}
+
+void _adaptCheck() {
+//
+//  Switch interrupts and polled phases by the link load.
+//  -----------------------------------------------------
+//  Runs between requests (no port direction). Every *nAdaptWindow* cycles
+//  bytes of the window are compared with thresholds: a busy window masks
+//  *IER* (polled batches, no interrupt per byte), PB_ADAPT_QUIET quiet
+//  windows in a row restore it (low latency).
+//
+    unsigned long t, nWindows, n;
+
+    if( nAdaptHigh <= 0 || port_mode != MODE_NONE )
+        return;
+
+    t = _getCycles();
+    if( (nWindows = (t - nAdaptStart) / nAdaptWindow) == 0 )
+        return;
+
+//  bytes per window (the link might be quiet for several windows)
+    n = nAdaptBytes / nWindows;
+
+    nAdaptStart = t;
+    nAdaptBytes = 0;
+    adapt_stat.nWindows += nWindows;
+    adapt_stat.nLastBytes = n;
+
+    if( !adapt_stat.IsPolled ) {
+        if( n < (unsigned long)nAdaptHigh )
+            return;
+    //  busy: mask enabled interrupts and take bytes in batches
+        nAdaptIER = ( GetIRQStatus(PB_EIRC) ? 1:0 ) | ( GetIRQStatus(PB_EITR) ? 2:0 );
+        if( !nAdaptIER )
+            return;
+        pBDisableIRQ( 0,0 );
+        PB_TRACE_IRQ();
+        isr_pb = 0;
+        isr_pb_state = 0;
+        nAdaptQuiet = 0;
+        adapt_stat.IsPolled = 1;
+        ++adapt_stat.nToPolled;
+        return;
+    }
+
+//  interrupts were enabled by the application meanwhile
+    if( GetIRQStatus(PB_EIRC) || GetIRQStatus(PB_EITR) ) {
+        adapt_stat.IsPolled = 0;
+        return;
+    }
+
+    if( n > (unsigned long)nAdaptLow ) {
+        nAdaptQuiet = 0;
+        return;
+    }
+    if( (nAdaptQuiet += (int)nWindows) < PB_ADAPT_QUIET )
+        return;
+
+//  quiet: restore interrupts
+    pBEnableIRQ( nAdaptIER & 1, (nAdaptIER >> 1) & 1 );
+    adapt_stat.IsPolled = 0;
+    ++adapt_stat.nToIRQ;
+}
+
+#endif
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+int pBInit( int IsEIRCEnable, int IsEITREnable ) {
+//
+//  Initialize port -B- (set required operational state).
+//  -----------------------------------------------------
+//  Should be ran before any utilization.
+//
+//  Arguments:
+//
+//      IsEIRCEnable -- 1/0, receiver interrupts mode (enable/disable)
+//
+//      IsEITREnable -- 1/0, transmitter interrupts mode (enable/disable).
+//
+//  Returns:
+//
+//      NONE (successfully) or error status (not ready).
+//
+    return pBInitEx( IsEIRCEnable, IsEITREnable, 0 );
+}
+
+int pBInitEx( int IsEIRCEnable, int IsEITREnable, TPortMemory *pMemory ) {
+//
+//  Initialize port -B- with caller provided queues memory.
+//  -------------------------------------------------------
+//  Should be ran before any utilization.
+//
+//  Arguments:
+//
+//      IsEIRCEnable -- 1/0, receiver interrupts mode (enable/disable)
+//
+//      IsEITREnable -- 1/0, transmitter interrupts mode (enable/disable)
+//
+//      pMemory -- queues storage and capacities, null pointers (sizes) take
+//                 static defaults. Trace log buffer should hold LOGGER_SIZE
+//                 at least (*logger* has no size argument), a smaller one
+//                 fails.
+//
+//  Returns:
+//
+//      NONE (successfully) or error status (not ready).
+//
+    PB_TRACE_CALL( TRACE_CALL_INIT, (IsEIRCEnable ? 1:0) | (IsEITREnable ? 2:0) );
+
+//  static defaults (nothing with PB_EXTERNAL_QUEUES)
+#ifndef PB_EXTERNAL_QUEUES
+    pOutQueueBase = aOutItemsQueue;
+    nOutQueueSize = OUTPUT_SIZE;
+    pInQueueBase = aInItemsQueue;
+    nInQueueSize = MAX_INPUT_ITEMS_COUNTER;
+#ifdef PB_USE_LOGGER
+    pLogger = msg;
+#endif
+#else
+    pOutQueueBase = 0;
+    nOutQueueSize = 0;
+    pInQueueBase = 0;
+    nInQueueSize = 0;
+#ifdef PB_USE_LOGGER
+    pLogger = 0;
+#endif
+#endif
+
+//  set queues storage
+    if( pMemory ) {
+        if( pMemory->pOutQueue && pMemory->nOutSize > SIZE_OFFSET ) {
+            pOutQueueBase = pMemory->pOutQueue;
+            nOutQueueSize = pMemory->nOutSize;
+        }
+#ifdef PB_HOT_STATE
+//  the field has the name of the hot state alias
+#undef nInItems
+#endif
+        if( pMemory->pInQueue && pMemory->nInItems > 0 ) {
+            pInQueueBase = pMemory->pInQueue;
+            nInQueueSize = pMemory->nInItems;
+        }
+#ifdef PB_HOT_STATE
+#define nInItems                 port_hot.nInItems
+#endif
+#ifdef PB_USE_LOGGER
+        if( pMemory->pLogger ) {
+            if( pMemory->nLoggerSize < LOGGER_SIZE )
+                return 0;
+            pLogger = pMemory->pLogger;
+        }
+#endif
+    }
+
+//  check queues storage (PB_EXTERNAL_QUEUES)
+    if( !pOutQueueBase || !pInQueueBase )
+        return 0;
+#ifdef PB_USE_LOGGER
+    if( !pLogger )
+        return 0;
+#endif
+
+//  set registers area pointer
+    _setBase();
+
+#ifdef PB_USE_LOGGER
+    logger( pLogger, 0, "" );
+#endif
+
+//  make default settings
+    _initPortBController();
+
+//  initialize receiver queue
+    _initInItemsQueue();
+
+#ifdef PB_ERROR_RECOVERY
+//  reset line errors state
+    rx_state = RX_STATE_DATA;
+    memset( &port_errors, 0, sizeof(port_errors) );
+#endif
+
+//  initialize transmitter queue
+    _initOutItemsQueue();
+
+//  transmitter goes first
+    nPollTurn = 0;
+
+//  enable or disable IRQ
+    pBEnableIRQ( IsEIRCEnable, IsEITREnable );
+
+#ifdef PB_ADAPTIVE_IRQ
+    _adaptReset();
+#endif
+
+#ifdef PB_FLOW_CONTROL
+    _flowReset();
+#endif
+
+//  check port ready state
+    return (GetPortErrorMask(0) ? 0:1);
+}
+
+void pBTerm() {
+//
+//  Terminate port -B- (set default state).
+//  ---------------------------------------
+//  Should be ran after any utilization.
+//
+#if defined(PB_SLAB_QUEUE) && defined(PB_USE_LOGGER) && defined(PB_STATISTICS)
+    int i;
+#endif
+
+    PB_TRACE_CALL( TRACE_CALL_TERM, 0 );
+
+    pBDisableIRQ( 0,0 );
+
+#ifdef PB_ADAPTIVE_IRQ
+    _adaptReset();
+#endif
+
+#ifdef PB_USE_LOGGER
+#ifdef PB_STATISTICS
+    logger( pLogger, 1, "--> PORT -B- QUEUE STATISTICS:\n" );
+    logger( pLogger, 1, "    queue size:     %d\n", nOutQueueSize );
+    logger( pLogger, 1, "    max queue size: %d\n", nMaxOutQueueSize );
+    logger( pLogger, 1, "    max items:      %d\n", nMaxOutItems );
+    logger( pLogger, 1, "    max item size:  %d\n", nMaxOutItemSize );
+#ifdef PB_SLAB_QUEUE
+    for( i=0; i<SLAB_CLASSES; i++ )
+        logger( pLogger, 1, "    pool[%d]:        size %d, items %d, max used %d, failed %d\n", i,
+            aSlabClasses[i].nItemSize, aSlabClasses[i].nCount, aSlabClasses[i].nMaxUsed, aSlabClasses[i].nFailed );
+#endif
+#ifdef PB_ERROR_RECOVERY
+    logger( pLogger, 1, "--> PORT -B- LINE ERRORS:\n" );
+    logger( pLogger, 1, "    parity:         %d\n", port_errors.nParity );
+    logger( pLogger, 1, "    framing:        %d\n", port_errors.nFraming );
+    logger( pLogger, 1, "    overrun:        %d\n", port_errors.nOverrun );
+    logger( pLogger, 1, "    discarded:      %d\n", port_errors.nDiscarded );
+#endif
+#endif
+    logger( pLogger, 2, "" );
+#endif
+}
+
+int pBInRequest( char *sItem, int nMaxSize ) {
+//
+//  Asynchronous Data Receiving from the port -B-.
+//  ----------------------------------------------
+//  Arguments:
+//
+//      sItem -- input buffer pointer
+//
+//      nMaxSize -- max size limits.
+//
+//  Returns:
+//
+//      NONE (successfully continued) or error callback code.
+//
+    PB_TRACE_CALL( TRACE_CALL_IN_REQUEST, sItem ? 1:0 );
+    PB_TRACE_ARG( nMaxSize );
+
+    return _pushInItem( sItem, nMaxSize, 0 );
+}
+
+#ifdef PB_RX_MODES
+
+int pBInRequestEx( char *sItem, int nMaxSize, TInOptions *pOptions ) {
+//
+//  Asynchronous Binary Data Receiving from the port -B-.
+//  -----------------------------------------------------
+//  Every byte (NUL included) is data, no line delimiters. The request is
+//  done after *nCount* bytes (IN_COUNT), by a byte of the delimiters set
+//  (IN_DELIMITERS, the delimiter is kept in the data), when the line is
+//  idle for *nGapChars* character times after a byte (IN_GAP), or when the
+//  buffer is full. *nReceived* and *nEnd* of the options are set when it's
+//  done, the data is terminated if there is a room.
+//
+//  Arguments:
+//
+//      sItem -- input buffer pointer
+//
+//      nMaxSize -- buffer size
+//
+//      pOptions -- request options (kept by the caller up to the request end).
+//
+//  Returns:
+//
+//      NONE (successfully continued) or error callback code.
+//
+    PB_TRACE_CALL( TRACE_CALL_IN_REQUEST, (sItem ? 1:0) | (pOptions ? 2:0) );
+    PB_TRACE_ARG( nMaxSize );
+    if( pOptions ) {
+        PB_TRACE_ARG( (unsigned long)pOptions->nMode << 16 | (pOptions->nGapChars & 0xFFFF) );
+        PB_TRACE_ARG( pOptions->nCount );
+        PB_TRACE_ITEM( pOptions->sDelimiters, pOptions->sDelimiters && pOptions->nDelimiters > 0 ? pOptions->nDelimiters : 0 );
+    }
+
+    if( !pOptions || !sItem || nMaxSize <= 0 )
+        return PB_ERR_UNDEFINED;
+    if( ( (pOptions->nMode & IN_COUNT) && pOptions->nCount <= 0 ) ||
+        ( (pOptions->nMode & IN_DELIMITERS) && ( !pOptions->sDelimiters || pOptions->nDelimiters <= 0 ) ) ||
+        ( (pOptions->nMode & IN_GAP) && pOptions->nGapChars <= 0 ) )
+        return PB_ERR_UNDEFINED;
+
+    pOptions->nReceived = 0;
+    pOptions->nEnd = IN_END_NONE;
+
+    return _pushInItem( sItem, nMaxSize, pOptions );
+}
+
+#endif
+
+int pBPush( char *sItem, int IsNewLine, int IsLog ) {
+//
+//  Push item in the output queue.
+//  ------------------------------
+//
+//  Arguments:
+//
+//      sItem -- output request string (queue item)
+//
+//      IsNewLine -- 1/0, insert new line/line feed
+//
+//      IsLog -- 1/0, debug logger
+//
+//  Returns:
+//
+//      1/0 - successfully or overflow.
+//
+    int i, nSize;
+    char new_line[] = NEW_LINE;
+    char *pData;
+
+#ifdef PB_USE_LOGGER
+#ifdef DEBUG
+    char *p;
+#ifdef PB_SLAB_QUEUE
+    TOutItem *pi;
+#endif
+#endif
+#ifdef TRACE
+    logger( pLogger, 1, "... sItem: %s\n", sItem );
+#endif
+#endif
+
+    PB_TRACE_CALL( TRACE_CALL_PUSH, IsNewLine ? 1:0 );
+    PB_TRACE_ITEM( sItem, -1 );
+
+    i = strsize(sItem);
+
+#ifdef PB_NO_EMPTY_REQUEST
+//  check an empty request (given *item*)
+    if( i==0 || ( i==1 && ( strin(sItem[0], (char *)"\n\r\t\0") ) ) )
+        return 1;
+#endif
+
+//  XXX  DisableInt();  XXX
+
+//  check *item* overflow (the reservation is available for the item)
+    nSize = i + SIZE_OFFSET;
+
+//  push *item* in the queue
+    if( nSize > SIZE_OFFSET ) {
+        if( !(pData = _openOutItem(nSize)) )
+            return 0;
+    //  make string delimeters
+        if( IsNewLine && !endswith(sItem, new_line) )
+            stradd(sItem, new_line);
+    //  push it as the latest in the queue
+        _closeOutItem( strpush(pData, sItem), nSize );
+    }
+
+//  XXX  EnableInt();  XXX
+
+#ifdef DEBUG
+#ifdef PB_USE_LOGGER
+//  log *item* if needed
+    if( IsLog ) {
+#ifdef PB_SLAB_QUEUE
+        logger( pLogger, 1, "... QUEUE, items: %d, pOutItemsQueue: %x\n", nOutItems, pOutItemsQueue );
+        for( pi=pOutHead; pi; pi=pi->pNext )
+            logger( pLogger, 1, "%s", pi->pData );
+#else
+        p = pOutNext;
+        logger( pLogger, 1, "... QUEUE, items: %d, pOutItemsQueue: %x, pOutNext: %x\n", nOutItems, pOutItemsQueue, p );
+        for( i=0; i<nOutItems; i++ ) {
+            p = strpop(p);
+            logger( pLogger, 1, "%s", p );
+        }
+#endif
+    }
+#endif
+#endif
+
+    return 1;
+}
+
+int pBPushv( TOutPart *pParts, int nParts ) {
+//
+//  Push item gathered from several parts in the output queue.
+//  ----------------------------------------------------------
+//  Parts (header, payload, trailer...) are copied one after another into
+//  the queue as one item with a single overflow check and one pair of line
+//  delimeters at the end, so the message can't be interleaved or pushed
+//  partially.
+//
+//  Arguments:
+//
+//      pParts -- parts array, a part with negative size is a string (its
+//                size is measured and kept in the part)
+//
+//      nParts -- parts counter.
+//
+//  Returns:
+//
+//      1/0 - successfully or overflow.
+//
+    char new_line[] = NEW_LINE;
+    char *pData, *p;
+    int i, n, nSize = 0, nDelimiter;
+
+    PB_TRACE_CALL( TRACE_CALL_PUSHV, nParts );
+
+    for( i=0; i<nParts; i++ ) {
+        if( pParts[i].nSize < 0 ) pParts[i].nSize = strsize(pParts[i].pData);
+        PB_TRACE_ITEM( pParts[i].pData, pParts[i].nSize );
+        nSize += pParts[i].nSize;
+    }
+
+#ifdef PB_NO_EMPTY_REQUEST
+//  check an empty request
+    if( nSize==0 )
+        return 1;
+#endif
+
+//  delimeters are not doubled if the last part ends with them
+    nDelimiter = strsize(new_line);
+    if( nParts > 0 && (n = pParts[nParts-1].nSize) >= nDelimiter &&
+        !memcmp(pParts[nParts-1].pData + n - nDelimiter, new_line, nDelimiter) )
+        nDelimiter = 0;
+
+//  XXX  DisableInt();  XXX
+
+//  check *item* overflow (the reservation is available for the item)
+    if( nSize > 0 ) {
+        if( !(pData = _openOutItem(nSize + nDelimiter)) )
+            return 0;
+    //  gather the parts and delimeters
+        for( i=0, p=pData; i<nParts; i++ ) {
+            memcpy( p, pParts[i].pData, pParts[i].nSize );
+            p += pParts[i].nSize;
+        }
+        memcpy( p, new_line, nDelimiter );
+        p += nDelimiter;
+        *p++ = '\0';
+    //  push it as the latest in the queue
+        _closeOutItem( p, nSize + SIZE_OFFSET );
+    }
+
+//  XXX  EnableInt();  XXX
+
+    return 1;
+}
+
+int pBOutRequest( char *fmt, ... ) {
+//
+//  Asynchronous Data Transmitting to the port -B-.
+//  -----------------------------------------------
+//  Arguments list is compatible with *printf*.
+//
+//  Returns:
+//
+//      NONE (successfully continued) or error callback code.
+//
+    va_list args;
+    char sItem[MAX_OUTPUT_ITEM_SIZE];
+    int code = 0;
+#ifndef PB_ERROR_RECOVERY
+    int errors;
+#endif
+
+    PB_TRACE_CALL( TRACE_CALL_OUT_REQUEST, 0 );
+
+//  check port state (PB_ERROR_RECOVERY: the receiver recovers the line)
+#ifndef PB_ERROR_RECOVERY
+    if((errors = GetPortErrorMask(0))) {
+        hOutLast = REQUEST_NONE;
+        return errors;
+    }
+#endif
+
+//  get formatted string to push it in the queue (room for the delimiters)
+    va_start(args, fmt);
+#ifdef PB_LIGHT_FORMAT
+    pBVFormat(sItem, sizeof(sItem) - SIZE_OFFSET, fmt, args);
+#else
+    vsprintf(sItem, fmt, args);
+#endif
+
+    if( !pBPush(sItem, 1, 0) ) return PB_ERR_OVERFLOW;
+
+#ifdef DEBUG
+#ifdef PB_USE_LOGGER
+#ifndef PB_SLAB_QUEUE
+    logger( pLogger, 1, "... QUEUE, items: %d, current size: %d\n%s", nOutItems, strsize(pOutQueueBase), pOutQueueBase );
+#endif
+#endif
+#endif
+
+    if( !nOutItems ) return PB_ERR_EMPTY;
+
+//  OK. Let's go. Transmit the first byte...
+    code = pBSend(1);
+    return (code ? code : PB_ERR_NONE);
+}
+
+#ifdef PB_DEFERRED
+
+int pBDeferRequest( char *fmt, ... ) {
+//
+//  Deferred Data Transmitting to the port -B-.
+//  -------------------------------------------
+//  The same as *pBOutRequest*, but the text isn't formatted now: the format
+//  pointer and arguments are kept in a record (DEFER_ITEMS), the queue item
+//  is a mark, and the text is rendered by bytes while it's transmitted. The
+//  format and string arguments should live up to the request is sent. The
+//  formats not supported (see *_deferSpec*) or more than DEFER_ARGS
+//  arguments are formatted at once, as well as when records are exhausted.
+//
+//  Returns:
+//
+//      NONE (successfully continued) or error callback code.
+//
+    va_list args;
+    TDeferRecord *pr;
+    char sItem[MAX_OUTPUT_ITEM_SIZE];
+    char new_line[] = NEW_LINE;
+    int code = 0;
+#ifndef PB_ERROR_RECOVERY
+    int errors;
+#endif
+
+    PB_TRACE_CALL( TRACE_CALL_DEFER_REQUEST, 0 );
+
+//  check port state (PB_ERROR_RECOVERY: the receiver recovers the line)
+#ifndef PB_ERROR_RECOVERY
+    if((errors = GetPortErrorMask(0))) {
+        hOutLast = REQUEST_NONE;
+        return errors;
+    }
+#endif
+
+    va_start(args, fmt);
+
+    _releaseDeferRecords();
+
+    if( nDeferRecords < DEFER_ITEMS && _scanDeferFormat(fmt) >= 0 ) {
+    //  keep the record (before the item is visible for the transmitter)
+        if( !pOutItemsQueue ) _initOutItemsQueue();
+        pr = &aDeferRecords[(nDeferHead + nDeferRecords) % DEFER_ITEMS];
+        pr->nSeq = nOutSeq;
+        pr->pFormat = fmt;
+        pr->IsNewLine = endswith(fmt, new_line) ? 0:1;
+        _takeDeferArgs( pr, args );
+        ++nDeferRecords;
+    //  push the mark
+        sItem[0] = DEFER_MARK;
+        sItem[1] = '\0';
+        if( !pBPush(sItem, 0, 0) ) {
+            --nDeferRecords;
+            va_end(args);
+            return PB_ERR_OVERFLOW;
+        }
+    }
+    else {
+    //  get formatted string to push it in the queue (room for the delimiters)
+#ifdef PB_LIGHT_FORMAT
+        pBVFormat(sItem, sizeof(sItem) - SIZE_OFFSET, fmt, args);
+#else
+        vsprintf(sItem, fmt, args);
+#endif
+        if( !pBPush(sItem, 1, 0) ) {
+            va_end(args);
+            return PB_ERR_OVERFLOW;
+        }
+    }
+
+    va_end(args);
+
+    if( !nOutItems ) return PB_ERR_EMPTY;
+
+//  OK. Let's go. Transmit the first byte...
+    code = pBSend(1);
+    return (code ? code : PB_ERR_NONE);
+}
+
+#endif
+
+int pBTxFree() {
+//
+//  Get free space of the output queue.
+//  -----------------------------------
+//  With PB_SLAB_QUEUE it's the bytes of free pool items of all the size
+//  classes, an item takes a pool item of its class, so a single item may
+//  not fit even a smaller free space (*pBReserve* tells it).
+//
+//  Returns:
+//
+//      Free space (bytes) without reserved one.
+//
+    int nFree;
+
+    if( !pOutItemsQueue ) _initOutItemsQueue();
+
+    nFree = _getOutQueueSize() - _getOutQueueUsed();
+#ifndef PB_SLAB_QUEUE
+//  the reserved space is left out (PB_SLAB_QUEUE: the reserved pool item is used one)
+    nFree -= nOutReserved;
+#endif
+    return (nFree > 0 ? nFree : 0);
+}
+
+int pBReserve( int nSize ) {
+//
+//  Reserve output queue space for the next item.
+//  ---------------------------------------------
+//  Guarantees the next *pBPush* (*pBOutRequest*) of the item not longer
+//  than *nSize* will not be rejected by overflow. The pushes of longer
+//  items don't take the reservation and can't use its space.
+//
+//  Arguments:
+//
+//      nSize -- item size (bytes), zero cancels the reservation.
+//
+//  Returns:
+//
+//      1/0 - successfully or overflow.
+//
+    PB_TRACE_CALL( TRACE_CALL_RESERVE, 0 );
+    PB_TRACE_ARG( nSize );
+
+    if( !pOutItemsQueue ) _initOutItemsQueue();
+
+//  cancel previous reservation
+    nOutReserved = 0;
+#ifdef PB_SLAB_QUEUE
+    if( pOutReserved ) {
+        _freeOutItem( pOutReserved );
+        pOutReserved = 0;
+    }
+#endif
+
+    if( nSize <= 0 )
+        return 1;
+
+    nSize += SIZE_OFFSET;
+    if( nSize > MAX_OUTPUT_ITEM_SIZE )
+        return 0;
+
+#ifdef PB_SLAB_QUEUE
+//  the item is taken from the pool (it's occupied space already)
+    if( !(pOutReserved = _allocOutItem(nSize + 1)) )
+        return 0;
+#else
+    if( nSize + 1 > pBTxFree() )
+        return 0;
+#endif
+    nOutReserved = nSize + 1;
+
+    return 1;
+}
+
+void pBSetLowWatermark( int nLevel, TWatermarkHandler pHandler ) {
+//
+//  Set output queue low watermark callback.
+//  ----------------------------------------
+//
+//  Arguments:
+//
+//      nLevel -- occupied space level (bytes)
+//
+//      pHandler -- callback, takes free space (bytes), NULL disables it.
+//
+    pOutWatermarkHandler = pHandler;
+    nOutWatermark = nLevel;
+    IsOutWatermarkArmed = ( pHandler && pOutItemsQueue && _getOutQueueUsed() >= nLevel ) ? 1:0;
+}
+
+void pBSetOverflow( int nPolicy, int nTimeout ) {
+//
+//  Set output queue overflow policy.
+//  ---------------------------------
+//
+//  Arguments:
+//
+//      nPolicy -- OVERFLOW_REJECT (the new item is rejected), OVERFLOW_DROP_OLDEST
+//                 (the oldest items not being sent are dropped up to the new
+//                 one fits), OVERFLOW_BLOCK (wait for the transmitter)
+//
+//      nTimeout -- OVERFLOW_BLOCK waiting timeout (as *nPortTimeout*),
+//                  zero - DEFAULT_TIMEOUT.
+//
+    PB_TRACE_CALL( TRACE_CALL_OVERFLOW, nPolicy );
+    PB_TRACE_ARG( nTimeout );
+
+    nOutPolicy = nPolicy;
+    nOutBlockTimeout = nTimeout > 0 ? nTimeout : DEFAULT_TIMEOUT;
+}
+
+void pBGetOverflow( TOverflowStat *pStat, int IsReset ) {
+//
+//  Get output queue overflow counters.
+//  -----------------------------------
+//
+//  Arguments:
+//
+//      pStat -- counters (dropped and rejected items and bytes, blocked pushes)
+//
+//      IsReset -- 1/0, clean the counters after.
+//
+    if( pStat ) *pStat = out_overflow;
+    if( IsReset ) memset( &out_overflow, 0, sizeof(TOverflowStat) );
+}
+
+#ifdef PB_ADAPTIVE_IRQ
+
+void pBSetAdaptive( int nHigh, int nLow, unsigned long nWindow ) {
+//
+//  Set adaptive interrupts mode.
+//  -----------------------------
+//  Under sustained traffic enabled interrupts are masked and the port is
+//  polled in batches (*pBPoll*), when the link goes quiet they are enabled
+//  again. Phases are switched between requests only.
+//
+//  Arguments:
+//
+//      nHigh -- bytes in a window to go polled, zero - ADAPT_HIGH_BYTES,
+//               negative - adaptive mode off (interrupts are restored)
+//
+//      nLow -- max bytes in a quiet window, negative - ADAPT_LOW_BYTES
+//
+//      nWindow -- load window (cycles), zero - ADAPT_WINDOW.
+//
+    PB_TRACE_CALL( TRACE_CALL_ADAPTIVE, 0 );
+    PB_TRACE_ARG( ((unsigned long)(nHigh & 0xFFFF) << 16) | (nLow & 0xFFFF) );
+    PB_TRACE_ARG( nWindow );
+
+    if( adapt_stat.IsPolled )
+        pBEnableIRQ( nAdaptIER & 1, (nAdaptIER >> 1) & 1 );
+
+    nAdaptHigh = nHigh ? nHigh : ADAPT_HIGH_BYTES;
+    nAdaptLow = nLow >= 0 ? nLow : ADAPT_LOW_BYTES;
+    nAdaptWindow = nWindow ? nWindow : ADAPT_WINDOW;
+
+    _adaptReset();
+}
+
+void pBGetAdaptive( TAdaptStat *pStat, int IsReset ) {
+//
+//  Get adaptive interrupts mode counters.
+//  --------------------------------------
+//
+//  Arguments:
+//
+//      pStat -- current phase, switches, windows and bytes counters
+//
+//      IsReset -- 1/0, clean the counters after (the phase is kept).
+//
+    int IsPolled = adapt_stat.IsPolled;
+
+    if( pStat ) *pStat = adapt_stat;
+    if( IsReset ) {
+        memset( &adapt_stat, 0, sizeof(TAdaptStat) );
+        adapt_stat.IsPolled = IsPolled;
+    }
+}
+
+#endif
+
+#ifdef PB_FLOW_CONTROL
+
+void pBSetFlow( int nMode, int nHigh, int nLow ) {
+//
+//  Set flow control mode.
+//  ----------------------
+//  Bytes the receiver can't take at once (the transmitter is busy, no
+//  input request) are held up to FLOW_HOLD_SIZE, the peer is stopped when
+//  *nHigh* bytes are held and started again at *nLow*. The transmitter
+//  pauses between bytes while the peer stops it. With FLOW_XONXOFF the
+//  XON/XOFF bytes are never data (binary requests need another mode).
+//
+//  Arguments:
+//
+//      nMode -- FLOW_NONE, FLOW_XONXOFF or FLOW_RTSCTS (*pBSetFlowHook*)
+//
+//      nHigh -- held bytes to stop the peer, zero - FLOW_HIGH
+//
+//      nLow -- held bytes to start it, negative - FLOW_LOW.
+//
+    int IsStopped;
+
+    PB_TRACE_CALL( TRACE_CALL_FLOW, nMode );
+    PB_TRACE_ARG( ((unsigned long)(nHigh & 0xFFFF) << 16) | (nLow & 0xFFFF) );
+
+//  the peer was told to stop (pending XON/XOFF is a change not told yet)
+    IsStopped = ( nFlowMode == FLOW_XONXOFF && flow_stat.IsRxStopped != ( nFlowOut ? 1:0 ) );
+
+    nFlowMode = nMode;
+    nFlowHigh = ( nHigh > 0 && nHigh <= FLOW_HOLD_SIZE ) ? nHigh : FLOW_HIGH;
+    nFlowLow = ( nLow >= 0 ? nLow : FLOW_LOW );
+    if( nFlowLow >= nFlowHigh ) nFlowLow = nFlowHigh - 1;
+
+//  the held bytes are kept, the peer (transmitter) goes
+    nFlowOut = ( IsStopped ? FLOW_XON : 0 );
+    flow_stat.IsTxStopped = flow_stat.IsRxStopped = 0;
+    if( nFlowMode == FLOW_RTSCTS && pFlowHandler ) (*pFlowHandler)( 1 );
+
+    _flowSend();
+}
+
+void pBSetFlowHook( TFlowHandler pHandler ) {
+//
+//  Set RTS/CTS board hook (FLOW_RTSCTS).
+//  -------------------------------------
+//  Port -B- has no modem lines, a board with them (or a GPIO pair) gives
+//  the hook: it sets RTS (1/0, -1 - kept) and returns CTS (1 - the peer is
+//  ready). It's called for every byte sent, so it should be short.
+//
+//  Arguments:
+//
+//      pHandler -- the hook, NULL - the peer is never stopped.
+//
+    pFlowHandler = pHandler;
+}
+
+void pBGetFlow( TFlowStat *pStat, int IsReset ) {
+//
+//  Get flow control state and counters.
+//  ------------------------------------
+//
+//  Arguments:
+//
+//      pStat -- stop states, held bytes and XON/XOFF counters
+//
+//      IsReset -- 1/0, clean the counters after (the state is kept).
+//
+    if( pStat ) *pStat = flow_stat;
+    if( IsReset ) {
+        flow_stat.nMaxHeld = flow_stat.nHeld;
+        flow_stat.nXoffSent = flow_stat.nXonSent = 0;
+        flow_stat.nXoffTaken = flow_stat.nXonTaken = 0;
+        flow_stat.nPauses = 0;
+    }
+}
+
+#endif
+
+TRequest pBLastRequest( int mode ) {
+//
+//  Get handle of the latest queued request.
+//  ----------------------------------------
+//
+//  Arguments:
+//
+//      mode -- MODE_TX (output request) or MODE_RX (input request).
+//
+//  Returns:
+//
+//      Request handle or REQUEST_NONE (nothing was queued or the latest
+//      request was rejected).
+//
+    return ( mode == MODE_RX ) ? hInLast : hOutLast;
+}
+
+int pBStatus( TRequest hRequest ) {
+//
+//  Get request state.
+//  ------------------
+//
+//  Returns:
+//
+//      REQUEST_QUEUED, REQUEST_ACTIVE (being sent or received),
+//      REQUEST_FINISHED (done, cancelled or dropped) or REQUEST_UNKNOWN.
+//
+    unsigned long nSeq = REQUEST_SEQ(hRequest);
+    int i;
+
+    if( hRequest == REQUEST_NONE )
+        return REQUEST_UNKNOWN;
+
+    if( REQUEST_IS_RX(hRequest) ) {
+        if( (long)(nSeq - nInSeq) >= 0 )
+            return REQUEST_UNKNOWN;
+        for( i=0; i<nInItems; i++ ) {
+            if( _getInItem(i)->nSeq == nSeq )
+                return ( !i && port_mode == MODE_RX ) ? REQUEST_ACTIVE : REQUEST_QUEUED;
+        }
+        return REQUEST_FINISHED;
+    }
+
+    if( (long)(nSeq - nOutSeq) >= 0 )
+        return REQUEST_UNKNOWN;
+    if( (i = _getOutItemIndex(nSeq)) < 0 )
+        return REQUEST_FINISHED;
+    return ( !i && port_mode == MODE_TX ) ? REQUEST_ACTIVE : REQUEST_QUEUED;
+}
+
+int pBCancel( TRequest hRequest ) {
+//
+//  Cancel the queued request.
+//  --------------------------
+//  The request being sent or received isn't cancelled (a line is never cut).
+//  Numbers of output requests cancelled behind current one are kept up to
+//  the transmitter passes them (REQUEST_HOLES ranges, adjacent ones merge).
+//
+//  Returns:
+//
+//      1/0 - cancelled or not (active, finished or unknown request, or no
+//            room for the number).
+//
+    unsigned long nSeq = REQUEST_SEQ(hRequest);
+    int i;
+
+    PB_TRACE_CALL( TRACE_CALL_CANCEL, 0 );
+//  the handle is traced back from the next number (a replay may start at any)
+    PB_TRACE_ARG( hRequest == REQUEST_NONE ? REQUEST_NONE :
+        REQUEST_HANDLE( ( REQUEST_IS_RX(hRequest) ? nInSeq : nOutSeq ) - nSeq, REQUEST_IS_RX(hRequest) ) );
+
+    if( pBStatus(hRequest) != REQUEST_QUEUED )
+        return 0;
+
+    if( REQUEST_IS_RX(hRequest) ) {
+        for( i=0; i<nInItems; i++ ) {
+            if( _getInItem(i)->nSeq == nSeq )
+                return _removeInItem(i);
+        }
+        return 0;
+    }
+
+    return ( (i = _getOutItemIndex(nSeq)) >= 0 && _removeOutItem(i) ) ? 1:0;
+}
+
+int pBFlushTx() {
+//
+//  Drop all output requests but the one being sent.
+//  ------------------------------------------------
+//
+//  Returns:
+//
+//      Number of dropped requests.
+//
+    int n = 0, nIndex = ( port_mode == MODE_TX ) ? 1:0;
+
+    PB_TRACE_CALL( TRACE_CALL_FLUSH_TX, 0 );
+
+    while( nOutItems > nIndex && _removeOutItem(nIndex) ) ++n;
+    return n;
+}
 
-    if( !nOutItems ) return PB_ERR_EMPTY;
+int pBFlushRx() {
+//
+//  Drop all input requests but the one being received.
+//  ---------------------------------------------------
+//
+//  Returns:
+//
+//      Number of dropped requests.
+//
+    int n = 0, nIndex = ( port_mode == MODE_RX ) ? 1:0;
 
-//  OK. Let's go. Transmit the first byte...
-    code = pBSend(1);
-    return (code ? code : PB_ERR_NONE);
+    PB_TRACE_CALL( TRACE_CALL_FLUSH_RX, 0 );
+
+    while( nInItems > nIndex && _removeInItem(nIndex) ) ++n;
+    return n;
 }
 
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=".fasttext"
+#endif
+
 int pBSend( int start ) {
 //
 //  *** SEND DATA ***
@@ -761,7 +3166,15 @@ int pBSend( int start ) {
 //      NONE (successfully) or Error (invalid data transmitted or any...).
 //
     unsigned char Data;
-    int IsError = 0, IsFlushed = 0, IsIRQEnabled = 0, IsStart = 0;
+    int IsError = 0, IsFlushed = 0, IsIRQEnabled = 0, IsStart = 0, IsActive;
+#ifdef PB_DEFERRED
+    int IsDeferred = 0;
+#endif
+#ifdef PB_FLOW_CONTROL
+    int IsFlowByte = 0, Timeout;
+#endif
+
+    PB_TRACE_CALL( TRACE_CALL_SEND, start );
 
 //  check if request exists
     if( !nOutItems )
@@ -770,6 +3183,32 @@ int pBSend( int start ) {
 //  check port direction
     if( port_mode == MODE_RX ) return PB_ERR_IS_BUSY;
 
+#ifdef PB_FLOW_CONTROL
+//  the receiver doesn't read the port meanwhile, the byte is held for it
+    if( nFlowMode ) _flowTake( 1 );
+//  paused by the peer (XOFF, CTS), our XON/XOFF goes anyway
+    if( !nFlowOut && _flowIsPaused() ) {
+        if( !IsFlowPaused ) ++flow_stat.nPauses;
+        IsFlowPaused = 1;
+        return PB_ERR_NONE;
+    }
+#endif
+
+#ifdef PB_ADAPTIVE_IRQ
+//  interrupts or polled phase (between requests)
+    _adaptCheck();
+#endif
+
+    IsActive = ( port_mode == MODE_TX );
+
+#ifdef PB_FLOW_CONTROL
+//  no transmitter interrupt is coming after a pause
+    if( IsFlowPaused ) {
+        IsFlowPaused = 0;
+        IsActive = 0;
+    }
+#endif
+
     IsIRQEnabled = pBIsIRQEnabled( PB_EITR );
 
 #ifdef PB_START_WITH_NEWLINE
@@ -782,15 +3221,30 @@ int pBSend( int start ) {
 #endif
 
 //  if no interrupts, wait...
-    if( port_mode == MODE_TX && IsIRQEnabled && !isr_pb )
+    if( IsActive && IsIRQEnabled && !isr_pb )
         return PB_ERR_NONE;
     else
         Data = *pOutItemsQueue;
 
+#ifdef PB_FLOW_CONTROL
+//  XON/XOFF goes ahead of the data (the queue isn't moved)
+    if( nFlowOut && !IsStart ) {
+        Data = nFlowOut;
+        IsFlowByte = 1;
+    }
+#endif
+
+#ifdef PB_DEFERRED
+//  deferred request is rendered by bytes (the item keeps a mark only)
+    if( !IsStart && Data == DEFER_MARK && (IsDeferred = _isDeferItem()) )
+        Data = _deferByte();
+#endif
+
 //  set transmitter port mode
     port_mode = MODE_TX;
 
 //  reset IRQ trigger
+    PB_TRACE_IRQ();
     isr_pb = 0;
 
 //  check the flush (riched last byte of a given item)
@@ -798,37 +3252,78 @@ int pBSend( int start ) {
 
     if( Data ) {
     //  check the errors
-        if( IsIRQEnabled ) {
+        if( IsIRQEnabled && IsActive ) {
     //  if interrups enabled, check the reason XXX
             if( !IsTXPortReady( IRQ_TIMEOUT ) ) IsError = PB_ERR_IS_NOT_READY;
             isr_pb_state = 0;
+        } else if( IsIRQEnabled ) {
+    //  the first byte, IRQ reason is out of date (transmitter may be busy yet)
+            if( !IsTXPortReady( 1 ) ) IsError = PB_ERR_IS_NOT_READY;
         } else {
-            if( !IsTXPortReady( DEFAULT_TIMEOUT ) ) IsError = PB_ERR_IS_NOT_READY;
+#ifdef PB_FLOW_CONTROL
+        //  nobody else reads the polled port, the bytes are held meanwhile
+            if( nFlowMode ) {
+                for( Timeout = nPortTimeout; !IsTXPortReady( 1 ) && --Timeout > 0; )
+                    _flowTake( 1 );
+                if( Timeout <= 0 ) IsError = PB_ERR_IS_NOT_READY;
+            }
+            else
+#endif
+            if( !IsTXPortReady( nPortTimeout ) ) IsError = PB_ERR_IS_NOT_READY;
         }
 
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
-        logger( msg, 1, "--> SENT(%d): %d\n", IsError, Data );
+        logger( pLogger, 1, "--> SENT(%d): %d\n", IsError, Data );
 #endif
 #endif
 
     //  send data and move current position
         if( !IsError ) {
-            BaseAddress[PB_TXHR] = Data;
-            if( !IsStart ) ++pOutItemsQueue;
+            PB_WRITE( PB_TXHR, Data );
+#ifdef PB_FLOW_CONTROL
+            if( IsFlowByte ) {
+                _flowSent( Data );
+                nFlowOut = 0;
+            }
+            else
+#endif
+#ifdef PB_DEFERRED
+            if( IsDeferred )
+                _deferNext();
+            else
+#endif
+            if( !IsStart )
+                ++pOutItemsQueue;
+#ifdef PB_ADAPTIVE_IRQ
+            ++nAdaptBytes;
+            if( adapt_stat.IsPolled ) ++adapt_stat.nPolledBytes;
+#endif
+#ifdef PB_LATENCY
+            if( !IsOutFirst ) {
+                nOutFirst = _getCycles();
+                IsOutFirst = 1;
+            }
+#endif
+        //  the reason may be kept by a receiver IRQ before the write, it's out of date now
+            if( IsIRQEnabled ) isr_pb_state |= TXRDY;
         }
     }
 
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
     else
-        logger( msg, 1, "--> NONE: %d\n", Data );
+        logger( pLogger, 1, "--> NONE: %d\n", Data );
 #endif
 #endif
 
 //  shift the queue and terminate the port if finalized
     if( IsFlushed ) {
+#ifdef PB_LATENCY
+        _doneOutItem( IsIRQEnabled );
+#endif
         _termPortBController();
+        _notifyOutWatermark();
     //  request was done
         return PB_OK;
     }
@@ -854,10 +3349,12 @@ int pBReceive( int start ) {
     unsigned char Data;
     int IsFlushed = 0, IsIRQEnabled = 0, IsOverflow = 0;
 
-#ifdef PB_CHECK_ERRORS
+#if defined(PB_CHECK_ERRORS) && !defined(PB_ERROR_RECOVERY)
     int IsError;
 #endif
 
+    PB_TRACE_CALL( TRACE_CALL_RECEIVE, start );
+
 //  check if request exists
     if( !nInItems )
         return PB_OK;
@@ -865,34 +3362,59 @@ int pBReceive( int start ) {
 //  check port direction
     if( port_mode == MODE_TX ) return PB_ERR_IS_BUSY;
 
+#ifdef PB_ADAPTIVE_IRQ
+//  interrupts or polled phase (between requests)
+    _adaptCheck();
+#endif
+
     IsIRQEnabled = pBIsIRQEnabled( PB_EIRC );
 
+#ifdef PB_FLOW_CONTROL
+//  flow control: bytes come through the hold (XON/XOFF are taken out),
+//  XON/XOFF left by the busy transmitter goes now
+    if( nFlowMode || flow_stat.nHeld ) {
+        if( IsIRQEnabled ) {
+            PB_TRACE_IRQ();
+            isr_pb = 0;
+        }
+        _flowSend();
+        _flowTake( flow_stat.nHeld || IsIRQEnabled ? 1 : nPortTimeout );
+        if( !flow_stat.nHeld )
+            return RX_IDLE(IsIRQEnabled);
+    }
+    else
+#endif
     if( IsIRQEnabled ) {
     //  if no interrupts, wait...
         if( !isr_pb )
-            return PB_ERR_NONE;
+            return RX_IDLE(1);
 
     //  reset IRQ trigger
+        PB_TRACE_IRQ();
         isr_pb = 0;
 
         if( !IsRXPortReady( IRQ_TIMEOUT ) ) {
 
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
-            logger( msg, 1, "... NOT READY(%08b)\n", isr_pb_state );
+            logger( pLogger, 1, "... NOT READY(%08b)\n", isr_pb_state );
 #endif
 #endif
 
-            return PB_ERR_NONE;
+            return RX_IDLE(1);
         }
 
-#ifdef PB_CHECK_ERRORS
+#ifdef PB_ERROR_RECOVERY
+    //  if an error, recover the line and skip damaged data...
+        if( _recoverPortErrors(isr_pb_state, 1) )
+            return PB_ERR_NONE;
+#elif defined(PB_CHECK_ERRORS)
     //  if an error, return...
-        if( IsError = GetPortErrorMask(isr_pb_state) ) {
+        if((IsError = GetPortErrorMask(isr_pb_state))) {
 
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
-            logger( msg, 1, "... ERROR(%08b)\n", isr_pb_state );
+            logger( pLogger, 1, "... ERROR(%08b)\n", isr_pb_state );
 #endif
 #endif
 
@@ -906,34 +3428,76 @@ int pBReceive( int start ) {
     //  reset IRQ reason state
         isr_pb_state = 0;
     } 
-    else if( !IsRXPortReady( DEFAULT_TIMEOUT ) )
+    else if( !IsRXPortReady( nPortTimeout ) )
+        return RX_IDLE(0);
+
+#ifdef PB_ERROR_RECOVERY
+    //  if an error, recover the line and skip damaged data...
+    else if( _recoverPortErrors(0, 1) )
         return PB_ERR_NONE;
+#endif
 
 //  set receiver port mode
     port_mode = MODE_RX;
 
+#ifdef PB_ERROR_RECOVERY
+//  skip the damaged line up to the next delimiter (resynchronization)
+    if( rx_state == RX_STATE_DISCARD ) {
+        Data = RX_READ();
+#ifdef PB_RX_MODES
+        if( (*pInItemsQueue).pOptions ) {
+            (*pInItemsQueue).nLast = _getCycles();
+            if( _isInDelimiter((*pInItemsQueue).pOptions, Data) ) rx_state = RX_STATE_DATA;
+        }
+        else
+#endif
+        if( Data == ENTER_CODE ) rx_state = RX_STATE_DATA;
+        return PB_ERR_NONE;
+    }
+#endif
+
+#ifdef PB_RX_MODES
+//  binary request: every byte is data, the end is by the request options
+    if( (*pInItemsQueue).pOptions )
+        return _receiveBinary( IsIRQEnabled );
+#endif
+
 //  check data for overflow
     if( (*pInItemsQueue).nMaxSize <= 1 ) {
 
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
-        logger( msg, 1, "--> OVERFLOW: %d\n", (*pInItemsQueue).nMaxSize );
+        logger( pLogger, 1, "--> OVERFLOW: %d\n", (*pInItemsQueue).nMaxSize );
 #endif
 #endif
 
         Data = ENTER_CODE;
         IsOverflow = 1;
-    } else
-        Data = BaseAddress[PB_RXHR];
+    } else {
+        Data = RX_READ();
+    //  the reason may be kept by an IRQ before the read, it's out of date now
+        if( IsIRQEnabled ) isr_pb_state &= ~RXRDY;
+#ifdef PB_ADAPTIVE_IRQ
+        ++nAdaptBytes;
+        if( adapt_stat.IsPolled ) ++adapt_stat.nPolledBytes;
+#endif
+    }
 
     if( Data ) {
 
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
-        logger( msg, 1, "--> RECEIVED(%d): %d\n", isr_pb_state, Data );
+        logger( pLogger, 1, "--> RECEIVED(%d): %d\n", isr_pb_state, Data );
 #endif
 #endif
 
+#ifdef PB_LATENCY
+        if( !(*pInItemsQueue).nFirst ) {
+            (*pInItemsQueue).nFirst = _getCycles();
+            _addLatency( LATENCY_RX_WAIT, IsIRQEnabled, (*pInItemsQueue).nFirst - (*pInItemsQueue).nQueued );
+        }
+#endif
+
         if( Data == ENTER_CODE ) {
             if( !IsOverflow ) *((*pInItemsQueue).pItem) = '\0';
             IsFlushed = 1;
@@ -947,12 +3511,16 @@ int pBReceive( int start ) {
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
     else
-        logger( msg, 1, "--> NONE: %d\n", Data );
+        logger( pLogger, 1, "--> NONE: %d\n", Data );
 #endif
 #endif
 
 //  shift the queue and terminate the port if finalized
     if( IsFlushed ) {
+#ifdef PB_LATENCY
+        if( (*pInItemsQueue).nFirst )
+            _addLatency( LATENCY_RX_DONE, IsIRQEnabled, _getCycles() - (*pInItemsQueue).nFirst );
+#endif
         _termPortBController();
     //  request was done
         return PB_OK;
@@ -961,6 +3529,282 @@ int pBReceive( int start ) {
     return PB_ERR_NONE;
 }
 
+#ifdef PB_FAST_TEXT
+#pragma ghs section text=default
+#endif
+
+int pBPoll() {
+//
+//  *** EVENTS LOOP STEP ***
+//  ------------------------
+//  Services the port once: transmitter and receiver take turns to go first,
+//  each of them sends (receives) a byte if the port is ready, without
+//  waiting (up to PB_ADAPT_BATCH bytes in polled phase of adaptive mode).
+//  Done requests are dispatched to the callbacks, then one of user tasks
+//  is called.
+//
+//  The port is half-duplex (*port_mode*): the direction which started an
+//  item keeps it up to the end, the other one gets PB_ERR_IS_BUSY and
+//  goes by its turn after. Input coming while an item is sent is lost to
+//  overruns unless PB_FLOW_CONTROL holds it (and stops the peer).
+//
+//  Returns:
+//
+//      Mask of happened events (PB_EVENT_...).
+//
+    TInItem *pr;
+    TTask *pt;
+    char *p, *sItem;
+    int i, n, code, timeout, events = 0;
+#ifdef PB_ADAPTIVE_IRQ
+    unsigned long m;
+    int k;
+#endif
+
+    PB_TRACE_CALL( TRACE_CALL_POLL, 0 );
+
+//  no waiting for the ready state
+    timeout = nPortTimeout;
+    nPortTimeout = 1;
+
+#ifdef PB_FLOW_CONTROL
+//  no input request: bytes are held, the peer is stopped in time
+    if( nFlowMode ) {
+        if( !nInItems ) _flowTake( 1 );
+        _flowSend();
+    }
+#endif
+
+    for( i=0; i<2; i++ ) {
+        if( (nPollTurn + i) & 1 ) {
+        //  receiver...
+            if( !nInItems ) continue;
+
+            pr = pInItemsQueue;
+            sItem = (*pr).pBuffer;
+            n = (*pr).nMaxSize;
+
+#ifdef PB_ADAPTIVE_IRQ
+            m = nAdaptBytes;
+#endif
+            code = pBReceive(0);
+#ifdef PB_ADAPTIVE_IRQ
+        //  polled phase: a batch while bytes come
+            for( k=1; adapt_stat.IsPolled && code == PB_ERR_NONE && nAdaptBytes != m && k < PB_ADAPT_BATCH; k++ ) {
+                m = nAdaptBytes;
+                code = pBReceive(0);
+            }
+#endif
+
+            if( code == PB_OK ) {
+                events |= PB_EVENT_RX_DONE;
+                if( pRxDoneHandler ) (*pRxDoneHandler)( sItem );
+            }
+            else if( code > 0 )
+                events |= PB_EVENT_ERROR;
+            else if( (*pr).nMaxSize != n )
+                events |= PB_EVENT_RX;
+        }
+        else {
+        //  transmitter...
+            if( !nOutItems ) continue;
+
+            p = pOutItemsQueue;
+
+#ifdef PB_ADAPTIVE_IRQ
+            m = nAdaptBytes;
+#endif
+            code = pBSend(0);
+#ifdef PB_ADAPTIVE_IRQ
+        //  polled phase: a batch while the transmitter is ready
+            for( k=1; adapt_stat.IsPolled && code == PB_ERR_NONE && nAdaptBytes != m && k < PB_ADAPT_BATCH; k++ ) {
+                m = nAdaptBytes;
+                code = pBSend(0);
+            }
+#endif
+
+            if( code == PB_OK ) {
+                events |= PB_EVENT_TX_DONE;
+                if( pTxDoneHandler ) (*pTxDoneHandler)( 0 );
+            }
+            else if( pOutItemsQueue != p )
+                events |= PB_EVENT_TX;
+        }
+    }
+
+    nPollTurn ^= 1;
+    nPortTimeout = timeout;
+
+//  user task (round robin)
+    if( nTasks ) {
+        if( nNextTask >= nTasks ) nNextTask = 0;
+        pt = &aTasks[nNextTask++];
+        (*pt->pTask)( pt->pArg );
+        events |= PB_EVENT_TASK;
+    }
+
+    return events;
+}
+
+void pBSetHandlers( TRequestHandler pTxDone, TRequestHandler pRxDone ) {
+//
+//  Set requests done callbacks (*pBPoll*).
+//  ---------------------------------------
+//
+//  Arguments:
+//
+//      pTxDone -- output request done callback (takes NULL)
+//
+//      pRxDone -- input request done callback (takes received data buffer).
+//
+    pTxDoneHandler = pTxDone;
+    pRxDoneHandler = pRxDone;
+}
+
+int pBAddTask( TTaskHandler pTask, void *pArg ) {
+//
+//  Register user task (*pBPoll*).
+//  ------------------------------
+//
+//  Arguments:
+//
+//      pTask -- task function, should be short and never wait
+//
+//      pArg -- task argument.
+//
+//  Returns:
+//
+//      1/0 - successfully or overflow.
+//
+    if( !pTask || nTasks >= PB_MAX_TASKS )
+        return 0;
+
+    aTasks[nTasks].pTask = pTask;
+    aTasks[nTasks].pArg = pArg;
+    ++nTasks;
+
+    return 1;
+}
+
+int pBRemoveTask( TTaskHandler pTask ) {
+//
+//  Unregister user task.
+//  ---------------------
+//
+//  Returns:
+//
+//      1/0 - successfully or not found.
+//
+    int i;
+
+    for( i=0; i<nTasks; i++ ) {
+        if( aTasks[i].pTask != pTask )
+            continue;
+        for( --nTasks; i<nTasks; i++ )
+            aTasks[i] = aTasks[i+1];
+        return 1;
+    }
+
+    return 0;
+}
+
+#ifdef PB_SELF_TEST
+
+int pBSelfTest( TSelfTest *pResults ) {
+//
+//  *** LOOPBACK SELF-TEST ***
+//  --------------------------
+//  Turns on internal loopback (*CNR->LOOP*) and streams a pattern of
+//  SELFTEST_SIZE bytes through *TXD* and *RXD* at every speed of
+//  *RS232_Speeds*, with no external equipment. Port interrupts are disabled
+//  while the test runs, *CNR* and *IER* are restored after. The queues
+//  should be empty (port is not occupied).
+//
+//  Arguments:
+//
+//      pResults -- results array (SELFTEST_SPEEDS items) or NULL (log only).
+//
+//  Returns:
+//
+//      Number of errors and timeouts (0 - passed) or PB_ERR_IS_BUSY.
+//
+    TSelfTest r;
+    unsigned char cnr, saved, status, Data, Pattern;
+    unsigned long t;
+    int i, n, total = 0;
+
+    if( port_mode != MODE_NONE || nOutItems || nInItems )
+        return PB_ERR_IS_BUSY;
+
+    _saveIERState();
+    saved = PB_READ(PB_CNR);
+
+    for( i=0; i<SELFTEST_SPEEDS; i++ ) {
+        memset( &r, 0, sizeof(r) );
+        r.sSpeed = RS232_SpeedsStr[0][i];
+
+    //  set speed and loopback mode (*SPEED* bits are written explicitly)
+        cnr = ( saved & ~0x06 ) | ( RS232_Speeds[i] & 0x06 ) | 0x08 | 0x01;
+        PB_WRITE( PB_CNR, cnr );
+
+    //  take stale data out of the receiver
+        for( n=0; n<SELFTEST_DRAIN && ( PB_READ(PB_STATUS) & RXRDY ); n++ )
+            rx = PB_READ(PB_RXHR);
+
+        t = _getCycles();
+
+        for( n=0; n<SELFTEST_SIZE; n++ ) {
+        //  every byte value once per 256 bytes, starts with 0x55 (bits toggle)
+            Pattern = (unsigned char)( 0x55 ^ (n * 0x3B) ^ (n >> 8) );
+
+            if( !IsTXPortReady( nPortTimeout ) ) {
+                ++r.nTimeouts;
+                break;
+            }
+            PB_WRITE( PB_TXHR, Pattern );
+
+            if( !IsRXPortReady( nPortTimeout ) ) {
+                ++r.nTimeouts;
+                break;
+            }
+            status = PB_READ(PB_STATUS);
+            Data = PB_READ(PB_RXHR);
+
+            if( ( status & TX_ERROR_MASK ) || Data != Pattern )
+                ++r.nErrors;
+            else
+                ++r.nBytes;
+        }
+
+        r.nCycles = _getCycles() - t;
+        if( r.nCycles ) {
+            r.nBytesPerSec = (unsigned long)( (double)r.nBytes * PB_CPU_HZ / r.nCycles );
+            r.nCyclesPerByte = ( r.nBytes ? r.nCycles / r.nBytes : 0 );
+        }
+
+#ifdef PB_USE_LOGGER
+        logger( pLogger, 1, "--> PORT -B- SELF-TEST %s: %lu bytes, %lu errors, %lu timeouts, %lu bytes/s, %lu cycles/byte\n",
+            r.sSpeed, r.nBytes, r.nErrors, r.nTimeouts, r.nBytesPerSec, r.nCyclesPerByte );
+#endif
+
+        total += (int)( r.nErrors + r.nTimeouts );
+        if( pResults ) pResults[i] = r;
+    }
+
+//  let the last byte go, then restore port state
+    IsTXPortReady( nPortTimeout );
+    PB_WRITE( PB_CNR, saved );
+    for( n=0; n<SELFTEST_DRAIN && ( PB_READ(PB_STATUS) & RXRDY ); n++ )
+        rx = PB_READ(PB_RXHR);
+    isr_pb_state = 0;
+    isr_pb = 0;
+    _restoreIERState();
+
+    return total;
+}
+
+#endif
+
 int pBIsIRQEnabled( int mode ) {
 //
 //  Checks if IRQ port -B- enabled.
@@ -977,6 +3821,136 @@ int pBIsIRQEnabled( int mode ) {
     return ( GetIRQStatus(mode) ? 1:0 );
 }
 
+int pBGetLatency( int IsIRQ, int nKind, TLatency *pLatency, int IsReset ) {
+//
+//  Get requests latency histogram.
+//  -------------------------------
+//
+//  Arguments:
+//
+//      IsIRQ -- 1/0, requests done in IRQ or polled mode
+//
+//      nKind -- LATENCY_TX_WAIT/TX_DONE/RX_WAIT/RX_DONE
+//
+//      pLatency -- histogram buffer pointer
+//
+//      IsReset -- 1/0, clean the histogram after.
+//
+//  Returns:
+//
+//      Number of requests (PB_LATENCY, 0 - not available).
+//
+#ifdef PB_LATENCY
+    TLatency *pl;
+    int n;
+
+    if( nKind < 0 || nKind >= LATENCY_KINDS )
+        return 0;
+
+    pl = &aLatency[IsIRQ ? 1:0][nKind];
+    n = (int)pl->nCount;
+    if( pLatency ) *pLatency = *pl;
+    if( IsReset ) memset( pl, 0, sizeof(TLatency) );
+
+    return n;
+#else
+    return 0;
+#endif
+}
+
+TIdleHandler pBSetIdle( TIdleHandler pHandler ) {
+//
+//  Set idle strategy.
+//  ------------------
+//  The handler is called while the driver (or application) waits for the
+//  port longer than PB_IDLE_SPINS, it should return when an interrupt
+//  comes (the port or timer tick). By default it's *wait* instruction.
+//  The receiver (and a push blocked by OVERFLOW_BLOCK) goes idle only with
+//  EIRC enabled: masked, it couldn't wake the CPU up before the next byte
+//  overruns *RXD*.
+//
+//  Arguments:
+//
+//      pHandler -- idle handler, NULL - spin (no idle).
+//
+//  Returns:
+//
+//      Previous handler.
+//
+    TIdleHandler pPrevious = pIdleHandler;
+
+    pIdleHandler = pHandler;
+    return pPrevious;
+}
+
+int pBIdle( int *pSpins ) {
+//
+//  *** WAITING STEP ***
+//  --------------------
+//  Waiting loops call it every pass: first PB_IDLE_SPINS passes just spin
+//  (the port is expected soon), then the idle handler is called (the link
+//  is idle or the peer is slow), the CPU goes back to other software.
+//
+//  Arguments:
+//
+//      pSpins -- passes counter of the loop (zero before the loop).
+//
+//  Returns:
+//
+//      Spins the step is counted for (1 or PB_IDLE_COST), to keep timeouts.
+//
+    if( !pIdleHandler || ++(*pSpins) <= PB_IDLE_SPINS )
+        return 1;
+
+    (*pIdleHandler)();
+    return PB_IDLE_COST;
+}
+
+void pBGetErrors( TPortErrors *pErrors, int IsReset ) {
+//
+//  Get line errors counters.
+//  -------------------------
+//
+//  Arguments:
+//
+//      pErrors -- counters buffer pointer
+//
+//      IsReset -- 1/0, clean counters after or not.
+//
+#ifdef PB_ERROR_RECOVERY
+    if( pErrors ) *pErrors = port_errors;
+    if( IsReset ) memset( &port_errors, 0, sizeof(port_errors) );
+#else
+    if( pErrors ) memset( pErrors, 0, sizeof(TPortErrors) );
+#endif
+}
+
+int pBGetPoolStat( TSlabClass *pClasses ) {
+//
+//  Get output items pool occupancy.
+//  --------------------------------
+//
+//  Arguments:
+//
+//      pClasses -- buffer for SLAB_CLASSES items (size classes state).
+//
+//  Returns:
+//
+//      Number of size classes (0 if no pool).
+//
+#ifdef PB_SLAB_QUEUE
+    int c;
+
+    for( c=0; c<SLAB_CLASSES; c++ ) {
+        pClasses[c] = aSlabClasses[c];
+        pClasses[c].pFree = 0;
+    }
+    return SLAB_CLASSES;
+#else
+    return 0;
+#endif
+}
+
 void pBPrintf( char *log ) {
 //
 //  Print the *log*, disable port interrupts before.
@@ -38,27 +38,369 @@
 #define MODE_NONE                0        // none
 #define MODE_TX                  1        // transmitter is busy (occupied)
 
-#define TX_ERROR_MASK           (0x04 | 0x08 | 0x10)
+#define ERR_PARITY               0x04     // parity error (ERP)
+#define ERR_FRAMING              0x08     // framing error (ERF)
+#define ERR_OVERRUN              0x10     // receiver overrun (OV)
+
+#define TX_ERROR_MASK           (ERR_PARITY | ERR_FRAMING | ERR_OVERRUN)
+//
+//  Receiver line state (error recovery)
+//
+#define RX_STATE_DATA            0        // receiving data of the line
+#define RX_STATE_DISCARD         1        // damaged line, skip up to the next delimiter
 
 #define MAX_OUTPUT_ITEM_SIZE     1024
 #define OUTPUT_SIZE              10*MAX_OUTPUT_ITEM_SIZE
 #define MAX_INPUT_ITEMS_COUNTER  10
 
 #define LOGGER_SIZE              20*1024
+//
+//  Events loop (pBPoll) definitions
+//
+#define PB_EVENT_TX              0x01     // a byte was transmitted
+#define PB_EVENT_RX              0x02     // a byte was received
+#define PB_EVENT_TX_DONE         0x04     // output request was done
+#define PB_EVENT_RX_DONE         0x08     // input request was done
+#define PB_EVENT_TASK            0x10     // user task was called
+#define PB_EVENT_ERROR           0x20     // line error status returned
+
+#define PB_MAX_TASKS             8
 
 #define SIZE_OFFSET              2
+//
+//  Output items pool size classes (PB_SLAB_QUEUE)
+//
+#define SLAB_CLASSES             3
+#define SLAB_SIZE_SMALL          32
+#define SLAB_SIZE_MEDIUM         128
+#define SLAB_SIZE_LARGE          ((MAX_OUTPUT_ITEM_SIZE + sizeof(void *)) & ~(sizeof(void *)-1)) // max item and terminator (aligned)
+#define SLAB_SHARES              { 25, 35, 40 } // queue storage shares by classes (%)
 
 #define ENTER_CODE               0x0D
+//
+//  Output queue overflow policies (pBSetOverflow)
+//
+#define OVERFLOW_REJECT          0        // the new item is rejected
+#define OVERFLOW_DROP_OLDEST     1        // the oldest items not being sent are dropped
+#define OVERFLOW_BLOCK           2        // wait for the transmitter up to timeout
+//
+//  Request handles (pBLastRequest, pBStatus, pBCancel)
+//
+#define REQUEST_NONE             0        // no request
+#define REQUEST_UNKNOWN         -1        // not a request handle
+#define REQUEST_FINISHED         0        // done, cancelled or dropped
+#define REQUEST_QUEUED           1        // waiting in the queue
+#define REQUEST_ACTIVE           2        // being sent or received
+
+#define REQUEST_HOLES            32       // output items removed out of order (ranges)
+
+#define REQUEST_HANDLE(seq,rx)   ( (((TRequest)(seq) + 1) << 1) | (rx) )
+#define REQUEST_SEQ(h)           ( ((h) >> 1) - 1 )
+#define REQUEST_IS_RX(h)         ( (h) & 1 )
+//
+//  Requests latency histograms (PB_LATENCY)
+//
+#define LATENCY_TX_WAIT          0        // output request: queued -> first byte
+#define LATENCY_TX_DONE          1        // output request: queued -> last byte sent
+#define LATENCY_RX_WAIT          2        // input request: queued -> first byte
+#define LATENCY_RX_DONE          3        // input request: first byte -> done
+#define LATENCY_KINDS            4
+
+#define LATENCY_BUCKETS          32       // log2 buckets (cycles)
+#define LATENCY_ITEMS            64       // output items stamps ring (items pushed when full are not stamped)
+//
+//  Deferred output requests (PB_DEFERRED)
+//
+#define DEFER_MARK               0x1A     // queue item of a deferred request (SUB)
+#define DEFER_ITEMS              16       // deferred requests records (FIFO)
+#define DEFER_ARGS               6        // max arguments of a deferred request
+#define DEFER_MAX_WIDTH          32       // max width/precision of a conversion
+#define DEFER_CONV_SIZE          48       // rendered conversion buffer
+#define DEFER_SPEC_SIZE          16       // conversion specification buffer
+//
+//  Loopback self-test (PB_SELF_TEST)
+//
+#define SELFTEST_SPEEDS          3        // *RS232_Speeds* tested
+#define SELFTEST_SIZE            1024     // pattern size (bytes) for a speed
+#define SELFTEST_DRAIN           16       // max stale bytes taken out of *RXD*
+
+#ifndef PB_CPU_HZ
+#define PB_CPU_HZ                200000000 // CPU clock (Hz)
+#endif
+#define PB_COUNT_RATE            2        // CPU cycles per CP0 *Count* increment
+//
+//  Idle strategy (waiting for the port)
+//
+#ifndef PB_IDLE_SPINS
+#define PB_IDLE_SPINS            10000    // spins before going idle (a few characters at 19200)
+#endif
+#ifndef PB_IDLE_COST
+#define PB_IDLE_COST             5000     // spins an idle wake is counted for timeouts (a timer tick)
+#endif
+//
+//  Adaptive interrupts mode (PB_ADAPTIVE_IRQ, pBSetAdaptive)
+//
+#define ADAPT_WINDOW             (PB_CPU_HZ/100) // load window (cycles, 10 ms)
+#define ADAPT_HIGH_BYTES         32       // bytes in a window to go polled (a third of 115200 line)
+#define ADAPT_LOW_BYTES          2        // max bytes in a quiet window
+#ifndef PB_ADAPT_QUIET
+#define PB_ADAPT_QUIET           2        // quiet windows to go back to interrupts
+#endif
+#ifndef PB_ADAPT_BATCH
+#define PB_ADAPT_BATCH           16       // bytes a direction per *pBPoll* in polled phase
+#endif
+//
+//  Input request options (PB_RX_MODES, pBInRequestEx)
+//
+#define IN_COUNT                 0x01     // done after *nCount* bytes
+#define IN_DELIMITERS            0x02     // done by a byte of *sDelimiters* set (kept in the data)
+#define IN_GAP                   0x04     // done when the line is idle for *nGapChars* characters
+                                          // done reasons (*nEnd*)
+#define IN_END_NONE              0        // not done (in progress, cancelled)
+#define IN_END_COUNT             1        // *nCount* bytes received
+#define IN_END_DELIMITER         2        // a delimiter received
+#define IN_END_GAP               3        // inter-byte gap elapsed
+#define IN_END_FULL              4        // buffer is full
+#define CHAR_BITS                11       // character on the line: start, 8 data, parity, stop bits
+//
+//  Flow control (PB_FLOW_CONTROL, pBSetFlow)
+//
+#define FLOW_NONE                0        // no flow control
+#define FLOW_XONXOFF             1        // in-band XON/XOFF (not data bytes)
+#define FLOW_RTSCTS              2        // RTS/CTS by the board hook (*pBSetFlowHook*)
+#define FLOW_XON                 0x11     // DC1, the peer may send
+#define FLOW_XOFF                0x13     // DC3, the peer should stop
+#define FLOW_HOLD_SIZE           32       // bytes taken from *RXD* the receiver hasn't got yet (power of two)
+#define FLOW_HIGH                16       // held bytes to stop the peer (room for its reaction)
+#define FLOW_LOW                 4        // held bytes to let the peer go again
+//
+//  Registers access (PB_REGISTER_MODEL - software model of the port, see pBModel.c)
+//
+#ifdef PB_REGISTER_MODEL
+#define PB_RAW_READ(r)           pBModelRead(r)
+#define PB_RAW_WRITE(r,v)        pBModelWrite(r, v)
+#else
+#define PB_RAW_READ(r)           (PB_BASE[r])
+#define PB_RAW_WRITE(r,v)        (PB_BASE[r] = (unsigned char)(v))
+#endif
+#ifdef PB_HOT_STATE
+#define PB_BASE                  port_hot.pBase
+#else
+#define PB_BASE                  BaseAddress
+#endif
+
+//
+//  Registers trace (PB_REGISTER_TRACE - record, PB_REGISTER_REPLAY - replay on
+//  the host, see pBTrace.c): accesses, client calls with pushed data and taken
+//  interrupts go through the trace hooks
+//
+#if defined(PB_REGISTER_TRACE) || defined(PB_REGISTER_REPLAY)
+#define PB_READ(r)               pBTraceRead(r)
+#define PB_WRITE(r,v)            pBTraceWrite(r, (unsigned char)(v))
+#define PB_TRACE_CALL(c,v)       pBTraceCall(c, v)
+#define PB_TRACE_ARG(a)          pBTraceArg((unsigned long)(a))
+#define PB_TRACE_ITEM(p,n)       pBTraceItem(p, n)
+#define PB_TRACE_IRQ()           if( isr_pb ) pBTraceIRQ(isr_pb_state)
+#else
+#define PB_READ(r)               PB_RAW_READ(r)
+#define PB_WRITE(r,v)            PB_RAW_WRITE(r, v)
+#define PB_TRACE_CALL(c,v)
+#define PB_TRACE_ARG(a)
+#define PB_TRACE_ITEM(p,n)
+#define PB_TRACE_IRQ()
+#endif
+
+//
+//  Receiver has no byte ready (PB_RX_MODES - binary request may be done by
+//  the inter-byte gap)
+//
+#ifdef PB_RX_MODES
+#define RX_IDLE(irq)             _checkInGap(irq)
+#else
+#define RX_IDLE(irq)             PB_ERR_NONE
+#endif
+
+//
+//  Receiver data register (PB_FLOW_CONTROL - bytes held by the flow check
+//  go first)
+//
+#ifdef PB_FLOW_CONTROL
+#define RX_READ()                _flowRead()
+#else
+#define RX_READ()                PB_READ(PB_RXHR)
+#endif
+
+//
+//  Word-at-a-time string helpers (PB_SWAR_STRINGS, see pBString.c)
+//
+#ifdef PB_SWAR_STRINGS
+#define strsize                  wstrsize
+#define strpush                  wstrpush
+#define strpop                   wstrpop
+#define strshift                 wstrshift
+#define stradd                   wstradd
+#define endswith                 wendswith
+#endif
 
 // *****************************************************************************
 //  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
 // *****************************************************************************
 typedef unsigned int PADDR;
 
+typedef unsigned long TRequest;           // request handle (REQUEST_NONE - none)
+
+typedef struct {                          // input request options (PB_RX_MODES, kept by the caller)
+    int   nMode;                          // IN_COUNT, IN_DELIMITERS, IN_GAP (any of, none - up to full buffer)
+    int   nCount;                         // exact bytes number (IN_COUNT)
+    char *sDelimiters;                    // delimiters set (IN_DELIMITERS)
+    int   nDelimiters;                    // delimiters number
+    int   nGapChars;                      // inter-byte gap (IN_GAP, character times)
+    int   nReceived;                      // done: bytes received
+    int   nEnd;                           // done: reason (IN_END_...)
+} TInOptions;
+
 typedef struct {                          // input item
     char *pItem;                          // received data buffer pointer
     int   nMaxSize;                       // max size limits
+    char *pBuffer;                        // buffer beginning (to restart damaged line)
+    int   nSize;                          // given max size
+    unsigned long nSeq;                   // request number (handle)
+#ifdef PB_LATENCY
+    unsigned long nQueued;                // request time (cycles)
+    unsigned long nFirst;                 // first byte time (cycles)
+#endif
+#ifdef PB_RX_MODES
+    TInOptions *pOptions;                 // binary request options (NULL - text line)
+    unsigned long nLast;                  // last byte time (cycles, IN_GAP)
+    unsigned long nGap;                   // inter-byte gap (cycles, IN_GAP)
+#endif
 } TInItem;
+
+typedef struct _TOutItem {                // output item (PB_SLAB_QUEUE)
+    struct _TOutItem *pNext;              // next item in the queue (free list)
+    char *pData;                          // item data (string)
+    int   nClass;                         // size class
+} TOutItem;
+
+typedef struct {                          // output items numbers range
+    unsigned long nFirst, nLast;
+} TSeqRange;
+
+typedef struct {                          // output item part (pBPushv)
+    char *pData;                          // part data
+    int   nSize;                          // part size (bytes), negative - string
+} TOutPart;
+
+typedef union {                           // deferred request argument
+    long  l;                              // signed integer, character
+    unsigned long u;                      // unsigned integer
+    char *s;                              // string (kept by the caller)
+} TDeferArg;
+
+typedef struct {                          // deferred output request (PB_DEFERRED)
+    unsigned long nSeq;                   // queue item number
+    char *pFormat;                        // format string (kept by the caller)
+    int   IsNewLine;                      // line delimeters are added
+    TDeferArg aArgs[DEFER_ARGS];          // arguments
+} TDeferRecord;
+
+typedef struct {                          // output items pool size class
+    int   nItemSize;                      // item data size (bytes)
+    int   nCount;                         // items in the class
+    int   nUsed;                          // items in use
+    int   nMaxUsed;                       // max items in use
+    int   nFailed;                        // allocation failures
+    TOutItem *pFree;                      // free items list
+} TSlabClass;
+
+typedef void (*TWatermarkHandler)( int ); // queue low watermark callback (free bytes)
+typedef void (*TRequestHandler)( char * ); // request done callback (input buffer or NULL)
+typedef void (*TTaskHandler)( void * );   // user task (lightweight, non-blocking)
+typedef void (*TIdleHandler)( void );     // idle strategy (sleeps up to an interrupt)
+typedef int  (*TFlowHandler)( int );     // RTS/CTS hook: sets RTS (1/0, -1 - kept), returns CTS (1 - peer is ready)
+
+typedef struct {                          // user task
+    TTaskHandler pTask;                   // task function
+    void *pArg;                           // task argument
+} TTask;
+
+typedef struct {                          // port hot state (PB_HOT_STATE)
+    unsigned char *pBase;                 // registers area base pointer (*BaseAddress*)
+    char    *pOutItemsQueue;              // current output item
+    char    *pOutNext;                    // output queue end
+    TInItem *pInItemsQueue;               // current input item
+    TInItem *pInNext;                     // input queue end
+    int      nOutItems;                   // output items counter
+    int      nInItems;                    // input items counter
+    int      port_mode;                   // port direction mode
+    int      nPortTimeout;                // ready state waiting timeout (no IRQ)
+} TPortHot;
+
+typedef struct {                          // port queues memory (caller provided)
+    char    *pOutQueue;                   // transmitter queue storage
+    int      nOutSize;                    // transmitter queue size (bytes)
+    TInItem *pInQueue;                    // receiver queue storage
+    int      nInItems;                    // receiver queue capacity (items)
+    char    *pLogger;                     // trace messages log buffer
+    int      nLoggerSize;                 // trace messages log size (bytes)
+} TPortMemory;
+
+typedef struct {                          // loopback self-test results (a speed)
+    char *sSpeed;                         // speed name
+    unsigned long nBytes;                 // bytes looped back successfully
+    unsigned long nErrors;                // mismatched bytes and line errors
+    unsigned long nTimeouts;              // transmitter/receiver ready timeouts
+    unsigned long nCycles;                // CPU cycles spent
+    unsigned long nBytesPerSec;           // measured throughput
+    unsigned long nCyclesPerByte;         // CPU cycles per byte
+} TSelfTest;
+
+typedef struct {                          // output item stamp (PB_LATENCY)
+    unsigned long nSeq;                   // item number
+    unsigned long nQueued;                // push time (cycles)
+} TOutStamp;
+
+typedef struct {                          // latency histogram (cycles)
+    unsigned long aBuckets[LATENCY_BUCKETS]; // [i] - from 2^i up to 2^(i+1)-1
+    unsigned long nCount;                 // requests
+    unsigned long nMin, nMax;             // min/max latency
+} TLatency;
+
+typedef struct {                          // output queue overflow counters
+    unsigned long nDroppedItems;          // old items dropped (OVERFLOW_DROP_OLDEST)
+    unsigned long nDroppedBytes;          // their bytes
+    unsigned long nRejectedItems;         // new items rejected
+    unsigned long nRejectedBytes;         // their bytes
+    unsigned long nBlocked;               // pushes waited for space (OVERFLOW_BLOCK)
+} TOverflowStat;
+
+typedef struct {                          // adaptive interrupts mode counters (PB_ADAPTIVE_IRQ)
+    int   IsPolled;                       // current phase: 1 - polled batches, 0 - interrupts
+    unsigned long nToPolled;              // switches to polled batches
+    unsigned long nToIRQ;                 // switches back to interrupts
+    unsigned long nWindows;               // load windows measured
+    unsigned long nLastBytes;             // bytes of the last window
+    unsigned long nPolledBytes;           // bytes handled in polled phase
+} TAdaptStat;
+
+typedef struct {                          // flow control state and counters (PB_FLOW_CONTROL)
+    int   IsTxStopped;                    // the peer stopped the transmitter (XOFF)
+    int   IsRxStopped;                    // the peer is stopped (XOFF sent, RTS off)
+    int   nHeld;                          // bytes held for the receiver
+    int   nMaxHeld;                       // max bytes held
+    unsigned long nXoffSent;              // XOFF sent (RTS turned off)
+    unsigned long nXonSent;               // XON sent (RTS turned on)
+    unsigned long nXoffTaken;             // XOFF received
+    unsigned long nXonTaken;              // XON received
+    unsigned long nPauses;                // transmitter pauses (XOFF, CTS off)
+} TFlowStat;
+
+typedef struct {                          // line errors counters
+    int   nParity;                        // parity errors (ERP)
+    int   nFraming;                       // framing errors (ERF)
+    int   nOverrun;                       // overrun errors (OV)
+    int   nDiscarded;                     // damaged lines discarded
+} TPortErrors;
 //
 //  Protected ------------------------------------------------------------------
 //
@@ -80,22 +422,97 @@ void  _initInItemsQueue   ();
 void  _initOutItemsQueue  ();
 void  _initPortBController( void );
 void  _termPortBController( void );
+void  _notifyOutWatermark ( void );
 void  _saveIERState       ();
 void  _restoreIERState    ();
 void  _delay              ( unsigned int );
+int   _recoverPortErrors  ( unsigned char, int );
+void  _initOutItemsPool   ( void );
+TOutItem *_allocOutItem   ( int );
+void  _freeOutItem        ( TOutItem * );
+int   _getOutQueueUsed    ( void );
+int   _getOutQueueSize    ( void );
+int   _fitOutItem         ( int, int );
+int   _fitEmptyOutQueue   ( int, int );
+void  _nextOutSeq         ( void );
+int   _addOutHole         ( unsigned long );
+int   _getOutItemIndex    ( unsigned long );
+unsigned long _getOutItemSeq( int );
+int   _removeOutItem      ( int );
+int   _dropOutItem        ( void );
+int   _removeInItem       ( int );
+TInItem *_getInItem       ( int );
+char *_openOutItem        ( int );
+void  _closeOutItem       ( char *, int );
+unsigned long _getCycles  ( void );
+unsigned long _charTime   ( void );
+void  _idleWait           ( void );
+char *_deferSpec          ( char *, int *, int * );
+int   _scanDeferFormat    ( char * );
+void  _releaseDeferRecords( void );
+int   _isDeferItem        ( void );
+unsigned char _deferByte  ( void );
+void  _deferNext          ( void );
+void  _addLatency         ( int, int, unsigned long );
+void  _stampOutItem       ( void );
+void  _doneOutItem        ( int );
+void  _adaptReset         ( void );
+void  _adaptCheck         ( void );
+int   _pushInItem         ( char *, int, TInOptions * );
+unsigned long _charCycles ( void );
+int   _isInDelimiter      ( TInOptions *, unsigned char );
+int   _receiveBinary      ( int );
+int   _checkInGap         ( int );
+int   _doneInItem         ( int, int );
+void  _flowReset           ( void );
+int   _flowTake           ( int );
+unsigned char _flowRead   ( void );
+void  _flowCheck          ( void );
+void  _flowSend           ( void );
+void  _flowSent           ( unsigned char );
+int   _flowIsPaused       ( void );
 //
 //  Public (client interface) --------------------------------------------------
 //
 int   pBInit              ( int, int );         // port intialization
+int   pBInitEx            ( int, int, TPortMemory * ); // port intialization with given queues memory
 void  pBTerm              ( void );             // port termination
 int   pBInRequest         ( char *, int );      // start receiving of a new line (...)
+int   pBInRequestEx       ( char *, int, TInOptions * ); // start receiving of binary data (count, delimiters, gap)
 int   pBPush              ( char *, int, int ); // push an output request in the queue
+int   pBPushv             ( TOutPart *, int );  // push an output request gathered from parts
 int   pBOutRequest        ( char *, ... );      // start transmitting with a new request
+int   pBDeferRequest      ( char *, ... );      // the same, the text is rendered at transmit time
 int   pBSend              ( int );              // call transmitter (sends current byte)
 int   pBReceive           ( int );              // call receiver (gets current byte)
 int   pBIsIRQEnabled      ( int );              // check IRQ state
 void  pBPrintf            ( char * );           // print given messages log buffer
 int   pBGetchar           ();                   // get a byte from *stdin*
+void  pBGetErrors         ( TPortErrors *, int ); // get line errors counters
+int   pBGetPoolStat       ( TSlabClass * );     // get output items pool occupancy
+int   pBTxFree            ( void );             // get output queue free space
+int   pBReserve           ( int );              // reserve output queue space for the next push
+void  pBSetLowWatermark   ( int, TWatermarkHandler ); // set output queue drain callback
+void  pBSetOverflow       ( int, int );         // set output queue overflow policy
+void  pBGetOverflow       ( TOverflowStat *, int ); // get overflow counters
+void  pBSetAdaptive       ( int, int, unsigned long ); // set adaptive interrupts mode thresholds
+void  pBGetAdaptive       ( TAdaptStat *, int ); // get adaptive mode counters
+void  pBSetFlow           ( int, int, int );    // set flow control mode and watermarks
+void  pBSetFlowHook       ( TFlowHandler );     // set RTS/CTS board hook
+void  pBGetFlow           ( TFlowStat *, int ); // get flow control state and counters
+TRequest pBLastRequest    ( int );              // handle of the latest queued request
+int   pBStatus            ( TRequest );         // get request state
+int   pBCancel            ( TRequest );         // cancel queued request
+int   pBFlushTx           ( void );             // drop queued output requests
+int   pBFlushRx           ( void );             // drop queued input requests
+int   pBPoll              ( void );             // service port once (events loop step)
+void  pBSetHandlers       ( TRequestHandler, TRequestHandler ); // set requests done callbacks
+int   pBAddTask           ( TTaskHandler, void * ); // register user task
+int   pBRemoveTask        ( TTaskHandler );     // unregister user task
+int   pBSelfTest          ( TSelfTest * );      // loopback self-test and benchmark
+int   pBGetLatency        ( int, int, TLatency *, int ); // get requests latency histogram
+TIdleHandler pBSetIdle    ( TIdleHandler );     // set idle strategy (NULL - spin)
+int   pBIdle              ( int * );            // wait step: spin, then go idle
 //
 //  External -------------------------------------------------------------------
 //
@@ -109,4 +526,40 @@ char *strpush             ( char *, char * );
 void  strshift            ( char *, char *, char * );
 int   strsize             ( char * );
 
+#ifdef PB_REGISTER_MODEL
+unsigned char pBModelRead ( int );
+void  pBModelWrite        ( int, unsigned char );
+unsigned char *pBModelRegisters( void );
+unsigned long pBModelTime ( void );
+unsigned long pBModelCharTime( void );
+void  pBModelIdle         ( void );
+#endif
+
+#ifdef PB_REGISTER_REPLAY
+unsigned long pBReplayTime( void );
+unsigned long pBReplayCharTime( void );
+#endif
+
+//
+//  Hot port state (PB_HOT_STATE): the driver variables used for every byte
+//  are fields of one aligned block in the small data area (*port_hot*, see
+//  pBController.c), the names below are kept for them in the driver and
+//  the host tools which check it (PB_PORT_INTERNALS is defined before this
+//  header), clients' names are left alone
+//
+#ifdef PB_HOT_STATE
+extern TPortHot port_hot;
+#endif
+
+#if defined(PB_HOT_STATE) && defined(PB_PORT_INTERNALS)
+#define pOutItemsQueue           port_hot.pOutItemsQueue
+#define pOutNext                 port_hot.pOutNext
+#define pInItemsQueue            port_hot.pInItemsQueue
+#define pInNext                  port_hot.pInNext
+#define nOutItems                port_hot.nOutItems
+#define nInItems                 port_hot.nInItems
+#define port_mode                port_hot.port_mode
+#define nPortTimeout             port_hot.nPortTimeout
+#endif
+
 #endif
@@ -0,0 +1,373 @@
+#
+/*******************************************************************************
+ *  Port -B- Bounded Formatter implementation
+ *  -----------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Small *vsprintf* replacement for the port requests. It never writes more
+ *  than the given buffer size (the text is cut, the terminator is always
+ *  put), keeps no static state and takes a fixed stack (an integer
+ *  conversion buffer), so it's safe in the transmitter path and interrupt
+ *  handlers. Integers are converted by tables: decimal by two digits per
+ *  division (pairs table), hexadecimal, octal and binary by shifts.
+ *
+ *  Conversions: %c %s %d %i %u %x %X %o %b %%, flags '-' (left justify),
+ *  '0' (zero-fill), '+' and ' ' (sign of positive %d), '#' (0x, 0X, 0b
+ *  prefix of non-zero value, leading 0 of %o), width, precision (max chars
+ *  of %s, min digits of integers, zero-fill is off then), 'l' size. 'h'
+ *  size is skipped, unknown conversions are copied as is.
+ *
+ *  The driver takes it instead of *vsprintf* with PB_LIGHT_FORMAT (see
+ *  pBController.c).
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBVFormat(sBuffer, nSize, fmt, args) - formats *args* by *fmt* into
+ *      *sBuffer* of *nSize* bytes (with terminator), returns the text size
+ *
+ *    pBFormat(sBuffer, nSize, fmt, ...) - the same with arguments list
+ *
+ *    pBFormatBench(nRounds) - prints timing of *vsprintf* and *pBVFormat*
+ *      on typical telemetry lines and compares them (PB_FORMAT_BENCH, host
+ *      build, PB_FORMAT_BENCH_MAIN makes *main*).
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pBFormat.h"
+
+#ifdef PB_FORMAT_BENCH
+#include <stdio.h>
+#include <time.h>
+#endif
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+                                        // conversion tables
+char  aFormatDigits[] = "0123456789abcdef";
+char  aFormatDigitsUpper[] = "0123456789ABCDEF";
+char  aFormatPairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+
+// *****************************************************************************
+//  INTEGER CONVERSION (PRIVATE)
+// *****************************************************************************
+
+char *_formatUnsigned( char *e, unsigned long u, int nBase, int IsUpper ) {
+//
+//  Convert unsigned integer (digits are put down from *e*).
+//  --------------------------------------------------------
+//
+//  Arguments:
+//
+//      e -- end of the conversion buffer
+//
+//      u -- value
+//
+//      nBase -- 10, 16, 8 or 2
+//
+//      IsUpper -- 1/0, upper case hexadecimal digits.
+//
+//  Returns:
+//
+//      The first digit position.
+//
+    char *pDigits = IsUpper ? aFormatDigitsUpper : aFormatDigits;
+    int r;
+
+    if( nBase == 10 ) {
+    //  two digits per division
+        while( u >= 100 ) {
+            r = (int)(u % 100) * 2;
+            u /= 100;
+            *--e = aFormatPairs[r+1];
+            *--e = aFormatPairs[r];
+        }
+        if( u >= 10 ) {
+            r = (int)u * 2;
+            *--e = aFormatPairs[r+1];
+            *--e = aFormatPairs[r];
+        }
+        else
+            *--e = pDigits[u];
+        return e;
+    }
+
+//  power of two bases by shifts
+    r = ( nBase == 16 ) ? 4 : ( nBase == 8 ) ? 3 : 1;
+    do {
+        *--e = pDigits[u & (nBase - 1)];
+        u >>= r;
+    } while( u );
+
+    return e;
+}
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+int pBVFormat( char *sBuffer, int nSize, char *fmt, va_list args ) {
+//
+//  Format arguments into bounded buffer.
+//  -------------------------------------
+//
+//  Arguments:
+//
+//      sBuffer -- output buffer
+//
+//      nSize -- buffer size with the terminator
+//
+//      fmt -- format string
+//
+//      args -- arguments list.
+//
+//  Returns:
+//
+//      Size of the text put into *sBuffer* (it's cut to *nSize*-1).
+//
+    char sConv[FORMAT_CONV_SIZE];
+    char *d = sBuffer, *e, *p, *s, *pPrefix;
+    char cSign, cFill;
+    int IsLeft, IsLong, IsAlt, nWidth, nPrecision, nZeros, n;
+    unsigned long u;
+    long v;
+
+    if( !sBuffer || nSize <= 0 )
+        return 0;
+
+    e = sBuffer + nSize - 1;
+
+    for( p = fmt; *p; ) {
+    //  plain text
+        if( *p != '%' ) {
+            if( d < e ) *d++ = *p;
+            ++p;
+            continue;
+        }
+
+    //  conversion specification
+        IsLeft = IsLong = IsAlt = 0;
+        nWidth = nZeros = 0;
+        nPrecision = -1;
+        cFill = ' ';
+        cSign = 0;
+        pPrefix = (char *)"";
+
+        for( ++p; *p == '-' || *p == '0' || *p == '+' || *p == ' ' || *p == '#'; p++ ) {
+            if( *p == '-' ) IsLeft = 1;
+            else if( *p == '0' ) cFill = '0';
+            else if( *p == '#' ) IsAlt = 1;
+            else if( cSign != '+' ) cSign = *p;
+        }
+        for( ; *p >= '0' && *p <= '9'; p++ ) nWidth = nWidth*10 + (*p - '0');
+        if( *p == '.' ) {
+            for( nPrecision = 0, ++p; *p >= '0' && *p <= '9'; p++ ) nPrecision = nPrecision*10 + (*p - '0');
+        }
+        for( ; *p == 'l' || *p == 'h'; p++ )
+            if( *p == 'l' ) IsLong = 1;
+
+        s = sConv + sizeof(sConv);
+
+        switch( *p ) {
+            case 'c':
+                *--s = (char)va_arg( args, int );
+                break;
+            case 's':
+                s = va_arg( args, char * );
+                if( !s ) s = (char *)"(null)";
+                break;
+            case 'd': case 'i':
+                v = IsLong ? va_arg( args, long ) : (long)va_arg( args, int );
+                if( v < 0 ) {
+                    pPrefix = (char *)"-";
+                    u = 0UL - (unsigned long)v;
+                }
+                else {
+                    if( cSign == '+' ) pPrefix = (char *)"+";
+                    else if( cSign == ' ' ) pPrefix = (char *)" ";
+                    u = (unsigned long)v;
+                }
+            //  zero precision makes no digits of zero
+                if( u || nPrecision ) s = _formatUnsigned( s, u, 10, 0 );
+                break;
+            case 'u': case 'x': case 'X': case 'o': case 'b':
+                u = IsLong ? va_arg( args, unsigned long ) : (unsigned long)va_arg( args, unsigned int );
+                if( u || nPrecision )
+                    s = _formatUnsigned( s, u, *p == 'u' ? 10 : *p == 'o' ? 8 : *p == 'b' ? 2 : 16, *p == 'X' );
+                if( IsAlt && u ) {
+                    if( *p == 'x' ) pPrefix = (char *)"0x";
+                    else if( *p == 'X' ) pPrefix = (char *)"0X";
+                    else if( *p == 'b' ) pPrefix = (char *)"0b";
+                }
+                break;
+            case '%':
+                *--s = '%';
+                break;
+            default:
+            //  unknown conversion is copied as is
+                if( d < e ) *d++ = '%';
+                if( *p && d < e ) *d++ = *p;
+                if( *p ) ++p;
+                continue;
+        }
+
+    //  text size (string precision is max chars, integer one is min digits)
+        if( *p == 's' ) {
+            for( n=0; s[n] && ( nPrecision < 0 || n < nPrecision ); n++ ) ;
+        }
+        else {
+            n = (int)(sConv + sizeof(sConv) - s);
+            if( *p == 'c' || *p == '%' ) cFill = ' ';
+            else if( nPrecision >= 0 ) {
+                if( nPrecision > n ) nZeros = nPrecision - n;
+                cFill = ' ';
+            }
+        //  octal alternate form starts with zero
+            if( *p == 'o' && IsAlt && !nZeros && ( !n || *s != '0' ) ) nZeros = 1;
+        }
+        ++p;
+
+        nWidth -= n + nZeros + (int)strlen(pPrefix);
+
+    //  sign (prefix) goes before zeros, spaces go before sign
+        if( !IsLeft && cFill == ' ' )
+            for( ; nWidth > 0; nWidth-- ) if( d < e ) *d++ = ' ';
+        for( ; *pPrefix; pPrefix++ ) if( d < e ) *d++ = *pPrefix;
+        if( !IsLeft )
+            for( ; nWidth > 0; nWidth-- ) if( d < e ) *d++ = '0';
+        for( ; nZeros > 0; nZeros-- ) if( d < e ) *d++ = '0';
+
+        for( ; n > 0 && d < e; n-- ) *d++ = *s++;
+
+        for( ; nWidth > 0; nWidth-- ) if( d < e ) *d++ = ' ';
+    }
+
+    *d = '\0';
+    return (int)(d - sBuffer);
+}
+
+int pBFormat( char *sBuffer, int nSize, char *fmt, ... ) {
+    va_list args;
+    int n;
+
+    va_start( args, fmt );
+    n = pBVFormat( sBuffer, nSize, fmt, args );
+    va_end( args );
+
+    return n;
+}
+
+#ifdef PB_FORMAT_BENCH
+
+// *****************************************************************************
+//  BENCHMARK
+// *****************************************************************************
+
+int _benchVsprintf( char *sBuffer, char *fmt, ... ) {
+    va_list args;
+    int n;
+
+    va_start( args, fmt );
+    n = vsprintf( sBuffer, fmt, args );
+    va_end( args );
+
+    return n;
+}
+
+double _formatSeconds( clock_t t ) {
+    return (double)(clock() - t) / CLOCKS_PER_SEC;
+}
+
+void pBFormatBench( int nRounds ) {
+//
+//  Compare *vsprintf* with the formatter.
+//  --------------------------------------
+//  Every round formats a set of telemetry like lines by both, the results
+//  are compared (%b has no *vsprintf* counterpart and isn't used here).
+//
+//  Arguments:
+//
+//      nRounds -- rounds number (0 - default).
+//
+    char s1[FORMAT_BENCH_SIZE], s2[FORMAT_BENCH_SIZE];
+    clock_t t;
+    double t1, t2;
+    unsigned long sum1 = 0, sum2 = 0;
+    int r, v, nMismatch = 0;
+
+    if( nRounds <= 0 ) nRounds = FORMAT_BENCH_ROUNDS;
+
+    printf( "--> FORMATTER BENCHMARK (%d rounds):\n", nRounds );
+
+    t = clock();
+    for( r=0; r<nRounds; r++ ) {
+        v = r * 7919 - 500000;
+        sum1 += _benchVsprintf( s1, "T=%d,U=%u,X=%08x", v, (unsigned)r, (unsigned)v );
+        sum1 += _benchVsprintf( s1, "%-10s|%5d|%c", "channel", r % 1000, 'A' + r % 26 );
+        sum1 += _benchVsprintf( s1, "%ld %lx %s", (long)v * 1000, (unsigned long)r, "OK" );
+    }
+    t1 = _formatSeconds( t );
+
+    t = clock();
+    for( r=0; r<nRounds; r++ ) {
+        v = r * 7919 - 500000;
+        sum2 += pBFormat( s2, sizeof(s2), "T=%d,U=%u,X=%08x", v, (unsigned)r, (unsigned)v );
+        sum2 += pBFormat( s2, sizeof(s2), "%-10s|%5d|%c", "channel", r % 1000, 'A' + r % 26 );
+        sum2 += pBFormat( s2, sizeof(s2), "%ld %lx %s", (long)v * 1000, (unsigned long)r, "OK" );
+    }
+    t2 = _formatSeconds( t );
+
+//  check the results on a range of values
+    for( r=0; r<nRounds && r<100000; r++ ) {
+        v = r * 7919 - 500000;
+        _benchVsprintf( s1, "%d|%5d|%-5d|%05d|%u|%x|%X|%08lx|%o|%-6s|%.3s|%3c|%%", v, v % 1000, r % 100, v % 10000,
+            (unsigned)v, (unsigned)r, (unsigned)v, (unsigned long)r * 31, (unsigned)r, "ab", "abcdef", 'z' );
+        pBFormat( s2, sizeof(s2), "%d|%5d|%-5d|%05d|%u|%x|%X|%08lx|%o|%-6s|%.3s|%3c|%%", v, v % 1000, r % 100, v % 10000,
+            (unsigned)v, (unsigned)r, (unsigned)v, (unsigned long)r * 31, (unsigned)r, "ab", "abcdef", 'z' );
+        if( strcmp(s1, s2) ) {
+            if( !nMismatch ) printf( "    MISMATCH: '%s' / '%s'\n", s1, s2 );
+            ++nMismatch;
+        }
+        _benchVsprintf( s1, "%+d|% d|%+5d|%-+6d|%.3d|%8.4d|%-8.3x|%.0d|%.0u|%#x|%#X|%#o|%#.0o|%#06x|%#5o", v, r % 1000, v % 100,
+            r % 77, v % 1000, v % 100000, (unsigned)r, r % 2, (unsigned)r % 3, (unsigned)r, (unsigned)v, (unsigned)r,
+            (unsigned)r % 2, (unsigned)r % 256, (unsigned)r % 64 );
+        pBFormat( s2, sizeof(s2), "%+d|% d|%+5d|%-+6d|%.3d|%8.4d|%-8.3x|%.0d|%.0u|%#x|%#X|%#o|%#.0o|%#06x|%#5o", v, r % 1000, v % 100,
+            r % 77, v % 1000, v % 100000, (unsigned)r, r % 2, (unsigned)r % 3, (unsigned)r, (unsigned)v, (unsigned)r,
+            (unsigned)r % 2, (unsigned)r % 256, (unsigned)r % 64 );
+        if( strcmp(s1, s2) ) {
+            if( !nMismatch ) printf( "    MISMATCH: '%s' / '%s'\n", s1, s2 );
+            ++nMismatch;
+        }
+    }
+
+    printf( "    vsprintf: %8.3f s, pBVFormat: %8.3f s (x%.2f)%s, mismatches: %d\n", t1, t2,
+        t2 > 0. ? t1/t2 : 0., sum1 != sum2 ? " SIZE MISMATCH":"", nMismatch );
+
+    pBFormat( s2, sizeof(s2), "%b|%08b|%#b|%lb", 5, 10, 6, (unsigned long)-1 );
+    printf( "    %%b: %s\n", s2 );
+
+    pBFormat( s2, 8, "%s", "bounded output" );
+    printf( "    bounded (8): '%s'\n", s2 );
+}
+
+#endif
+
+#ifdef PB_FORMAT_BENCH_MAIN
+
+int main( int argc, char **argv ) {
+    pBFormatBench( argc > 1 ? atoi(argv[1]) : 0 );
+    return 0;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#
+/*******************************************************************************
+ *  Port -B- Bounded Formatter header file
+ *  --------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBFORMAT__
+#define __PBFORMAT__
+
+#include <stdarg.h>
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define FORMAT_CONV_SIZE         (8*sizeof(long) + 2) // integer conversion buffer (binary of long, sign)
+
+#ifdef PB_FORMAT_BENCH_MAIN
+#define PB_FORMAT_BENCH                   // the benchmark is taken with its *main*
+#endif
+
+#define FORMAT_BENCH_ROUNDS      200000   // default benchmark rounds
+#define FORMAT_BENCH_SIZE        128      // benchmark line buffer
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+//
+//  Private --------------------------------------------------------------------
+//
+char *_formatUnsigned     ( char *, unsigned long, int, int );
+//
+//  Public (client interface) --------------------------------------------------
+//
+int   pBVFormat           ( char *, int, char *, va_list ); // format into bounded buffer (*vsprintf*)
+int   pBFormat            ( char *, int, char *, ... );     // the same (*sprintf*)
+#ifdef PB_FORMAT_BENCH
+void  pBFormatBench       ( int );              // formatter benchmark against *vsprintf*
+#endif
+
+#endif
@@ -0,0 +1,575 @@
+#
+/*******************************************************************************
+ *  Port -B- Host Gateway (threads)
+ *  -------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Host (Linux gateway) build of the driver for several application threads
+ *  pushing output at the same time. The driver itself stays single threaded:
+ *  its queues and state are touched by the service thread only, which plays
+ *  the role of the port interrupt and the events loop. Application threads
+ *  push items into a lock-free ring of cells (bounded multi-producer queue,
+ *  a cell sequence number tells it's free or ready), the service thread
+ *  moves them into the driver queue in the ring order (items of a thread
+ *  keep their order) and services the port by *pBPoll*. An item the driver
+ *  queue can't take waits in the ring, a push into the full ring is
+ *  rejected at once (the caller decides to repeat it or drop the item).
+ *
+ *  The service thread polls the port while the driver queues have items.
+ *  With the ring empty and nothing in the driver it sleeps on a condition
+ *  up to a push (a producer signals it only if it's asleep, the push stays
+ *  lock-free) or HOST_IDLE_WAIT, so user tasks go on.
+ *
+ *  With PB_REGISTER_MODEL the service thread advances the model time too,
+ *  so the model ISR emulation is called from it (IRQ mode of the driver).
+ *
+ *  Other driver calls (input requests, settings) should be done by the
+ *  service thread: in the requests done callbacks or user tasks
+ *  (*pBSetHandlers*, *pBAddTask*), or before *pBHostStart*.
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBHostInit() - resets the ring, run before *pBHostStart*
+ *
+ *    pBHostPush(sItem, IsNewLine) - pushes an output item from any thread,
+ *      returns 1/0 (taken or the ring is full) or PB_ERR_UNDEFINED (no item
+ *      or longer than HOST_ITEM_SIZE)
+ *
+ *    pBHostStart(), pBHostStop() - start the service thread after *pBInit*,
+ *      stop it when the ring and the driver queue are drained
+ *
+ *    pBHostGetStat(pStat, IsReset) - gateway counters
+ *
+ *    pBHostBench(nThreads, nItems) - prints enqueue throughput from 1 to
+ *      *nThreads* producers (the service thread checks the items order and
+ *      drops them), with PB_REGISTER_MODEL the items of the last run go
+ *      through the driver and the model and are checked at the peer.
+ *
+ *  Assembly (host): pBHost.c pBController.c (pBModel.c with PB_REGISTER_MODEL)
+ *  with PB_HOST_BENCH_MAIN (*main*: pbhost [threads [items]]), -lpthread.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "..\config.h"
+
+#define PB_PORT_INTERNALS               // hot state names (PB_HOT_STATE)
+#include "pBController.h"
+#ifdef PB_REGISTER_MODEL
+#include "pBModel.h"
+#endif
+#include "pBHost.h"
+
+#include "..\common\pBCommon.h"
+
+// -----------------------------------------------------------------------------
+//  Controller internals
+// -----------------------------------------------------------------------------
+#ifndef PB_HOT_STATE
+extern int   nOutItems, nInItems;
+#endif
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+THostCell aHostCells[HOST_CELLS];       // pushed items ring
+THostCounter HostTail;                  // the next cell to push (producers)
+THostCounter HostHead;                  // the next cell to take (service thread)
+THostStat HostStat;                     // gateway counters
+
+pthread_t HostThread;                   // service thread
+int   IsHostRunning = 0;
+int   IsHostStop = 0;                   // stop request (service thread exits when drained)
+int   IsHostDirect = 0;                 // benchmark: items are checked and dropped, no driver
+
+pthread_mutex_t HostLock = PTHREAD_MUTEX_INITIALIZER; // idle service thread sleep
+pthread_cond_t HostWake = PTHREAD_COND_INITIALIZER;
+int   IsHostAsleep = 0;                 // producers signal *HostWake*
+
+typedef struct {                        // benchmark producer
+    int   nId;                          // producer number
+    unsigned long nItems;               // items to push
+    unsigned long nRetries;             // pushes repeated (ring was full)
+} THostProducer;
+
+unsigned long aHostNext[HOST_MAX_THREADS]; // the next item number of a producer (check)
+unsigned long nHostChecked, nHostErrors;
+char  sHostLine[HOST_ITEM_SIZE + SIZE_OFFSET + 1]; // line taken at the peer (PB_REGISTER_MODEL)
+int   nHostLine;
+
+// *****************************************************************************
+//  RING AND SERVICE THREAD (PRIVATE)
+// *****************************************************************************
+
+THostCell *_hostPeek() {
+//
+//  The oldest pushed cell (service thread) or NULL if the ring is empty.
+//
+    THostCell *pc = &aHostCells[HostHead.nPos & (HOST_CELLS - 1)];
+
+    return ( __atomic_load_n(&pc->nSeq, __ATOMIC_ACQUIRE) == HostHead.nPos + 1 ) ? pc : 0;
+}
+
+void _hostTake( THostCell *pc ) {
+//
+//  Free the oldest cell for producers (a ring round later).
+//
+    __atomic_store_n( &pc->nSeq, HostHead.nPos + HOST_CELLS, __ATOMIC_RELEASE );
+    ++HostHead.nPos;
+}
+
+int _hostRound() {
+//
+//  Service round: move pushed items into the driver queue, service the port.
+//  ------------------------------------------------------------------------
+//
+//  Returns:
+//
+//      Number of items moved.
+//
+    THostCell *pc;
+    int n = 0;
+
+    ++HostStat.nRounds;
+
+    while( (pc = _hostPeek()) ) {
+        if( IsHostDirect )
+            _hostCheckLine( pc->sData, pc->nSize );
+    //  the driver queue is full, the item waits in the ring
+        else if( !pBPush( pc->sData, pc->IsNewLine, 0 ) ) {
+            ++HostStat.nWaits;
+            break;
+        }
+        _hostTake( pc );
+        ++n;
+    }
+    HostStat.nMoved += n;
+
+    if( !IsHostDirect ) {
+        pBPoll();
+#ifdef PB_REGISTER_MODEL
+    //  the line time goes on, port interrupts come from here
+        pBModelTick( 1 );
+#endif
+    }
+
+    return n;
+}
+
+void _hostWait() {
+//
+//  Sleep up to a push, the stop request or HOST_IDLE_WAIT.
+//  -------------------------------------------------------
+//  The flag is set before the ring is checked again, a producer publishes
+//  the cell before it looks at the flag (both fenced): either the cell is
+//  seen here or the producer signals under the lock.
+//
+    struct timespec t;
+
+    pthread_mutex_lock( &HostLock );
+    __atomic_store_n( &IsHostAsleep, 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+    if( !_hostPeek() && !__atomic_load_n(&IsHostStop, __ATOMIC_ACQUIRE) ) {
+        clock_gettime( CLOCK_REALTIME, &t );
+        t.tv_nsec += HOST_IDLE_WAIT * 1000000L;
+        if( t.tv_nsec >= 1000000000L ) {
+            t.tv_nsec -= 1000000000L;
+            ++t.tv_sec;
+        }
+        pthread_cond_timedwait( &HostWake, &HostLock, &t );
+        ++HostStat.nSleeps;
+    }
+
+    __atomic_store_n( &IsHostAsleep, 0, __ATOMIC_RELAXED );
+    pthread_mutex_unlock( &HostLock );
+}
+
+void _hostWake() {
+//
+//  Wake the service thread if it's asleep (after a push or the stop request),
+//  the first caller takes the flag, the others don't go to the lock.
+//
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+    if( __atomic_load_n(&IsHostAsleep, __ATOMIC_RELAXED) && __atomic_exchange_n(&IsHostAsleep, 0, __ATOMIC_RELAXED) ) {
+        pthread_mutex_lock( &HostLock );
+        pthread_cond_signal( &HostWake );
+        pthread_mutex_unlock( &HostLock );
+    }
+}
+
+void *_hostService( void *pArg ) {
+//
+//  Service thread: rounds up to the stop request and drained queues.
+//
+    int nIdle = 0, nYields = 0;
+
+    while( !__atomic_load_n(&IsHostStop, __ATOMIC_ACQUIRE) || _hostPeek() || ( !IsHostDirect && nOutItems ) ) {
+        if( _hostRound() )
+            nIdle = nYields = 0;
+        else if( ++nIdle >= HOST_IDLE_ROUNDS ) {
+        //  the port is polled while the driver has requests, busy producers
+        //  get the CPU for a while before the thread sleeps
+            if( nYields >= HOST_IDLE_YIELDS && ( IsHostDirect || ( !nOutItems && !nInItems ) ) ) {
+                _hostWait();
+                nYields = 0;
+            }
+            else {
+                sched_yield();
+                if( nYields < HOST_IDLE_YIELDS ) ++nYields;
+            }
+            nIdle = 0;
+        }
+    }
+
+    return pArg;
+}
+
+// *****************************************************************************
+//  BENCHMARK (PRIVATE)
+// *****************************************************************************
+
+void *_hostProducer( void *pArg ) {
+//
+//  Push numbered items ("P<producer>:<number>:...") repeating the full ring.
+//
+    THostProducer *pp = (THostProducer *)pArg;
+    char sItem[64];
+    unsigned long i;
+
+    for( i=0; i<pp->nItems; i++ ) {
+        sprintf( sItem, "P%02d:%08lu:0123456789abcdef", pp->nId, i );
+        while( !pBHostPush( sItem, 1 ) ) {
+            ++pp->nRetries;
+            sched_yield();
+        }
+    }
+
+    return 0;
+}
+
+void _hostCheckLine( char *s, int n ) {
+//
+//  Check the item is the next one of its producer.
+//
+    int nId;
+    unsigned long nItem;
+
+    if( n < 4 || sscanf( s, "P%d:%lu", &nId, &nItem ) != 2 || nId < 0 || nId >= HOST_MAX_THREADS ||
+        nItem != aHostNext[nId] )
+        ++nHostErrors;
+    else
+        ++aHostNext[nId];
+
+    ++nHostChecked;
+}
+
+#ifdef PB_REGISTER_MODEL
+
+void _hostCheckTask( void *pArg ) {
+//
+//  Take the lines came to the peer (user task of the service thread).
+//
+    char s[256];
+    int i, n;
+
+    while( (n = pBModelGet(s, sizeof(s))) > 0 ) {
+        for( i=0; i<n; i++ ) {
+            if( s[i] == '\r' ) {
+                if( nHostLine && sHostLine[nHostLine-1] == '\n' ) --nHostLine;
+                sHostLine[nHostLine] = '\0';
+                _hostCheckLine( sHostLine, nHostLine );
+                nHostLine = 0;
+            }
+            else if( nHostLine < (int)sizeof(sHostLine) - 1 )
+                sHostLine[nHostLine++] = s[i];
+        }
+    }
+}
+
+#endif
+
+double _hostSeconds() {
+    struct timespec t;
+
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+int _hostBenchRun( int nThreads, unsigned long nItems, int IsDirect, THostBench *pBench ) {
+//
+//  Run producers against the service thread.
+//  -----------------------------------------
+//
+//  Arguments:
+//
+//      nThreads -- producer threads
+//
+//      nItems -- items of all of them
+//
+//      IsDirect -- 1/0, the service thread checks and drops the items, or
+//                  they go through the driver (PB_REGISTER_MODEL)
+//
+//      pBench -- results.
+//
+//  Returns:
+//
+//      Number of failures.
+//
+    THostProducer aProducers[HOST_MAX_THREADS];
+    pthread_t aThreads[HOST_MAX_THREADS];
+    double t;
+    int i;
+#ifdef PB_REGISTER_MODEL
+    unsigned long n;
+#endif
+
+    memset( pBench, 0, sizeof(THostBench) );
+    memset( aHostNext, 0, sizeof(aHostNext) );
+    nHostChecked = nHostErrors = 0;
+    nHostLine = 0;
+
+    pBench->nThreads = nThreads;
+    pBench->nItems = nItems;
+
+    pBHostInit();
+    IsHostDirect = IsDirect;
+
+#ifdef PB_REGISTER_MODEL
+    if( !IsDirect ) {
+        pBModelInit( 0, MODEL_RX_FLOW );
+        pBInit( 1, 1 );
+        pBAddTask( _hostCheckTask, 0 );
+    }
+#endif
+
+    if( !pBHostStart() )
+        return 1;
+
+    t = _hostSeconds();
+
+    for( i=0; i<nThreads; i++ ) {
+        aProducers[i].nId = i;
+        aProducers[i].nItems = nItems / nThreads + ( (unsigned long)i < nItems % nThreads ? 1:0 );
+        aProducers[i].nRetries = 0;
+        pthread_create( &aThreads[i], 0, _hostProducer, &aProducers[i] );
+    }
+    for( i=0; i<nThreads; i++ ) {
+        pthread_join( aThreads[i], 0 );
+        pBench->nRetries += aProducers[i].nRetries;
+    }
+
+    pBench->nSeconds = _hostSeconds() - t;
+
+    pBHostStop();
+
+#ifdef PB_REGISTER_MODEL
+    if( !IsDirect ) {
+    //  the last bytes are on the line
+        for( n=0; n<HOST_DRAIN_TICKS && nHostChecked < nItems; n++ ) {
+            pBModelTick( 1 );
+            _hostCheckTask( 0 );
+        }
+        pBRemoveTask( _hostCheckTask );
+        pBTerm();
+    }
+#endif
+
+    pBench->nErrors = nHostErrors + ( nHostChecked < nItems ? nItems - nHostChecked : 0 );
+    return (int)pBench->nErrors;
+}
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+void pBHostInit() {
+//
+//  Reset the ring (no service thread is running).
+//
+    unsigned long i;
+
+    for( i=0; i<HOST_CELLS; i++ )
+        aHostCells[i].nSeq = i;
+
+    HostTail.nPos = HostHead.nPos = 0;
+    memset( &HostStat, 0, sizeof(HostStat) );
+}
+
+int pBHostPush( char *sItem, int IsNewLine ) {
+//
+//  Push an output item (any thread).
+//  ---------------------------------
+//  A producer takes the tail position by CAS when the cell there is free
+//  (its sequence is the position), fills it and publishes it (sequence is
+//  the position + 1). The service thread takes cells in the positions
+//  order.
+//
+//  Arguments:
+//
+//      sItem -- item text
+//
+//      IsNewLine -- 1/0, line delimeters are added by the driver.
+//
+//  Returns:
+//
+//      1/0 (taken or the ring is full) or PB_ERR_UNDEFINED.
+//
+    THostCell *pc;
+    unsigned long nPos, nSeq;
+    long nDiff;
+    int nSize;
+
+    if( !sItem || (nSize = (int)strlen(sItem)) > HOST_ITEM_SIZE )
+        return PB_ERR_UNDEFINED;
+
+    nPos = __atomic_load_n( &HostTail.nPos, __ATOMIC_RELAXED );
+
+    for( ;; ) {
+        pc = &aHostCells[nPos & (HOST_CELLS - 1)];
+        nSeq = __atomic_load_n( &pc->nSeq, __ATOMIC_ACQUIRE );
+        nDiff = (long)(nSeq - nPos);
+
+        if( !nDiff ) {
+        //  free cell, take the position (*nPos* is reloaded on failure)
+            if( __atomic_compare_exchange_n( &HostTail.nPos, &nPos, nPos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        }
+        else if( nDiff < 0 ) {
+        //  the cell isn't taken by the service thread yet: the ring is full
+            __atomic_fetch_add( &HostStat.nFull, 1, __ATOMIC_RELAXED );
+            return 0;
+        }
+        else
+            nPos = __atomic_load_n( &HostTail.nPos, __ATOMIC_RELAXED );
+    }
+
+    memcpy( pc->sData, sItem, nSize + 1 );
+    pc->nSize = nSize;
+    pc->IsNewLine = IsNewLine;
+
+    __atomic_store_n( &pc->nSeq, nPos + 1, __ATOMIC_RELEASE );
+    _hostWake();
+
+    return 1;
+}
+
+int pBHostStart() {
+//
+//  Start the service thread.
+//  -------------------------
+//
+//  Returns:
+//
+//      1/0 - started or not.
+//
+    if( IsHostRunning )
+        return 1;
+
+    __atomic_store_n( &IsHostStop, 0, __ATOMIC_RELEASE );
+
+    if( pthread_create( &HostThread, 0, _hostService, 0 ) )
+        return 0;
+
+    IsHostRunning = 1;
+    return 1;
+}
+
+void pBHostStop() {
+//
+//  Stop the service thread when the ring and the driver queue are drained.
+//
+    if( !IsHostRunning )
+        return;
+
+    __atomic_store_n( &IsHostStop, 1, __ATOMIC_RELEASE );
+    _hostWake();
+    pthread_join( HostThread, 0 );
+
+    IsHostRunning = 0;
+}
+
+void pBHostGetStat( THostStat *pStat, int IsReset ) {
+//
+//  Get gateway counters (service thread ones are approximate while it runs).
+//
+//  Arguments:
+//
+//      pStat -- counters (may be NULL)
+//
+//      IsReset -- 1/0, clean the counters after.
+//
+    if( pStat ) {
+        *pStat = HostStat;
+        pStat->nPushed = __atomic_load_n( &HostTail.nPos, __ATOMIC_RELAXED );
+        pStat->nFull = __atomic_load_n( &HostStat.nFull, __ATOMIC_RELAXED );
+    }
+
+    if( IsReset && !IsHostRunning )
+        pBHostInit();
+}
+
+int pBHostBench( int nThreads, unsigned long nItems ) {
+//
+//  Enqueue scaling benchmark.
+//  --------------------------
+//  Every run pushes *nItems* by 1..*nThreads* producers, the service thread
+//  checks the items order of every producer.
+//
+//  Arguments:
+//
+//      nThreads -- max producer threads (0 - default)
+//
+//      nItems -- items of a run (0 - default).
+//
+//  Returns:
+//
+//      Number of failures.
+//
+    THostBench Bench;
+    double nBase = 0., nRate;
+    int n, nErrors = 0;
+
+    if( nThreads <= 0 ) nThreads = HOST_BENCH_THREADS;
+    if( nThreads > HOST_MAX_THREADS ) nThreads = HOST_MAX_THREADS;
+    if( !nItems ) nItems = HOST_BENCH_ITEMS;
+
+    printf( "--> HOST GATEWAY ENQUEUE (%lu items, ring of %d cells):\n", nItems, HOST_CELLS );
+
+    for( n=1; n<=nThreads; n++ ) {
+        nErrors += _hostBenchRun( n, nItems, 1, &Bench );
+        nRate = Bench.nSeconds > 0. ? Bench.nItems / Bench.nSeconds : 0.;
+        if( n == 1 ) nBase = nRate;
+        printf( "    producers %2d: %8.3f s, %10.0f items/s (x%.2f), %lu retries, %lu errors\n", n,
+            Bench.nSeconds, nRate, nBase > 0. ? nRate / nBase : 0., Bench.nRetries, Bench.nErrors );
+    }
+
+#ifdef PB_REGISTER_MODEL
+//  the same through the driver and the model
+    nErrors += _hostBenchRun( nThreads, HOST_CHECK_ITEMS, 0, &Bench );
+    printf( "    driver check: %d producers, %lu items at the peer, %lu waits for the driver queue, %lu sleeps, %lu errors\n",
+        nThreads, nHostChecked, HostStat.nWaits, HostStat.nSleeps, Bench.nErrors );
+#endif
+
+    return nErrors;
+}
+
+#ifdef PB_HOST_BENCH_MAIN
+
+int main( int argc, char **argv ) {
+    return pBHostBench( argc > 1 ? atoi(argv[1]) : 0, argc > 2 ? (unsigned long)atol(argv[2]) : 0 ) ? 1:0;
+}
+
+#endif
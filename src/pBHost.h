@@ -0,0 +1,87 @@
+#
+/*******************************************************************************
+ *  Port -B- Host Gateway (threads) header file
+ *  -------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBHOST__
+#define __PBHOST__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define HOST_CELLS               1024     // pushed items ring (cells, power of two)
+#define HOST_ITEM_SIZE           (MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET) // max item text size (delimiters are added)
+#define HOST_LINE_SIZE           64       // cache line (producers and service counters apart)
+#define HOST_IDLE_ROUNDS         64       // empty service rounds before yielding the CPU
+#define HOST_IDLE_YIELDS         16       // yields with nothing to do before sleeping
+#define HOST_IDLE_WAIT           10       // max sleep of the idle service thread (ms, user tasks go on)
+
+#define HOST_BENCH_THREADS       8        // default max producer threads
+#define HOST_BENCH_ITEMS         1000000  // default items of a benchmark run
+#define HOST_CHECK_ITEMS         5000     // items of the check run through the driver (PB_REGISTER_MODEL)
+#define HOST_DRAIN_TICKS         100000000 // max model ticks to take the rest of the output
+#define HOST_MAX_THREADS         64       // max producer threads
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef struct {                          // pushed item cell
+    unsigned long nSeq;                   // cell state (position it's ready to be written or read at)
+    int   nSize;                          // item size
+    int   IsNewLine;                      // line delimeters are added
+    char  sData[HOST_ITEM_SIZE + SIZE_OFFSET + 1]; // item text (room for delimiters)
+} THostCell;
+
+typedef struct {                          // ring position (a cache line)
+    unsigned long nPos;
+    char  aPad[HOST_LINE_SIZE - sizeof(unsigned long)];
+} THostCounter;
+
+typedef struct {                          // gateway counters
+    unsigned long nPushed;                // items taken by the ring
+    unsigned long nFull;                  // pushes rejected (ring is full)
+    unsigned long nMoved;                 // items moved into the driver queue
+    unsigned long nWaits;                 // rounds an item waited for the driver queue
+    unsigned long nRounds;                // service rounds
+    unsigned long nSleeps;                // service thread sleeps (nothing to do)
+} THostStat;
+
+typedef struct {                          // benchmark run results
+    int   nThreads;                       // producer threads
+    unsigned long nItems;                 // items pushed
+    unsigned long nRetries;               // pushes repeated (ring was full)
+    unsigned long nErrors;                // items lost or out of a producer order
+    double nSeconds;                      // enqueue time (wall)
+} THostBench;
+//
+//  Private --------------------------------------------------------------------
+//
+THostCell *_hostPeek      ( void );
+void  _hostTake           ( THostCell * );
+int   _hostRound          ( void );
+void  _hostWait           ( void );
+void  _hostWake           ( void );
+void *_hostService        ( void * );
+void *_hostProducer       ( void * );
+void  _hostCheckLine      ( char *, int );
+void  _hostCheckTask      ( void * );
+double _hostSeconds       ( void );
+int   _hostBenchRun       ( int, unsigned long, int, THostBench * );
+//
+//  Public (client interface) --------------------------------------------------
+//
+void  pBHostInit          ( void );             // reset the ring
+int   pBHostPush          ( char *, int );      // push an output item (any thread)
+int   pBHostStart         ( void );             // start the service thread
+void  pBHostStop          ( void );             // drain the ring and the driver queue, stop the thread
+void  pBHostGetStat       ( THostStat *, int ); // get gateway counters
+int   pBHostBench         ( int, unsigned long ); // enqueue scaling benchmark (1..N producers)
+
+#endif
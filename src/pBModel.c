@@ -0,0 +1,374 @@
+#
+/*******************************************************************************
+ *  Port -B- Registers Model implementation
+ *  ---------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Software model of port -B- registers to run the controller without the
+ *  board (host build, PB_REGISTER_MODEL). The controller accesses registers
+ *  through PB_READ/PB_WRITE, which call the model instead of *BaseAddress*.
+ *
+ *  The model keeps its own time (ticks), every register access takes a
+ *  tick. A character takes MODEL_CHAR_TICKS at 115200 (3 and 6 times more
+ *  at 38400 and 19200, *CNR->SPEED*). Transmitted bytes go to the peer
+ *  output buffer (or back to the receiver with *CNR->LOOP*), the peer input
+ *  buffer feeds *RXD*. Port interrupts call the ISR emulation at any tick
+ *  when they are not disabled by *DisableInt*:
+ *
+ *    - EITR, when the transmitter gets empty (edge), or EITR is enabled
+ *      while it's empty
+ *
+ *    - EIRC, while *RXD* has data and *isr_pb* is not set (level).
+ *
+ *  The ISR emulation does the same as the board one: keeps *STATUS* in
+ *  *isr_pb_state* and sets *isr_pb* trigger.
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBModelInit(nCharTicks, nRxMode) - resets the model, *nCharTicks* is
+ *      character time at 115200 (0 - default), *nRxMode* is MODEL_RX_FREE
+ *      (peer sends at line speed, overrun is possible) or MODEL_RX_FLOW (peer
+ *      waits until *RXD* is read), with MODEL_RX_XONXOFF the peer stops on
+ *      XOFF transmitted by the driver and goes on XON (they aren't put into
+ *      the peer output), XON/XOFF of the peer go ahead of its data
+ *
+ *    pBModelRead(Register), pBModelWrite(Register, Value) - registers access
+ *
+ *    pBModelTick(n) - advances the model time by *n* ticks
+ *
+ *    pBModelInterrupt() - calls the ISR emulation now (spurious interrupt)
+ *
+ *    pBModelIdle() - CPU *wait*, advances the model time up to the next port
+ *      interrupt or timer tick (MODEL_IDLE_TICKS)
+ *
+ *    pBModelPut(s, n, errors) - peer sends *n* bytes, *errors* (ERR_PARITY,
+ *      ERR_FRAMING) is status to be set with every of them
+ *
+ *    pBModelGet(s, n) - takes up to *n* bytes transmitted by the driver
+ *
+ *    pBModelTime(), pBModelCharTime() (at 115200, ticks), pBModelLineTime()
+ *      (at *CNR->SPEED*, ticks), pBModelPending(),
+ *      pBModelStat(pStat) - model state.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <string.h>
+
+#include "..\config.h"
+
+#include "pBController.h"
+#include "pBModel.h"
+
+#include "..\common\pBCommon.h"
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+extern unsigned char isr_pb_state;      // port interrupt reason (*ISR_PB*)
+
+int   isr_pb;                           // port interrupt trigger (ISR)
+int   nModelMask = 0;                   // *DisableInt* depth
+
+unsigned char aModelRegisters[MODEL_REGISTERS]; // registers image (CNR, IER)
+
+TModelStat ModelStat;
+int   nModelCharTicks = MODEL_CHAR_TICKS;
+int   nModelRxMode = MODEL_RX_FLOW;
+
+int   IsTxBusy;                         // transmitter shift register state
+unsigned char TxData;
+unsigned long nTxDone;                  // time of the current byte end
+int   IsTxIRQ;                          // transmitter empty (edge)
+
+int   IsRxReady;                        // *RXD* state
+unsigned char RxData, RxErrors;
+unsigned long nRxNext;                  // time of the next byte from peer
+int   IsPeerStopped;                    // peer got XOFF (MODEL_RX_XONXOFF)
+unsigned char PeerControl;              // XON/XOFF of the peer ahead of its data (0 - none)
+
+                                        // peer data (FIFO)
+char  aPeerIn[MODEL_FIFO_SIZE], aPeerOut[MODEL_FIFO_SIZE];
+unsigned char aPeerInErrors[MODEL_FIFO_SIZE];
+unsigned int nPeerInHead, nPeerInTail, nPeerOutHead, nPeerOutTail;
+
+// *****************************************************************************
+//  LINE MODEL (PRIVATE)
+// *****************************************************************************
+
+int _modelCharTicks() {
+//
+//  Character time by *CNR->SPEED* (ticks).
+//
+    switch( aModelRegisters[PB_CNR] & 0x06 ) {
+        case SPEED_19200: return nModelCharTicks * 6;
+        case SPEED_38400: return nModelCharTicks * 3;
+    }
+    return nModelCharTicks;
+}
+
+void _modelReceive( unsigned char Data, unsigned char errors ) {
+//
+//  A byte came to *RXD*.
+//
+    if( IsRxReady ) {
+        ++ModelStat.nRxOverruns;
+        errors |= ERR_OVERRUN;
+    }
+    RxData = Data;
+    RxErrors |= errors;
+    IsRxReady = 1;
+    ++ModelStat.nRxBytes;
+}
+
+void _modelCheckIRQ() {
+//
+//  Call the ISR emulation if port interrupt is requested.
+//
+    unsigned char ier = aModelRegisters[PB_IER];
+
+    if( nModelMask )
+        return;
+
+    if( ( (ier & MODEL_IER_EITR) && IsTxIRQ ) ||
+        ( (ier & MODEL_IER_EIRC) && IsRxReady && !isr_pb ) )
+        pBModelInterrupt();
+}
+
+void _modelAdvance() {
+//
+//  Advance the model time by a tick.
+//  ---------------------------------
+//
+    unsigned int i;
+
+    ++ModelStat.nTime;
+
+//  the transmitter finished current byte
+    if( IsTxBusy && ModelStat.nTime >= nTxDone ) {
+        IsTxBusy = 0;
+        IsTxIRQ = 1;
+        ++ModelStat.nTxBytes;
+        if( aModelRegisters[PB_CNR] & MODEL_CNR_LOOP )
+            _modelReceive( TxData, 0 );
+        else if( (nModelRxMode & MODEL_RX_XONXOFF) && ( TxData == FLOW_XOFF || TxData == FLOW_XON ) ) {
+            if( (IsPeerStopped = ( TxData == FLOW_XOFF )) ) ++ModelStat.nPeerStops;
+        }
+        else if( nPeerOutTail - nPeerOutHead < MODEL_FIFO_SIZE )
+            aPeerOut[nPeerOutTail++ % MODEL_FIFO_SIZE] = TxData;
+    }
+
+//  the next byte from peer (its XON/XOFF goes first, even when it's stopped)
+    if( ModelStat.nTime >= nRxNext && ( !(nModelRxMode & MODEL_RX_FLOW) || !IsRxReady ) ) {
+        if( PeerControl ) {
+            _modelReceive( PeerControl, 0 );
+            PeerControl = 0;
+            nRxNext = ModelStat.nTime + _modelCharTicks();
+        }
+        else if( nPeerInHead != nPeerInTail && !IsPeerStopped ) {
+            i = nPeerInHead++ % MODEL_FIFO_SIZE;
+            _modelReceive( aPeerIn[i], aPeerInErrors[i] );
+            nRxNext = ModelStat.nTime + _modelCharTicks();
+        }
+    }
+
+    _modelCheckIRQ();
+}
+
+// *****************************************************************************
+//  INTERRUPTS (HOST BUILD)
+// *****************************************************************************
+
+void DisableInt() {
+    ++nModelMask;
+}
+
+void EnableInt() {
+    if( nModelMask ) --nModelMask;
+    _modelCheckIRQ();
+}
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+void pBModelInit( int nCharTicks, int nRxMode ) {
+//
+//  Reset the model.
+//  ----------------
+//
+//  Arguments:
+//
+//      nCharTicks -- character time at 115200 (ticks), 0 - default
+//
+//      nRxMode -- MODEL_RX_FREE/MODEL_RX_FLOW, MODEL_RX_XONXOFF.
+//
+    memset( aModelRegisters, 0, sizeof(aModelRegisters) );
+    memset( &ModelStat, 0, sizeof(ModelStat) );
+
+    nModelCharTicks = ( nCharTicks > 0 ? nCharTicks : MODEL_CHAR_TICKS );
+    nModelRxMode = nRxMode;
+    nModelMask = 0;
+
+    IsTxBusy = IsTxIRQ = IsRxReady = IsPeerStopped = 0;
+    PeerControl = 0;
+    RxData = RxErrors = 0;
+    nTxDone = nRxNext = 0;
+
+    nPeerInHead = nPeerInTail = nPeerOutHead = nPeerOutTail = 0;
+
+    isr_pb = 0;
+    isr_pb_state = 0;
+}
+
+unsigned char pBModelRead( int Register ) {
+//
+//  Register read access.
+//  ---------------------
+//
+    unsigned char Value;
+
+    _modelAdvance();
+
+    if( Register == PB_STATUS )
+        return (IsTxBusy ? TXRDY:0) | (IsRxReady ? RXRDY:0) | RxErrors;
+
+    if( Register == PB_RXHR ) {
+    //  reading *RXD* cleans receiver state and errors
+        Value = RxData;
+        IsRxReady = 0;
+        RxErrors = 0;
+        return Value;
+    }
+
+    return aModelRegisters[Register];
+}
+
+void pBModelWrite( int Register, unsigned char Value ) {
+//
+//  Register write access.
+//  ----------------------
+//
+    _modelAdvance();
+
+    if( Register == PB_TXHR ) {
+        if( IsTxBusy ) {
+            ++ModelStat.nTxLost;
+            return;
+        }
+        TxData = Value;
+        IsTxBusy = 1;
+        IsTxIRQ = 0;
+        nTxDone = ModelStat.nTime + _modelCharTicks();
+        return;
+    }
+
+    if( Register == PB_IER && (Value & MODEL_IER_EITR) &&
+        !(aModelRegisters[PB_IER] & MODEL_IER_EITR) && !IsTxBusy )
+        IsTxIRQ = 1;
+
+    aModelRegisters[Register] = Value;
+
+    _modelCheckIRQ();
+}
+
+void pBModelTick( int n ) {
+//
+//  Advance the model time by *n* ticks (interrupts may come).
+//
+    while( n-- > 0 ) _modelAdvance();
+}
+
+void pBModelInterrupt() {
+//
+//  Port ISR emulation.
+//  -------------------
+//
+    isr_pb_state = (IsTxBusy ? TXRDY:0) | (IsRxReady ? RXRDY:0) | RxErrors;
+    isr_pb = 1;
+    IsTxIRQ = 0;
+    ++ModelStat.nInterrupts;
+}
+
+void pBModelIdle() {
+//
+//  CPU sleeps up to an interrupt (port or timer tick).
+//  ---------------------------------------------------
+//
+    unsigned long nInterrupts = ModelStat.nInterrupts;
+    int n;
+
+    for( n=0; n<MODEL_IDLE_TICKS && ModelStat.nInterrupts == nInterrupts; n++ )
+        _modelAdvance();
+
+    ModelStat.nIdleTicks += n;
+}
+
+unsigned long pBModelTime() {
+    return ModelStat.nTime;
+}
+
+unsigned long pBModelCharTime() {
+    return (unsigned long)nModelCharTicks;
+}
+
+unsigned long pBModelLineTime() {
+    return (unsigned long)_modelCharTicks();
+}
+
+int pBModelPut( char *s, int n, unsigned char errors ) {
+//
+//  Peer sends data to the port.
+//  ----------------------------
+//
+//  Returns:
+//
+//      Number of bytes taken.
+//
+    int i;
+
+    for( i=0; i<n && nPeerInTail - nPeerInHead < MODEL_FIFO_SIZE; i++ ) {
+        if( (nModelRxMode & MODEL_RX_XONXOFF) && ( s[i] == FLOW_XON || s[i] == FLOW_XOFF ) ) {
+            PeerControl = s[i];
+            continue;
+        }
+        aPeerIn[nPeerInTail % MODEL_FIFO_SIZE] = s[i];
+        aPeerInErrors[nPeerInTail % MODEL_FIFO_SIZE] = errors;
+        ++nPeerInTail;
+    }
+
+    return i;
+}
+
+int pBModelGet( char *s, int n ) {
+//
+//  Take data transmitted by the driver.
+//  ------------------------------------
+//
+//  Returns:
+//
+//      Number of bytes taken.
+//
+    int i;
+
+    for( i=0; i<n && nPeerOutHead != nPeerOutTail; i++ )
+        s[i] = aPeerOut[nPeerOutHead++ % MODEL_FIFO_SIZE];
+
+    return i;
+}
+
+int pBModelPending() {
+    return (int)(nPeerInTail - nPeerInHead) + (IsRxReady ? 1:0);
+}
+
+void pBModelStat( TModelStat *pStat ) {
+    *pStat = ModelStat;
+}
+
+unsigned char *pBModelRegisters() {
+    return aModelRegisters;
+}
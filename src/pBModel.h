@@ -0,0 +1,71 @@
+#
+/*******************************************************************************
+ *  Port -B- Registers Model header file
+ *  ------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBMODEL__
+#define __PBMODEL__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define MODEL_REGISTERS          0x40     // registers area size (bytes)
+#define MODEL_FIFO_SIZE          0x10000  // peer data buffers size (bytes)
+
+#define MODEL_CHAR_TICKS         16       // default character time at 115200 (ticks)
+#define MODEL_IDLE_TICKS         1000     // timer tick period (idle wake up, ticks)
+
+#define MODEL_RX_FREE            0        // peer sends at line speed (overrun is possible)
+#define MODEL_RX_FLOW            1        // peer waits until *RXD* is read
+#define MODEL_RX_XONXOFF         0x02     // peer stops on XOFF from the driver up to XON (with any of above)
+
+#define MODEL_CNR_LOOP           0x08     // *CNR->LOOP*
+#define MODEL_IER_EITR           0x01     // transmitter interrupts enabled
+#define MODEL_IER_EIRC           0x02     // receiver interrupts enabled
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef struct {                          // model statistics
+    unsigned long nTime;                  // model time (ticks)
+    unsigned long nTxBytes;               // bytes transmitted through the line
+    unsigned long nRxBytes;               // bytes received from the line
+    unsigned long nTxLost;                // *TXD* written while busy
+    unsigned long nRxOverruns;            // *RXD* overwritten before read
+    unsigned long nInterrupts;            // ISR calls
+    unsigned long nIdleTicks;             // ticks spent idle (*pBModelIdle*)
+    unsigned long nPeerStops;             // XOFF taken by the peer (MODEL_RX_XONXOFF)
+} TModelStat;
+//
+//  Private --------------------------------------------------------------------
+//
+void  _modelAdvance       ( void );
+void  _modelReceive       ( unsigned char, unsigned char );
+void  _modelCheckIRQ      ( void );
+int   _modelCharTicks     ( void );
+//
+//  Public (client interface) --------------------------------------------------
+//
+void  pBModelInit         ( int, int );         // reset the model (char time, RX mode)
+unsigned char pBModelRead ( int );              // register read access
+void  pBModelWrite        ( int, unsigned char ); // register write access
+void  pBModelTick         ( int );              // advance the model time
+void  pBModelInterrupt    ( void );             // call the port ISR now
+void  pBModelIdle         ( void );             // CPU sleeps up to an interrupt (*wait*)
+unsigned long pBModelTime ( void );             // model time (ticks)
+unsigned long pBModelCharTime( void );         // character time at 115200 (ticks)
+unsigned long pBModelLineTime( void );         // character time at *CNR->SPEED* (ticks)
+int   pBModelPut          ( char *, int, unsigned char ); // peer sends data
+int   pBModelGet          ( char *, int );      // take data transmitted by the driver
+int   pBModelPending      ( void );             // peer data waiting to be received
+void  pBModelStat         ( TModelStat * );     // get model statistics
+unsigned char *pBModelRegisters( void );        // registers area image
+
+#endif
@@ -0,0 +1,332 @@
+#
+/*******************************************************************************
+ *  Port -B- Model Pseudo-Terminal Bridge
+ *  -------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Shows the registers model of the port (PB_REGISTER_MODEL, see pBModel.c)
+ *  as a Linux pty, so real serial software (ground-station tools, terminal
+ *  programs) drives the driver without the board. Bytes the driver writes
+ *  into *TXD* come out of the pty, bytes written into the pty go to the
+ *  model peer and come to *RXD* by the model line: one per character time,
+ *  with RXRDY and receiver interrupts (the model flow control or overruns,
+ *  as the model is initialized).
+ *
+ *  The bridge is a user task of the driver events loop (*pBAddTask*,
+ *  *pBPtyTask*): every call moves the bytes and advances the model time.
+ *  With pacing on the model time follows the clock at the line speed (a
+ *  character of CHAR_BITS at 115200 is *nModelCharTicks* ticks, slower
+ *  speeds are scaled by the model), the task sleeps when the driver got
+ *  ahead; a model fallen behind the clock more than PTY_MAX_LAG is
+ *  resynchronized (counted as late). Without pacing the time goes a
+ *  character per call, as fast as the driver runs.
+ *
+ *  The slave side is opened by the bridge too and kept in raw mode, so the
+ *  peer software may come and go. *pBPtyTask* is the only task allowed to
+ *  wait (up to PTY_SLEEP_MS, paced and ahead of the clock): on the host
+ *  there's nothing else to run in the loop.
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBPtyOpen(IsPaced) - opens the pty after *pBModelInit*, returns the
+ *      slave device name (NULL - failed)
+ *
+ *    pBPtyClose() - closes the pty
+ *
+ *    pBPtySetPacing(IsPaced) - turns the baud rate pacing on/off
+ *
+ *    pBPtyPump() - moves bytes between the pty and the model, returns
+ *      their number
+ *
+ *    pBPtyTask(pArg) - pump and model time step (a user task)
+ *
+ *    pBPtyGetStat(pStat, IsReset) - bridge counters.
+ *
+ *  Assembly (host): pBPty.c pBModel.c pBController.c with PB_REGISTER_MODEL
+ *  and PB_PTY_MAIN (*main*: pbpty [paced [irq]] - echo loop, every line
+ *  received is sent back, the throughput is printed every second).
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#define _GNU_SOURCE                     // posix_openpt, ptsname, cfmakeraw
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "..\config.h"
+
+#include "pBController.h"
+#include "pBModel.h"
+#include "pBPty.h"
+
+#include "..\common\pBCommon.h"
+
+// -----------------------------------------------------------------------------
+//  Model internals
+// -----------------------------------------------------------------------------
+extern int   nModelCharTicks;           // character time at 115200 (ticks)
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+int   nPtyMaster = -1;                  // pty master side
+int   nPtySlave = -1;                   // slave side kept open (raw mode)
+char  sPtyName[PTY_NAME_SIZE];
+
+int   IsPtyPaced = 0;                   // baud rate pacing
+double nPtyClockStart;                  // pacing base: the clock (s)
+unsigned long nPtyModelStart;           // and the model time (ticks)
+
+char  sPtyIn[PTY_BUFFER_SIZE];          // read from the pty, not taken by the model yet
+int   nPtyInPos, nPtyInSize;
+char  sPtyOut[PTY_BUFFER_SIZE];         // taken from the model, not written to the pty yet
+int   nPtyOutPos, nPtyOutSize;
+
+TPtyStat PtyStat;
+
+// *****************************************************************************
+//  PACING (PRIVATE)
+// *****************************************************************************
+
+double _ptySeconds() {
+    struct timespec t;
+
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+double _ptyTicksPerSecond() {
+//
+//  Model time rate at the line speed (115200 character is *nModelCharTicks*).
+//
+    return (double)nModelCharTicks * 115200. / CHAR_BITS;
+}
+
+void _ptyResync() {
+//
+//  Start pacing from now.
+//
+    nPtyClockStart = _ptySeconds();
+    nPtyModelStart = pBModelTime();
+}
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+char *pBPtyOpen( int IsPaced ) {
+//
+//  Open the pty.
+//  -------------
+//
+//  Arguments:
+//
+//      IsPaced -- 1/0, baud rate pacing on/off.
+//
+//  Returns:
+//
+//      Slave device name or NULL (failed).
+//
+    struct termios tio;
+    char *s;
+
+    if( nPtyMaster >= 0 )
+        return sPtyName;
+
+    if( (nPtyMaster = posix_openpt( O_RDWR | O_NOCTTY )) < 0 )
+        return 0;
+
+    if( grantpt(nPtyMaster) || unlockpt(nPtyMaster) || !(s = ptsname(nPtyMaster)) ) {
+        pBPtyClose();
+        return 0;
+    }
+    strncpy( sPtyName, s, sizeof(sPtyName) - 1 );
+
+//  raw slave side, kept open (the master doesn't get hang up without the peer)
+    if( (nPtySlave = open( sPtyName, O_RDWR | O_NOCTTY )) < 0 || tcgetattr( nPtySlave, &tio ) ) {
+        pBPtyClose();
+        return 0;
+    }
+    cfmakeraw( &tio );
+    tcsetattr( nPtySlave, TCSANOW, &tio );
+
+    fcntl( nPtyMaster, F_SETFL, fcntl(nPtyMaster, F_GETFL) | O_NONBLOCK );
+
+    nPtyInPos = nPtyInSize = nPtyOutPos = nPtyOutSize = 0;
+    memset( &PtyStat, 0, sizeof(PtyStat) );
+
+    pBPtySetPacing( IsPaced );
+
+    return sPtyName;
+}
+
+void pBPtyClose() {
+    if( nPtySlave >= 0 ) close( nPtySlave );
+    if( nPtyMaster >= 0 ) close( nPtyMaster );
+    nPtySlave = nPtyMaster = -1;
+}
+
+void pBPtySetPacing( int IsPaced ) {
+    IsPtyPaced = IsPaced;
+    _ptyResync();
+}
+
+int pBPtyPump() {
+//
+//  Move bytes between the pty and the model.
+//  -----------------------------------------
+//  Bytes the model peer can't take yet (its buffer is full) and the ones
+//  the pty can't take are kept up to the next pump.
+//
+//  Returns:
+//
+//      Number of bytes moved.
+//
+    int n, nMoved = 0;
+
+    if( nPtyMaster < 0 )
+        return 0;
+
+//  pty -> model peer
+    if( nPtyInPos == nPtyInSize ) {
+        nPtyInPos = nPtyInSize = 0;
+        if( (n = (int)read( nPtyMaster, sPtyIn, sizeof(sPtyIn) )) > 0 )
+            nPtyInSize = n;
+    }
+    if( nPtyInPos < nPtyInSize ) {
+        n = pBModelPut( sPtyIn + nPtyInPos, nPtyInSize - nPtyInPos, 0 );
+        nPtyInPos += n;
+        PtyStat.nFromPty += n;
+        nMoved += n;
+    }
+
+//  model peer -> pty
+    if( nPtyOutPos == nPtyOutSize ) {
+        nPtyOutPos = 0;
+        nPtyOutSize = pBModelGet( sPtyOut, sizeof(sPtyOut) );
+    }
+    if( nPtyOutPos < nPtyOutSize ) {
+        if( (n = (int)write( nPtyMaster, sPtyOut + nPtyOutPos, nPtyOutSize - nPtyOutPos )) > 0 ) {
+            nPtyOutPos += n;
+            PtyStat.nToPty += n;
+            nMoved += n;
+        }
+    }
+
+    return nMoved;
+}
+
+void pBPtyTask( void *pArg ) {
+//
+//  Pump and advance the model time (user task of the events loop).
+//  ---------------------------------------------------------------
+//  A step is a character time at most, so the driver takes every byte.
+//
+    struct pollfd fd;
+    double nTarget;
+    long nAhead;
+    int n;
+
+    pBPtyPump();
+
+    if( !IsPtyPaced ) {
+        pBModelTick( nModelCharTicks );
+        PtyStat.nTicks += nModelCharTicks;
+        return;
+    }
+
+//  the model time the clock allows
+    nTarget = (double)nPtyModelStart + ( _ptySeconds() - nPtyClockStart ) * _ptyTicksPerSecond();
+    nAhead = (long)( (double)pBModelTime() - nTarget );
+
+    if( nAhead < -(long)PTY_MAX_LAG ) {
+    //  the driver can't keep the line speed, go on from now
+        ++PtyStat.nLate;
+        _ptyResync();
+        nAhead = 0;
+    }
+
+    if( nAhead < 0 ) {
+        n = ( -nAhead < nModelCharTicks ? (int)-nAhead : nModelCharTicks );
+        pBModelTick( n );
+        PtyStat.nTicks += n;
+    }
+    else {
+    //  wait for the clock (or the peer)
+        n = (int)( (double)nAhead * 1000. / _ptyTicksPerSecond() );
+        fd.fd = nPtyMaster;
+        fd.events = POLLIN;
+        poll( &fd, 1, n < 1 ? 0 : n > PTY_SLEEP_MS ? PTY_SLEEP_MS : n );
+        ++PtyStat.nSleeps;
+    }
+}
+
+void pBPtyGetStat( TPtyStat *pStat, int IsReset ) {
+    if( pStat ) *pStat = PtyStat;
+    if( IsReset ) memset( &PtyStat, 0, sizeof(PtyStat) );
+}
+
+#ifdef PB_PTY_MAIN
+
+char  sPtyLine[PTY_LINE_SIZE];          // echo loop input request
+unsigned long nPtyLines;
+
+void _ptyEchoLine( char *sItem ) {
+//
+//  Input request done: send the line back, wait for the next one.
+//
+    ++nPtyLines;
+    pBOutRequest( (char *)"%s", sItem );
+    pBInRequest( sPtyLine, sizeof(sPtyLine) );
+}
+
+int main( int argc, char **argv ) {
+    TPtyStat Stat;
+    char *sName;
+    int IsPaced = 1, IsIRQ = 1;
+    double t, t0;
+
+    if( argc > 1 ) IsPaced = atoi(argv[1]);
+    if( argc > 2 ) IsIRQ = atoi(argv[2]);
+
+    pBModelInit( 0, MODEL_RX_FLOW );
+    if( !(sName = pBPtyOpen( IsPaced )) ) {
+        printf( "... PTY: not opened (%s)\n", strerror(errno) );
+        return 1;
+    }
+    printf( "--> PTY: %s (pacing %s, %s mode), lines are echoed\n", sName, IsPaced ? "on":"off", IsIRQ ? "IRQ":"polled" );
+
+    pBInit( IsIRQ, IsIRQ );
+    pBAddTask( pBPtyTask, 0 );
+    pBSetHandlers( 0, _ptyEchoLine );
+    pBInRequest( sPtyLine, sizeof(sPtyLine) );
+
+    t0 = _ptySeconds();
+    for( ;; ) {
+        pBPoll();
+        if( (t = _ptySeconds()) - t0 >= PTY_STAT_PERIOD ) {
+            pBPtyGetStat( &Stat, 1 );
+            printf( "    %8.0f bytes/s in, %8.0f bytes/s out, %lu lines, %lu late\n",
+                Stat.nFromPty / (t - t0), Stat.nToPty / (t - t0), nPtyLines, Stat.nLate );
+            fflush( stdout );
+            nPtyLines = 0;
+            t0 = t;
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#
+/*******************************************************************************
+ *  Port -B- Model Pseudo-Terminal Bridge header file
+ *  -------------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBPTY__
+#define __PBPTY__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define PTY_BUFFER_SIZE          4096     // bytes moved a direction per pump
+#define PTY_NAME_SIZE            128      // slave device name
+#define PTY_MAX_LAG              (MODEL_CHAR_TICKS * 1000) // model ticks behind the clock before it's resynchronized
+#define PTY_SLEEP_MS             1        // max sleep when the model is ahead of the clock (ms)
+#define PTY_STAT_PERIOD          1.0      // statistics print period of the echo loop (s)
+#define PTY_LINE_SIZE            256      // echo loop line buffer
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef struct {                          // bridge counters
+    unsigned long nToPty;                 // bytes transmitted by the driver, written to the pty
+    unsigned long nFromPty;               // bytes read from the pty, sent to the port
+    unsigned long nTicks;                 // model ticks advanced by the bridge
+    unsigned long nSleeps;                // waits for the clock (paced, model is ahead)
+    unsigned long nLate;                  // resynchronizations (paced, model fell behind)
+} TPtyStat;
+//
+//  Private --------------------------------------------------------------------
+//
+double _ptySeconds        ( void );
+double _ptyTicksPerSecond ( void );
+void  _ptyResync          ( void );
+//
+//  Public (client interface) --------------------------------------------------
+//
+char *pBPtyOpen           ( int );              // open the pty (pacing on/off), returns slave name
+void  pBPtyClose          ( void );             // close the pty
+void  pBPtySetPacing      ( int );              // turn baud rate pacing on/off
+int   pBPtyPump           ( void );             // move bytes between the pty and the model
+void  pBPtyTask           ( void * );           // pump and advance the model time (user task)
+void  pBPtyGetStat        ( TPtyStat *, int );  // get bridge counters
+
+#endif
@@ -0,0 +1,1064 @@
+#
+/*******************************************************************************
+ *  Port -B- Controller Stress Harness
+ *  ----------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Runs the controller against the registers model (PB_REGISTER_MODEL,
+ *  see pBModel.c) and randomly interleaves client calls (*pBPush*,
+ *  *pBPushv*, *pBOutRequest*, *pBDeferRequest*, *pBInRequest*, *pBSend*,
+ *  *pBReceive*, *pBPoll*) with the model time and interrupts (the model
+ *  calls the ISR between any register accesses, spurious interrupts are
+ *  added at random points).
+ *
+ *  Checks after every step:
+ *
+ *    - bytes came to the peer are the same as pushed items (FIFO order,
+ *      line delimeters included), but the ones removed from the queue; with
+ *      PB_LIGHT_FORMAT the long lines of *pBOutRequest* (STRESS_LONG_ITEM, up
+ *      to the item size and over it) come cut to the item size; an item of
+ *      the max size (MAX_OUTPUT_ITEM_SIZE) is never rejected by the empty
+ *      queue (every queue variant); the item the space is reserved for
+ *      (*pBReserve*) is never rejected, a longer push ahead of it can't
+ *      use the space
+ *
+ *    - output queue overflow policies: OVERFLOW_DROP_OLDEST drops the
+ *      oldest items waiting in the queue (their number is the counter of
+ *      *pBGetOverflow*, *pBStatus* is REQUEST_FINISHED), OVERFLOW_BLOCK
+ *      waits for the transmitter (the policy is switched now and then)
+ *
+ *    - requests are cancelled and the queues are flushed at random points
+ *      (*pBCancel*, *pBFlushTx*, *pBFlushRx*): the removed output items are
+ *      the ones reported (REQUEST_FINISHED), the lines sent by the peer for
+ *      removed input requests go to the later requests; *pBStatus* of the
+ *      outstanding requests and *pBLastRequest* (REQUEST_NONE after a
+ *      rejected request) are checked
+ *
+ *    - every done input request holds the line sent by the peer for it
+ *      (binary frames with PB_RX_MODES: fixed length, delimited and ended
+ *      by the gap while the peer pauses, any bytes, their sizes and done
+ *      reasons, the gap time by the model line time)
+ *
+ *    - queues invariants (counters and pointers are inside the storage).
+ *
+ *  With PB_FLOW_CONTROL the driver runs XON/XOFF flow control against the
+ *  model peer honouring it (MODEL_RX_XONXOFF), low watermarks make the
+ *  peer stopped by long output items, and the peer stops the driver
+ *  transmitter for a while now and then.
+ *
+ *  The free peer (STRESS_FREE_PEER) doesn't wait until *RXD* is read, it
+ *  sends at line speed and the model time goes with *pBPoll* called every
+ *  STRESS_FREE_TICKS (the application polls the port). Only the flow
+ *  control keeps the bytes then: an overrun is a failure with it.
+ *
+ *  At the end the queues are flushed and the throughput is reported (bytes
+ *  per model ticks and host time).
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBStressRun(nSeed, nSteps, IsIRQ, pStat) - runs *nSteps* random
+ *      operations (IRQ or polled mode, 2 - adaptive with PB_ADAPTIVE_IRQ,
+ *      STRESS_FREE_PEER flag - the free peer), returns number of failures
+ *
+ *    pBStressPrint(pStat) - prints run results.
+ *
+ *  Assembly (host): pBStress.c pBModel.c pBController.c with PB_REGISTER_MODEL
+ *  and PB_STRESS_MAIN (*main*: pbstress [seed [steps [irq [trace]]]], the free
+ *  peer runs go with PB_FLOW_CONTROL: irq 4, 5), any queue variant
+ *  (PB_RING_QUEUE, PB_SLAB_QUEUE) may be checked, pBFormat.c is added with
+ *  PB_LIGHT_FORMAT. With PB_REGISTER_TRACE
+ *  (and pBTrace.c) the runs are recorded into *trace* file to be replayed.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "..\config.h"
+
+#define PB_PORT_INTERNALS               // hot state names (PB_HOT_STATE)
+#include "pBController.h"
+#include "pBModel.h"
+#include "pBStress.h"
+#ifdef PB_REGISTER_TRACE
+#include "pBTrace.h"
+#endif
+
+#include "..\common\pBCommon.h"
+
+// -----------------------------------------------------------------------------
+//  Controller internals (checked invariants)
+// -----------------------------------------------------------------------------
+extern TInItem *pInQueueBase;
+extern int   nInQueueSize;
+extern char *pOutQueueBase;
+extern int   nOutQueueSize;
+#ifndef PB_HOT_STATE
+extern TInItem *pInItemsQueue, *pInNext;
+extern int   nInItems;
+extern char *pOutItemsQueue, *pOutNext;
+extern int   nOutItems;
+extern int   nPortTimeout, port_mode;
+#endif
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+unsigned int nStressSeed;               // random generator state
+unsigned long nStressStep;
+
+char  aExpected[STRESS_EXPECTED_SIZE];  // expected output stream (FIFO)
+unsigned long nExpectedHead, nExpectedTail;
+
+typedef struct {                        // output item on the way to the peer
+    TRequest hRequest;                  // its handle
+    unsigned long nEnd;                 // end of its bytes in the expected stream
+    int   IsQueued;                     // waiting in the queue (*_stressSnapItems*)
+    int   IsRemoved;                    // removed from the queue (never sent)
+} TStressItem;
+
+TStressItem aItems[STRESS_ITEMS];       // output items not verified yet (FIFO)
+int   nItemsHead, nItemsCount;
+int   nStressPolicy;                    // output queue overflow policy
+int   nStressReserved;                  // the push goes ahead of the reserved item of the size (0 - none)
+int   IsStressFree;                     // the peer sends at line speed (STRESS_FREE_PEER)
+
+typedef struct {                        // input request slot
+    char  sBuffer[STRESS_LINE_SIZE];    // request buffer
+    char  sLine[STRESS_LINE_SIZE];      // line sent by the peer
+#ifdef PB_RX_MODES
+    TInOptions Options;                 // binary request options
+    int   nLine;                        // binary frame size (0 - text line)
+#endif
+    TRequest hRequest;                  // its handle
+    int   IsRemoved;                    // removed from the queue
+} TStressSlot;
+
+TStressSlot aSlots[STRESS_SLOTS];       // outstanding input requests (FIFO)
+int   nSlotsHead, nSlotsCount, nSlotsRemoved, nLines;
+
+char  aOrphans[STRESS_SLOTS][STRESS_LINE_SIZE]; // lines sent for removed requests (FIFO)
+int   nOrphansHead, nOrphansCount;
+int   nStressGaps;                      // frames to be ended by the gap (the peer pauses)
+
+#ifdef PB_FLOW_CONTROL
+int   nStressPause;                     // steps up to the peer sends XON (0 - not paused)
+#endif
+
+// *****************************************************************************
+//  HARNESS (PRIVATE)
+// *****************************************************************************
+
+unsigned int _stressRandom() {
+//
+//  Random generator (LCG), the same sequence on any platform.
+//
+    nStressSeed = nStressSeed * 1103515245 + 12345;
+    return (nStressSeed >> 16) & 0x7FFF;
+}
+
+void _stressFail( TStressStat *pStat, char *sReason ) {
+    if( !pStat->nErrors ) {
+        pStat->nFirstError = nStressStep;
+        printf( "... FAILURE at step %lu: %s\n", nStressStep, sReason );
+    }
+    ++pStat->nErrors;
+}
+
+void _stressCheck( TStressStat *pStat ) {
+//
+//  Check output stream, done input requests and queues invariants.
+//
+    char s[256];
+    TStressSlot *ps;
+    int i, n;
+#ifdef PB_FLOW_CONTROL
+    TFlowStat Flow;
+#endif
+
+//  output: bytes came to the peer
+    while( (n = pBModelGet(s, sizeof(s))) > 0 ) {
+        for( i=0; i<n; i++ ) {
+            if( nExpectedHead == nExpectedTail ) {
+                _stressFail( pStat, "unexpected output byte" );
+                break;
+            }
+            if( s[i] != aExpected[nExpectedHead++ % STRESS_EXPECTED_SIZE] )
+                _stressFail( pStat, "output byte mismatch" );
+            else
+                ++pStat->nTxBytes;
+        //  the item came, the removed ones behind it are skipped
+            if( nItemsCount && nExpectedHead == aItems[nItemsHead].nEnd ) {
+                nItemsHead = (nItemsHead + 1) % STRESS_ITEMS;
+                --nItemsCount;
+                _stressSkipRemoved();
+            }
+        }
+    }
+
+//  input: done requests
+    if( nInItems < 0 || nInItems > nSlotsCount - nSlotsRemoved )
+        _stressFail( pStat, "input items counter" );
+    else {
+        while( nSlotsCount - nSlotsRemoved > nInItems ) {
+            ps = &aSlots[nSlotsHead];
+#ifdef PB_RX_MODES
+            if( ps->nLine ) {
+                if( ps->Options.nReceived != ps->nLine || memcmp(ps->sBuffer, ps->sLine, ps->nLine) ||
+                    ps->sBuffer[ps->nLine] != '\0' ||
+                    ps->Options.nEnd != ( (ps->Options.nMode & IN_COUNT) ? IN_END_COUNT :
+                        (ps->Options.nMode & IN_DELIMITERS) ? IN_END_DELIMITER : IN_END_GAP ) )
+                    _stressFail( pStat, "input frame mismatch" );
+                else {
+                    ++pStat->nRxItems;
+                    pStat->nRxBytes += ps->nLine;
+                }
+            //  the peer goes on after the gap
+                if( ps->Options.nMode == IN_GAP ) {
+                    --nStressGaps;
+                    ++pStat->nRxGaps;
+                }
+            }
+            else
+#endif
+            if( strcmp(ps->sBuffer, ps->sLine) )
+                _stressFail( pStat, "input line mismatch" );
+            else {
+                ++pStat->nRxItems;
+                pStat->nRxBytes += strlen(ps->sLine) + 1;
+            }
+            nSlotsHead = (nSlotsHead + 1) % STRESS_SLOTS;
+            --nSlotsCount;
+            _stressSkipSlots();
+        }
+    }
+
+//  queues invariants
+    if( nInItems > nInQueueSize ||
+        pInItemsQueue < pInQueueBase || pInItemsQueue >= pInQueueBase + nInQueueSize ||
+        pInNext < pInQueueBase || pInNext > pInQueueBase + nInQueueSize )
+        _stressFail( pStat, "input queue pointers" );
+
+    if( nOutItems < 0 )
+        _stressFail( pStat, "output items counter" );
+
+#ifndef PB_SLAB_QUEUE
+    if( pOutItemsQueue < pOutQueueBase || pOutItemsQueue > pOutNext ||
+        pOutNext > pOutQueueBase + nOutQueueSize )
+        _stressFail( pStat, "output queue pointers" );
+#endif
+
+    if( !nOutItems && !nInItems && port_mode != MODE_NONE )
+        _stressFail( pStat, "port mode of empty queues" );
+
+#ifdef PB_FLOW_CONTROL
+    pBGetFlow( &Flow, 0 );
+    if( Flow.nHeld < 0 || Flow.nHeld > FLOW_HOLD_SIZE )
+        _stressFail( pStat, "held bytes counter" );
+#endif
+}
+
+void _stressPush( TStressStat *pStat, int IsFormat ) {
+//
+//  Push random output item (*pBPush*, *pBPushv* or *pBOutRequest*).
+//
+    char sItem[STRESS_LONG_ITEM + 8];
+    TOutPart parts[3];
+    TOverflowStat Overflow;
+    TStressItem *pi;
+    unsigned long nDropped = 0;
+    int i, n, code, IsEmpty = 0, IsReserved = 0;
+
+    if( nItemsCount >= STRESS_ITEMS )
+        return;
+
+    n = 1 + _stressRandom() % STRESS_MAX_ITEM;
+#ifdef PB_LIGHT_FORMAT
+    if( IsFormat && !(_stressRandom() % STRESS_LONG_RATE) )
+        n = STRESS_LONG_ITEM - 1 - _stressRandom() % 8;
+#endif
+//  an item of the max size fits the empty queue
+    if( !IsFormat && !(_stressRandom() % STRESS_LONG_RATE) ) {
+        n = MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET;
+        IsEmpty = !nOutItems;
+    }
+//  the push ahead of the reserved item is longer, it fits the queue only
+//  with the reserved space (PB_SLAB_QUEUE: the max size)
+    if( nStressReserved ) {
+#ifdef PB_SLAB_QUEUE
+        n = MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET;
+#else
+        n = pBTxFree() + nStressReserved;
+        if( n > MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET ) n = MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET;
+#endif
+        if( n <= nStressReserved ) n = nStressReserved + 1;
+    }
+    for( i=0; i<n; i++ )
+        sItem[i] = '!' + _stressRandom() % ('~' - '!' + 1);
+    sItem[n] = '\0';
+
+//  the space is reserved for the item, a longer one is pushed first
+    if( !IsFormat && !nStressReserved && n <= STRESS_MAX_ITEM && !(_stressRandom() % STRESS_RESERVE_RATE) &&
+        pBReserve(n) ) {
+        IsReserved = 1;
+        nStressReserved = n;
+        _stressPush( pStat, 0 );
+        nStressReserved = 0;
+    }
+
+//  the items waiting in the queue may be dropped for the new one
+    if( nStressPolicy == OVERFLOW_DROP_OLDEST ) {
+        pBGetOverflow( &Overflow, 0 );
+        nDropped = Overflow.nDroppedItems;
+        _stressSnapItems();
+    }
+
+#ifdef PB_DEFERRED
+    if( IsFormat && _stressRandom() % 2 ) {
+    //  deferred request, the text is expected as *sprintf* makes it
+        i = (int)_stressRandom() - (int)_stressRandom();
+        sprintf( sItem, "D%+d:%#-8lx|%.5u%c%%", i, (unsigned long)n, (unsigned int)n, 'a' + n % 26 );
+        code = pBDeferRequest( "D%+d:%#-8lx|%.5u%c%%", i, (unsigned long)n, (unsigned int)n, 'a' + n % 26 );
+        code = ( code == PB_ERR_OVERFLOW || code > PB_OK ) ? 0:1;
+        n = strlen(sItem);
+    }
+    else
+#endif
+    if( IsFormat ) {
+        code = pBOutRequest( "%s", sItem );
+        code = ( code == PB_ERR_OVERFLOW || code > PB_OK ) ? 0:1;
+#ifdef PB_LIGHT_FORMAT
+    //  the line is cut to the item size with its delimiters
+        if( n > MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET - 1 )
+            n = MAX_OUTPUT_ITEM_SIZE - SIZE_OFFSET - 1;
+#endif
+    }
+    else if( n >= 3 && _stressRandom() % 2 ) {
+    //  the item is gathered from three parts (the last one is a string)
+        parts[0].pData = sItem;
+        parts[0].nSize = 1;
+        parts[1].pData = sItem + 1;
+        parts[1].nSize = 1 + _stressRandom() % (n - 2);
+        parts[2].pData = sItem + 1 + parts[1].nSize;
+        parts[2].nSize = -1;
+        code = pBPushv( parts, 3 );
+    }
+    else
+        code = pBPush( sItem, 1, 0 );
+
+    if( nStressPolicy == OVERFLOW_DROP_OLDEST ) {
+        pBGetOverflow( &Overflow, 0 );
+        _stressRemoveItems( pStat, (int)(Overflow.nDroppedItems - nDropped), 1 );
+    }
+
+    if( !code ) {
+        if( pBLastRequest(MODE_TX) != REQUEST_NONE )
+            _stressFail( pStat, "last output request is rejected one" );
+        if( IsEmpty )
+            _stressFail( pStat, "max size item rejected by the empty queue" );
+        if( IsReserved )
+            _stressFail( pStat, "reserved item rejected" );
+        ++pStat->nTxRejected;
+        return;
+    }
+    if( IsReserved ) ++pStat->nTxReserved;
+
+//  the item and line delimeters are expected at the peer
+    for( i=0; i<n; i++ )
+        aExpected[nExpectedTail++ % STRESS_EXPECTED_SIZE] = sItem[i];
+    aExpected[nExpectedTail++ % STRESS_EXPECTED_SIZE] = '\n';
+    aExpected[nExpectedTail++ % STRESS_EXPECTED_SIZE] = '\r';
+
+    pi = &aItems[(nItemsHead + nItemsCount++) % STRESS_ITEMS];
+    pi->hRequest = pBLastRequest( MODE_TX );
+    pi->nEnd = nExpectedTail;
+    pi->IsQueued = pi->IsRemoved = 0;
+
+    if( pBStatus(pi->hRequest) == REQUEST_UNKNOWN )
+        _stressFail( pStat, "last output request state" );
+
+    ++pStat->nTxItems;
+}
+
+void _stressSnapItems() {
+//
+//  Note the output items waiting in the queue (not being sent) before an
+//  operation which may remove them.
+//
+    TStressItem *pi;
+    int i;
+
+    for( i=0; i<nItemsCount; i++ ) {
+        pi = &aItems[(nItemsHead + i) % STRESS_ITEMS];
+        pi->IsQueued = !pi->IsRemoved && pBStatus(pi->hRequest) == REQUEST_QUEUED;
+    }
+}
+
+void _stressRemoveItems( TStressStat *pStat, int nRemoved, int IsOldest ) {
+//
+//  The noted items finished by the operation were removed from the queue
+//  (nothing is sent meanwhile but a byte of the current item), there must
+//  be *nRemoved* of them, the oldest ones with *IsOldest*.
+//
+    TStressItem *pi;
+    int i, n = 0, IsKept = 0;
+
+    for( i=0; i<nItemsCount; i++ ) {
+        pi = &aItems[(nItemsHead + i) % STRESS_ITEMS];
+        if( !pi->IsQueued )
+            continue;
+        pi->IsQueued = 0;
+        if( pBStatus(pi->hRequest) != REQUEST_FINISHED ) {
+            IsKept = 1;
+            continue;
+        }
+        if( IsOldest && IsKept )
+            _stressFail( pStat, "not the oldest output item removed" );
+        pi->IsRemoved = 1;
+        ++n;
+    }
+
+    if( n != nRemoved )
+        _stressFail( pStat, "removed output items counter" );
+
+    pStat->nTxRemoved += n;
+    _stressSkipRemoved();
+}
+
+void _stressSkipRemoved() {
+//
+//  Skip bytes of the removed items at the head of the expected stream.
+//
+    while( nItemsCount && aItems[nItemsHead].IsRemoved ) {
+        nExpectedHead = aItems[nItemsHead].nEnd;
+        nItemsHead = (nItemsHead + 1) % STRESS_ITEMS;
+        --nItemsCount;
+    }
+}
+
+void _stressCancel( TStressStat *pStat ) {
+//
+//  Cancel a random request or flush a queue now and then.
+//
+    int i, n = _stressRandom() % STRESS_FLUSH_RATE;
+
+    if( n > 1 ) {
+        if( n % 2 ) _stressCancelOut( pStat );
+        else _stressCancelIn( pStat );
+    }
+    else if( n ) _stressFlushIn( pStat );
+    else {
+        _stressSnapItems();
+        i = pBFlushTx();
+        _stressRemoveItems( pStat, i, 0 );
+    }
+}
+
+void _stressCancelOut( TStressStat *pStat ) {
+//
+//  Cancel a random output item, only a waiting one is removed (an item in
+//  the middle may be kept if there is no room for its number).
+//
+    TStressItem *pi;
+    int n, nStatus;
+
+    if( !nItemsCount )
+        return;
+
+    pi = &aItems[(nItemsHead + _stressRandom() % nItemsCount) % STRESS_ITEMS];
+    nStatus = pBStatus( pi->hRequest );
+    if( pi->IsRemoved ? nStatus != REQUEST_FINISHED : nStatus == REQUEST_UNKNOWN )
+        _stressFail( pStat, "output request state" );
+
+    _stressSnapItems();
+    n = pBCancel( pi->hRequest );
+    if( n && nStatus != REQUEST_QUEUED )
+        _stressFail( pStat, "output request cancelled not waiting" );
+
+    _stressRemoveItems( pStat, n, 0 );
+    if( n && !pi->IsRemoved )
+        _stressFail( pStat, "other output request cancelled" );
+}
+
+void _stressCancelIn( TStressStat *pStat ) {
+//
+//  Cancel a random input request, the one being received is kept.
+//
+    TStressSlot *ps;
+    int i, n, nStatus;
+
+    if( nSlotsCount == nSlotsRemoved )
+        return;
+
+    i = _stressRandom() % nSlotsCount;
+    ps = &aSlots[(nSlotsHead + i) % STRESS_SLOTS];
+    if( ps->IsRemoved )
+        return;
+
+    nStatus = pBStatus( ps->hRequest );
+    if( nStatus != REQUEST_QUEUED && ( nStatus != REQUEST_ACTIVE || i ) )
+        _stressFail( pStat, "input request state" );
+
+//  a line can't go to a binary request
+    if( !_stressIsTextFrom(i) )
+        return;
+
+    n = pBCancel( ps->hRequest );
+    if( n != ( nStatus == REQUEST_QUEUED ) || ( n && pBStatus(ps->hRequest) != REQUEST_FINISHED ) )
+        _stressFail( pStat, "input request cancel" );
+
+    if( n ) {
+        _stressRemoveSlot( i );
+        ++pStat->nRxRemoved;
+    }
+}
+
+void _stressFlushIn( TStressStat *pStat ) {
+//
+//  Flush the input queue, all requests but the one being received are
+//  removed.
+//
+    int i, n, nFirst = 0;
+
+    if( nSlotsCount == nSlotsRemoved )
+        return;
+
+    if( pBStatus(aSlots[nSlotsHead].hRequest) == REQUEST_ACTIVE )
+        nFirst = 1;
+    if( !_stressIsTextFrom(nFirst) )
+        return;
+
+    n = pBFlushRx();
+    if( n != nSlotsCount - nSlotsRemoved - nFirst )
+        _stressFail( pStat, "flushed input requests counter" );
+
+    for( i=nSlotsCount-1; i>=nFirst; i-- ) {
+        if( aSlots[(nSlotsHead + i) % STRESS_SLOTS].IsRemoved )
+            continue;
+        if( pBStatus(aSlots[(nSlotsHead + i) % STRESS_SLOTS].hRequest) != REQUEST_FINISHED )
+            _stressFail( pStat, "flushed input request state" );
+        _stressRemoveSlot( i );
+        ++pStat->nRxRemoved;
+    }
+}
+
+int _stressIsTextFrom( int nSlot ) {
+//
+//  1/0 - the requests from the slot are text ones (the lines may move
+//  between them).
+//
+#ifdef PB_RX_MODES
+    int i;
+
+    for( i=nSlot; i<nSlotsCount; i++ )
+        if( aSlots[(nSlotsHead + i) % STRESS_SLOTS].nLine )
+            return 0;
+#endif
+    return 1;
+}
+
+void _stressRemoveSlot( int nSlot ) {
+//
+//  The input request was removed: lines sent by the peer for the later
+//  requests move up to them, the last line waits for a new request.
+//
+    TStressSlot *ps;
+    char sLine[STRESS_LINE_SIZE], sNext[STRESS_LINE_SIZE];
+    int i;
+
+    ps = &aSlots[(nSlotsHead + nSlot) % STRESS_SLOTS];
+    strcpy( sLine, ps->sLine );
+    ps->IsRemoved = 1;
+    ++nSlotsRemoved;
+
+    for( i=nSlot+1; i<nSlotsCount; i++ ) {
+        ps = &aSlots[(nSlotsHead + i) % STRESS_SLOTS];
+        if( ps->IsRemoved )
+            continue;
+        strcpy( sNext, ps->sLine );
+        strcpy( ps->sLine, sLine );
+        strcpy( sLine, sNext );
+    }
+
+//  it comes ahead of the lines waiting already
+    nOrphansHead = (nOrphansHead + STRESS_SLOTS - 1) % STRESS_SLOTS;
+    strcpy( aOrphans[nOrphansHead], sLine );
+    ++nOrphansCount;
+
+    _stressSkipSlots();
+}
+
+void _stressSkipSlots() {
+//
+//  Drop the removed requests at the head of the slots.
+//
+    while( nSlotsCount && aSlots[nSlotsHead].IsRemoved ) {
+        nSlotsHead = (nSlotsHead + 1) % STRESS_SLOTS;
+        --nSlotsCount;
+        --nSlotsRemoved;
+    }
+}
+
+void _stressOverflow() {
+//
+//  Switch output queue overflow policy.
+//
+    static int aPolicies[] = { OVERFLOW_REJECT, OVERFLOW_DROP_OLDEST, OVERFLOW_BLOCK };
+
+    nStressPolicy = aPolicies[_stressRandom() % 3];
+    pBSetOverflow( nStressPolicy, STRESS_BLOCK_TIMEOUT );
+}
+
+void _stressInRequest( TStressStat *pStat ) {
+//
+//  Push an input request and send the line for it from the peer.
+//
+    TStressSlot *ps;
+    int i, n, code;
+
+//  the peer pauses up to the gap ends the frame (nothing is sent)
+    if( nSlotsCount >= STRESS_SLOTS || nStressGaps )
+        return;
+
+    ps = &aSlots[(nSlotsHead + nSlotsCount) % STRESS_SLOTS];
+    memset( ps->sBuffer, 0x55, sizeof(ps->sBuffer) );
+    ps->IsRemoved = 0;
+
+#ifdef PB_RX_MODES
+    ps->nLine = 0;
+#endif
+
+//  the line sent for a removed request is taken first
+    if( nOrphansCount ) {
+        strcpy( ps->sLine, aOrphans[nOrphansHead] );
+        n = 0;
+    }
+    else {
+        sprintf( ps->sLine, "R%05d:", nLines % 100000 );
+        n = strlen(ps->sLine) + _stressRandom() % (STRESS_MAX_LINE - 8);
+        for( i=strlen(ps->sLine); i<n; i++ )
+            ps->sLine[i] = '!' + _stressRandom() % ('~' - '!' + 1);
+        ps->sLine[n] = '\0';
+
+#ifdef PB_RX_MODES
+        if( _stressRandom() % 2 ) {
+            _stressInFrame( pStat );
+            return;
+        }
+#endif
+    }
+
+    ++nSlotsCount;
+    code = pBInRequest( ps->sBuffer, sizeof(ps->sBuffer) );
+
+    if( code == PB_ERR_OVERFLOW || code == PB_ERR_UNDEFINED || code > PB_OK ) {
+        if( pBLastRequest(MODE_RX) != REQUEST_NONE )
+            _stressFail( pStat, "last input request is rejected one" );
+        --nSlotsCount;
+        ++pStat->nRxRejected;
+        return;
+    }
+
+    ps->hRequest = pBLastRequest( MODE_RX );
+    if( pBStatus(ps->hRequest) == REQUEST_UNKNOWN )
+        _stressFail( pStat, "last input request state" );
+
+    if( !n ) {
+        nOrphansHead = (nOrphansHead + 1) % STRESS_SLOTS;
+        --nOrphansCount;
+        return;
+    }
+
+    ++nLines;
+    pBModelPut( ps->sLine, n, 0 );
+    pBModelPut( "\r", 1, 0 );
+}
+
+#ifdef PB_RX_MODES
+
+void _stressInFrame( TStressStat *pStat ) {
+//
+//  Push a binary input request (fixed length or delimited frame, any bytes)
+//  and send the frame for it from the peer. The gap is set long enough not
+//  to end the frame, but for the frame ended by it (the peer pauses then).
+//
+    static char sDelimiters[] = { 0x03, 0x17 };
+    TStressSlot *ps = &aSlots[(nSlotsHead + nSlotsCount) % STRESS_SLOTS];
+    TInOptions *po = &ps->Options;
+    int i, n, code;
+
+    memset( po, 0, sizeof(TInOptions) );
+    n = 1 + _stressRandom() % (STRESS_MAX_LINE - 1);
+
+    if( !(_stressRandom() % STRESS_GAP_RATE) ) {
+        po->nMode = IN_GAP;
+        po->nGapChars = STRESS_GAP_END_CHARS;
+        for( i=0; i<n; i++ )
+            ps->sLine[i] = _stressDataByte();
+    }
+    else if( _stressRandom() % 2 ) {
+        po->nMode = IN_COUNT;
+        po->nCount = n;
+        for( i=0; i<n; i++ )
+            ps->sLine[i] = _stressDataByte();
+    }
+    else {
+        po->nMode = IN_DELIMITERS;
+        po->sDelimiters = sDelimiters;
+        po->nDelimiters = sizeof(sDelimiters);
+        for( i=0; i<n-1; i++ ) {
+            do ps->sLine[i] = _stressDataByte(); while( memchr(sDelimiters, ps->sLine[i], sizeof(sDelimiters)) );
+        }
+        ps->sLine[i] = sDelimiters[_stressRandom() % sizeof(sDelimiters)];
+    }
+    if( po->nMode != IN_GAP && _stressRandom() % 2 ) {
+        po->nMode |= IN_GAP;
+        po->nGapChars = STRESS_GAP_CHARS;
+    }
+
+    ps->nLine = n;
+    ++nSlotsCount;
+    code = pBInRequestEx( ps->sBuffer, sizeof(ps->sBuffer), po );
+
+    if( code == PB_ERR_OVERFLOW || code == PB_ERR_UNDEFINED || code > PB_OK ) {
+        if( pBLastRequest(MODE_RX) != REQUEST_NONE )
+            _stressFail( pStat, "last input request is rejected one" );
+        --nSlotsCount;
+        ++pStat->nRxRejected;
+        return;
+    }
+
+    ps->hRequest = pBLastRequest( MODE_RX );
+
+//  the gap is counted by the model line time
+    if( po->nMode == IN_GAP ) {
+        if( _getInItem(nInItems - 1)->nGap != STRESS_GAP_END_CHARS * pBModelLineTime() )
+            _stressFail( pStat, "input gap time" );
+        ++nStressGaps;
+    }
+
+    ++nLines;
+    pBModelPut( ps->sLine, n, 0 );
+}
+
+char _stressDataByte() {
+//
+//  Random byte of a binary frame (XON/XOFF are not data with PB_FLOW_CONTROL).
+//
+    char c;
+
+    do c = (char)_stressRandom();
+#ifdef PB_FLOW_CONTROL
+    while( c == FLOW_XON || c == FLOW_XOFF );
+#else
+    while( 0 );
+#endif
+
+    return c;
+}
+
+#endif
+
+void _stressTick( int n ) {
+//
+//  Advance the model time by *n* ticks, the free peer goes on meanwhile, so
+//  the port is polled every STRESS_FREE_TICKS (an overrun otherwise).
+//
+    int k;
+
+    if( !IsStressFree ) {
+        pBModelTick( n );
+        return;
+    }
+
+    while( n > 0 ) {
+        k = ( n > STRESS_FREE_TICKS ? STRESS_FREE_TICKS : n );
+        pBModelTick( k );
+        n -= k;
+        pBPoll();
+    }
+}
+
+#ifdef PB_FLOW_CONTROL
+
+void _stressPeerFlow() {
+//
+//  The peer stops the driver transmitter (XOFF) and starts it again after
+//  STRESS_PAUSE_STEPS (XON), in the same stream with the lines.
+//
+    char c;
+
+    if( nStressPause ) {
+        if( --nStressPause ) return;
+        c = FLOW_XON;
+    }
+    else if( _stressRandom() % STRESS_PAUSE_RATE )
+        return;
+    else {
+        c = FLOW_XOFF;
+        nStressPause = STRESS_PAUSE_STEPS;
+    }
+
+    pBModelPut( &c, 1, 0 );
+}
+
+#endif
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+int pBStressRun( unsigned int nSeed, int nSteps, int IsIRQ, TStressStat *pStat ) {
+//
+//  Run the stress.
+//  ---------------
+//
+//  Arguments:
+//
+//      nSeed -- random sequence seed
+//
+//      nSteps -- number of random operations
+//
+//      IsIRQ -- 1/0, interrupts or polled mode, 2 - adaptive mode (with
+//               STRESS_FREE_PEER - the free peer)
+//
+//      pStat -- results.
+//
+//  Returns:
+//
+//      Number of failures.
+//
+    TModelStat ModelStat;
+    clock_t t;
+    int n;
+
+    memset( pStat, 0, sizeof(TStressStat) );
+    nStressSeed = nSeed;
+    nExpectedHead = nExpectedTail = 0;
+    nItemsHead = nItemsCount = 0;
+    nSlotsHead = nSlotsCount = nSlotsRemoved = nLines = 0;
+    nOrphansHead = nOrphansCount = nStressGaps = nStressReserved = 0;
+
+    IsStressFree = ( IsIRQ & STRESS_FREE_PEER );
+    IsIRQ &= ~STRESS_FREE_PEER;
+
+#ifdef PB_FLOW_CONTROL
+    nStressPause = 0;
+    pBModelInit( 0, IsStressFree ? MODEL_RX_XONXOFF : MODEL_RX_FLOW | MODEL_RX_XONXOFF );
+    pBInit( IsIRQ ? 1:0, IsIRQ ? 1:0 );
+    pBSetFlow( FLOW_XONXOFF, STRESS_FLOW_HIGH, STRESS_FLOW_LOW );
+    pBGetFlow( 0, 1 );
+#else
+    pBModelInit( 0, IsStressFree ? MODEL_RX_FREE : MODEL_RX_FLOW );
+    pBInit( IsIRQ ? 1:0, IsIRQ ? 1:0 );
+#endif
+
+    nStressPolicy = OVERFLOW_REJECT;
+    pBSetOverflow( nStressPolicy, STRESS_BLOCK_TIMEOUT );
+    pBGetOverflow( 0, 1 );
+
+#ifdef PB_ADAPTIVE_IRQ
+    pBGetAdaptive( 0, 1 );
+    pBSetAdaptive( IsIRQ == 2 ? STRESS_ADAPT_HIGH : -1, STRESS_ADAPT_LOW, STRESS_ADAPT_WINDOW );
+#endif
+
+#ifdef PB_LATENCY
+    for( n=0; n<LATENCY_KINDS; n++ ) {
+        pBGetLatency( 0, n, 0, 1 );
+        pBGetLatency( 1, n, 0, 1 );
+    }
+#endif
+    nPortTimeout = STRESS_PORT_TIMEOUT;
+
+    t = clock();
+
+    for( nStressStep=0; nStressStep<(unsigned long)nSteps && !pStat->nErrors; nStressStep++ ) {
+        switch( _stressRandom() % 12 ) {
+            case 0: _stressPush( pStat, 0 ); break;
+            case 1: _stressPush( pStat, 1 ); break;
+            case 2: _stressInRequest( pStat ); break;
+            case 3:
+            case 4: pBSend(0); break;
+            case 5:
+            case 6: pBReceive(0); break;
+            case 7: pBPoll(); break;
+            case 8: _stressTick( _stressRandom() % 64 ); break;
+            case 9: pBModelInterrupt(); break;
+            case 10: if( !(_stressRandom() % STRESS_POLICY_RATE) ) _stressOverflow(); break;
+            case 11: if( !(_stressRandom() % STRESS_CANCEL_RATE) ) _stressCancel( pStat ); break;
+        }
+#ifdef PB_FLOW_CONTROL
+        _stressPeerFlow();
+#endif
+        _stressCheck( pStat );
+    }
+    pStat->nSteps = nStressStep;
+
+#ifdef PB_FLOW_CONTROL
+//  the transmitter goes
+    if( nStressPause ) {
+        nStressPause = 1;
+        _stressPeerFlow();
+    }
+#endif
+
+//  flush the queues
+    for( n=0; n<STRESS_DRAIN_STEPS && !pStat->nErrors; n++ ) {
+        if( !nOutItems && !nInItems && nExpectedHead == nExpectedTail && !nSlotsCount )
+            break;
+        pBSend(0);
+        pBReceive(0);
+        pBModelTick(1);
+        _stressCheck( pStat );
+    }
+
+    if( n == STRESS_DRAIN_STEPS )
+        _stressFail( pStat, "queues are not flushed" );
+    else if( nItemsCount )
+        _stressFail( pStat, "output items not accounted for" );
+
+    pStat->nSeconds = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+    pBModelStat( &ModelStat );
+    pStat->nTicks = ModelStat.nTime;
+    pStat->nInterrupts = ModelStat.nInterrupts;
+    pStat->nRxOverruns = ModelStat.nRxOverruns;
+
+#ifdef PB_FLOW_CONTROL
+//  the flow control holds every byte of the free peer
+    if( pStat->nRxOverruns )
+        _stressFail( pStat, "peer bytes overrun" );
+#endif
+
+    pBTerm();
+
+    return pStat->nErrors;
+}
+
+void pBStressPrint( TStressStat *pStat ) {
+//
+//  Print run results.
+//
+    double nBytes = (double)(pStat->nTxBytes + pStat->nRxBytes);
+
+#ifdef PB_LATENCY
+    static char *sLatency[LATENCY_KINDS] = { "TX wait", "TX done", "RX wait", "RX done" };
+    TLatency Latency;
+    int i, n;
+#endif
+#ifdef PB_ADAPTIVE_IRQ
+    TAdaptStat Adapt;
+#endif
+#ifdef PB_FLOW_CONTROL
+    TFlowStat Flow;
+#endif
+    TOverflowStat Overflow;
+
+    printf( "--> PORT -B- STRESS:\n" );
+    printf( "    steps:          %lu\n", pStat->nSteps );
+    printf( "    output items:   %lu (%lu bytes, %lu rejected, %lu removed, %lu reserved)\n", pStat->nTxItems,
+        pStat->nTxBytes, pStat->nTxRejected, pStat->nTxRemoved, pStat->nTxReserved );
+    printf( "    input items:    %lu (%lu bytes, %lu rejected, %lu removed, %lu gap ended)\n", pStat->nRxItems,
+        pStat->nRxBytes, pStat->nRxRejected, pStat->nRxRemoved, pStat->nRxGaps );
+    pBGetOverflow( &Overflow, 0 );
+    printf( "    overflow:       %lu dropped, %lu rejected, %lu blocked\n",
+        Overflow.nDroppedItems, Overflow.nRejectedItems, Overflow.nBlocked );
+    printf( "    interrupts:     %lu (%lu overruns)\n", pStat->nInterrupts, pStat->nRxOverruns );
+    printf( "    model ticks:    %lu (%.2f bytes per 1000 ticks)\n", pStat->nTicks,
+        pStat->nTicks ? nBytes * 1000. / pStat->nTicks : 0. );
+    printf( "    host time:      %.3f s (%.0f bytes/s)\n", pStat->nSeconds,
+        pStat->nSeconds > 0. ? nBytes / pStat->nSeconds : 0. );
+#ifdef PB_ADAPTIVE_IRQ
+    pBGetAdaptive( &Adapt, 0 );
+    if( Adapt.nWindows )
+        printf( "    adaptive:       %lu to polled, %lu to IRQ, %lu windows, %lu polled bytes\n",
+            Adapt.nToPolled, Adapt.nToIRQ, Adapt.nWindows, Adapt.nPolledBytes );
+#endif
+#ifdef PB_FLOW_CONTROL
+    pBGetFlow( &Flow, 0 );
+    printf( "    flow control:   %lu/%lu XOFF/XON sent, %lu/%lu taken, %lu pauses, %d max held\n",
+        Flow.nXoffSent, Flow.nXonSent, Flow.nXoffTaken, Flow.nXonTaken, Flow.nPauses, Flow.nMaxHeld );
+#endif
+    printf( "    failures:       %lu", pStat->nErrors );
+    if( pStat->nErrors ) printf( " (first at step %lu)", pStat->nFirstError );
+    printf( "\n" );
+
+#ifdef PB_LATENCY
+    for( i=0; i<2*LATENCY_KINDS; i++ ) {
+        if( !pBGetLatency( i / LATENCY_KINDS, i % LATENCY_KINDS, &Latency, 0 ) )
+            continue;
+        printf( "    latency %s %-8s %lu requests, %lu..%lu ticks:", i < LATENCY_KINDS ? "polled":"IRQ",
+            sLatency[i % LATENCY_KINDS], Latency.nCount, Latency.nMin, Latency.nMax );
+        for( n=0; n<LATENCY_BUCKETS; n++ )
+            if( Latency.aBuckets[n] ) printf( " %d:%lu", n, Latency.aBuckets[n] );
+        printf( "\n" );
+    }
+#endif
+}
+
+#ifdef PB_STRESS_MAIN
+
+int main( int argc, char **argv ) {
+    TStressStat Stat;
+    unsigned int nSeed = 1;
+    int nSteps = 100000, IsIRQ = -1, nErrors = 0;
+#ifdef PB_REGISTER_TRACE
+    int nSize;
+#endif
+
+    if( argc > 1 ) nSeed = (unsigned int)atoi(argv[1]);
+    if( argc > 2 ) nSteps = atoi(argv[2]);
+    if( argc > 3 ) IsIRQ = atoi(argv[3]);
+
+#ifdef PB_REGISTER_TRACE
+    if( argc > 4 ) pBTraceStart( malloc(STRESS_TRACE_SIZE), STRESS_TRACE_SIZE );
+#endif
+
+    if( IsIRQ <= 0 ) {
+        printf( "*** polled mode, seed %u\n", nSeed );
+        nErrors += pBStressRun( nSeed, nSteps, 0, &Stat );
+        pBStressPrint( &Stat );
+    }
+    if( IsIRQ < 0 || IsIRQ == 1 ) {
+        printf( "*** IRQ mode, seed %u\n", nSeed );
+        nErrors += pBStressRun( nSeed, nSteps, 1, &Stat );
+        pBStressPrint( &Stat );
+    }
+#ifdef PB_ADAPTIVE_IRQ
+    if( IsIRQ < 0 || IsIRQ == 2 ) {
+        printf( "*** adaptive mode, seed %u\n", nSeed );
+        nErrors += pBStressRun( nSeed, nSteps, 2, &Stat );
+        pBStressPrint( &Stat );
+    }
+#endif
+#ifdef PB_FLOW_CONTROL
+    if( IsIRQ < 0 || IsIRQ == STRESS_FREE_PEER ) {
+        printf( "*** polled mode, free peer, seed %u\n", nSeed );
+        nErrors += pBStressRun( nSeed, nSteps, STRESS_FREE_PEER, &Stat );
+        pBStressPrint( &Stat );
+    }
+    if( IsIRQ < 0 || IsIRQ == (STRESS_FREE_PEER | 1) ) {
+        printf( "*** IRQ mode, free peer, seed %u\n", nSeed );
+        nErrors += pBStressRun( nSeed, nSteps, STRESS_FREE_PEER | 1, &Stat );
+        pBStressPrint( &Stat );
+    }
+#endif
+
+#ifdef PB_REGISTER_TRACE
+    if( argc > 4 ) {
+        nSize = pBTraceStop();
+        printf( "--> TRACE: %s, %d bytes%s\n", argv[4], nSize, pBTraceSave(argv[4]) ? "" : " (not saved)" );
+    }
+#endif
+
+    return (nErrors ? 1:0);
+}
+
+#endif
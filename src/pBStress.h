@@ -0,0 +1,99 @@
+#
+/*******************************************************************************
+ *  Port -B- Controller Stress Harness header file
+ *  ----------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBSTRESS__
+#define __PBSTRESS__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define STRESS_MAX_ITEM          200      // max output item size (random)
+#define STRESS_LONG_ITEM         1028     // long lines are 8 sizes below it (PB_LIGHT_FORMAT, cut to the item size)
+#define STRESS_LONG_RATE         64       // long line (max size item) once per items (random)
+#define STRESS_RESERVE_RATE      16       // an item is pushed by a reservation once per items (random)
+#define STRESS_MAX_LINE          40       // max input line size (random)
+#define STRESS_LINE_SIZE         64       // input request buffer size
+#define STRESS_SLOTS             16       // input request buffers
+#define STRESS_EXPECTED_SIZE     0x100000 // expected output stream buffer
+#define STRESS_PORT_TIMEOUT      256      // ready state waiting timeout (no IRQ)
+#define STRESS_DRAIN_STEPS       1000000  // max steps to flush the queues at the end
+#define STRESS_TRACE_SIZE       0x4000000 // trace memory (PB_REGISTER_TRACE)
+#define STRESS_ADAPT_HIGH        8        // adaptive mode thresholds (PB_ADAPTIVE_IRQ, model ticks)
+#define STRESS_ADAPT_LOW         1
+#define STRESS_ADAPT_WINDOW      512
+#define STRESS_GAP_CHARS         10000    // inter-byte gap of binary requests (PB_RX_MODES, not reached)
+#define STRESS_GAP_END_CHARS     4        // gap of frames ended by it (the peer pauses after the frame)
+#define STRESS_GAP_RATE          4        // a frame is ended by the gap once per frames (random)
+#define STRESS_FLOW_HIGH         8        // held bytes to stop the peer (PB_FLOW_CONTROL)
+#define STRESS_FLOW_LOW          2        // held bytes to start it
+#define STRESS_PAUSE_RATE        64       // the peer stops the driver transmitter once per steps (random)
+#define STRESS_PAUSE_STEPS       32       // steps up to the peer starts it again
+#define STRESS_ITEMS             4096     // output items on the way to the peer
+#define STRESS_POLICY_RATE       256      // overflow policy is switched once per steps (random)
+#define STRESS_BLOCK_TIMEOUT     2000     // OVERFLOW_BLOCK waiting timeout
+#define STRESS_CANCEL_RATE       16       // a request is cancelled once per steps (random)
+#define STRESS_FLUSH_RATE        64       // a queue is flushed once per cancels (random)
+#define STRESS_FREE_PEER         0x04     // run mode flag: the peer sends at line speed (MODEL_RX_FREE)
+#define STRESS_FREE_TICKS        8        // model ticks between *pBPoll* calls with the free peer
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef struct {                          // stress run results
+    unsigned long nSteps;                 // random operations done
+    unsigned long nTxItems;               // output items accepted by the queue
+    unsigned long nTxBytes;               // output bytes verified at the peer
+    unsigned long nTxRejected;            // output items rejected (overflow)
+    unsigned long nTxRemoved;             // output items removed from the queue (never sent)
+    unsigned long nTxReserved;            // output items pushed by a reservation
+    unsigned long nRxItems;               // input requests verified
+    unsigned long nRxBytes;               // input bytes verified
+    unsigned long nRxRejected;            // input requests rejected (overflow)
+    unsigned long nRxRemoved;             // input requests removed from the queue
+    unsigned long nRxGaps;                // binary frames ended by the gap (PB_RX_MODES)
+    unsigned long nErrors;                // integrity and invariants failures
+    unsigned long nFirstError;            // step of the first failure
+    unsigned long nTicks;                 // model time (ticks)
+    unsigned long nInterrupts;            // ISR calls
+    unsigned long nRxOverruns;            // peer bytes overwritten in *RXD* before read
+    double        nSeconds;               // host time
+} TStressStat;
+//
+//  Private --------------------------------------------------------------------
+//
+unsigned int _stressRandom( void );
+void  _stressFail         ( TStressStat *, char * );
+void  _stressCheck        ( TStressStat * );
+void  _stressPush         ( TStressStat *, int );
+void  _stressSnapItems    ( void );
+void  _stressRemoveItems  ( TStressStat *, int, int );
+void  _stressSkipRemoved  ( void );
+void  _stressOverflow     ( void );
+void  _stressCancel       ( TStressStat * );
+void  _stressCancelOut    ( TStressStat * );
+void  _stressCancelIn     ( TStressStat * );
+void  _stressFlushIn      ( TStressStat * );
+int   _stressIsTextFrom   ( int );
+void  _stressRemoveSlot   ( int );
+void  _stressSkipSlots    ( void );
+void  _stressInRequest    ( TStressStat * );
+void  _stressInFrame      ( TStressStat * );
+char  _stressDataByte      ( void );
+void  _stressTick         ( int );
+void  _stressPeerFlow     ( void );
+//
+//  Public (client interface) --------------------------------------------------
+//
+int   pBStressRun         ( unsigned int, int, int, TStressStat * );
+void  pBStressPrint       ( TStressStat * );
+
+#endif
@@ -0,0 +1,278 @@
+#
+/*******************************************************************************
+ *  Port -B- String Helpers (word-at-a-time) implementation
+ *  -------------------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Word-at-a-time (SWAR) variants of '..\common' string helpers used by the
+ *  port queues. Strings are scanned by aligned machine words (4 bytes on
+ *  MIPS32, 8 bytes on the host build), a zero byte in the word is detected
+ *  without a loop (WORD_HAS_ZERO). Words are loaded and stored by *memcpy*
+ *  of WORD_SIZE (WORD_LOAD/WORD_STORE): the compiler makes it a single
+ *  access and the char data isn't read through a *TWord* pointer (strict
+ *  aliasing, inlined or LTO builds). Aligned loads never cross a page, so
+ *  reading the rest of the word after the terminator is safe on the board.
+ *  Unaligned heads and tails are done bytewise.
+ *
+ *  The driver takes them instead of the common ones with PB_SWAR_STRINGS
+ *  (see pBController.h).
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    wstrsize(s) - returns size of string *s* (without terminator)
+ *
+ *    wstrpush(p, s) - copies *s* with the terminator into *p*, returns the
+ *      position after the terminator
+ *
+ *    wstrpop(p) - returns beginning of the string ended just before *p*
+ *
+ *    wstrshift(d, s, e) - moves block from *s* up to *e* down to *d*
+ *
+ *    wstradd(d, s) - appends *s* to *d*
+ *
+ *    wendswith(s, t) - returns 1/0, string *s* ends with *t* or not
+ *
+ *    pBStringBench(nRounds) - prints timing of the common helpers and word
+ *      variants on a queue like data (PB_STRING_BENCH_MAIN makes *main*).
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "..\config.h"
+
+#include "pBString.h"
+
+#include "..\common\pBCommon.h"
+
+// *****************************************************************************
+//  WORD-AT-A-TIME HELPERS (PUBLIC)
+// *****************************************************************************
+
+int wstrsize( char *s ) {
+//
+//  Get string size.
+//  ----------------
+//
+    char *p = s;
+    TWord w;
+
+//  head, up to the word boundary
+    for( ; !WORD_ALIGNED(p); p++ )
+        if( !*p ) return (int)(p - s);
+
+//  words, up to one with the terminator
+    for( ; WORD_LOAD(w, p), !WORD_HAS_ZERO(w); p += WORD_SIZE ) ;
+
+//  tail, the terminator inside of the word
+    for( ; *p; p++ ) ;
+
+    return (int)(p - s);
+}
+
+char *wstrpush( char *p, char *s ) {
+//
+//  Copy string with the terminator.
+//  --------------------------------
+//
+//  Returns:
+//
+//      Position after the terminator.
+//
+    TWord w;
+    int n;
+
+    if( ((unsigned long)p & WORD_MASK) != ((unsigned long)s & WORD_MASK) ) {
+    //  different alignment: size by words, then block copy
+        n = wstrsize(s) + 1;
+        memcpy( p, s, n );
+        return p + n;
+    }
+
+//  head, up to the word boundary
+    for( ; !WORD_ALIGNED(s); p++, s++ )
+        if( !(*p = *s) ) return p + 1;
+
+//  words, up to one with the terminator
+    for( ; WORD_LOAD(w, s), !WORD_HAS_ZERO(w); p += WORD_SIZE, s += WORD_SIZE )
+        WORD_STORE(p, w);
+
+//  tail
+    for( ; (*p = *s); p++, s++ ) ;
+
+    return p + 1;
+}
+
+char *wstrpop( char *p ) {
+//
+//  Get beginning of the string ended before *p* (*p* is after its terminator).
+//  ---------------------------------------------------------------------------
+//
+    TWord w;
+
+//  skip the terminator
+    --p;
+
+//  head, down to the word boundary
+    for( ; !WORD_ALIGNED(p); p-- )
+        if( !p[-1] ) return p;
+
+//  words, down to one with the previous terminator
+    for( ; WORD_LOAD(w, p - WORD_SIZE), !WORD_HAS_ZERO(w); p -= WORD_SIZE ) ;
+
+//  tail
+    for( ; p[-1]; p-- ) ;
+
+    return p;
+}
+
+void wstrshift( char *d, char *s, char *e ) {
+//
+//  Move block [s, e) down to *d* (d < s, blocks may overlap).
+//  ----------------------------------------------------------
+//
+    TWord w;
+
+    if( ((unsigned long)d & WORD_MASK) != ((unsigned long)s & WORD_MASK) ) {
+    //  different alignment, library move does it by words with shifts
+        memmove( d, s, e - s );
+        return;
+    }
+
+    for( ; !WORD_ALIGNED(s) && s < e; ) *d++ = *s++;
+
+//  ascending copy is safe for overlapped blocks when d < s
+    for( ; s + WORD_SIZE <= e; d += WORD_SIZE, s += WORD_SIZE ) {
+        WORD_LOAD(w, s);
+        WORD_STORE(d, w);
+    }
+
+    for( ; s < e; ) *d++ = *s++;
+}
+
+void wstradd( char *d, char *s ) {
+    wstrpush( d + wstrsize(d), s );
+}
+
+int wendswith( char *s, char *t ) {
+//
+//  Check string ends with the suffix.
+//
+    int n = wstrsize(s), m = wstrsize(t);
+
+    return ( n >= m && !memcmp(s + n - m, t, m) ) ? 1:0;
+}
+
+// *****************************************************************************
+//  MICROBENCHMARK
+// *****************************************************************************
+
+char  aBenchQueue[BENCH_QUEUE_SIZE + 2*sizeof(TWord)];
+char  aBenchShift[BENCH_QUEUE_SIZE + 2*sizeof(TWord)];
+
+double _benchSeconds( clock_t t ) {
+    return (double)(clock() - t) / CLOCKS_PER_SEC;
+}
+
+void pBStringBench( int nRounds ) {
+//
+//  Compare the common helpers with word variants.
+//  ----------------------------------------------
+//  The queue is filled with items of 1..120 bytes (as *pBPush* does), every
+//  helper walks all of them *nRounds* times.
+//
+//  Arguments:
+//
+//      nRounds -- rounds number (0 - default).
+//
+    char *pItems[BENCH_QUEUE_SIZE / 4];
+    char sItem[128 + 4], *p, *e;
+    clock_t t;
+    double t1, t2;
+    unsigned long sum1 = 0, sum2 = 0;
+    int i, n, r, nItems = 0;
+
+    if( nRounds <= 0 ) nRounds = BENCH_ROUNDS;
+
+//  make the queue
+    srand( 1 );
+    for( p = aBenchQueue; ; ) {
+        n = 1 + rand() % 120;
+        for( i=0; i<n; i++ ) sItem[i] = 'A' + rand() % 26;
+        strcpy( sItem + n, "\n\r" );
+        if( p + n + 3 > aBenchQueue + BENCH_QUEUE_SIZE ) break;
+        pItems[nItems++] = p;
+        p = wstrpush( p, sItem );
+    }
+    e = p;
+
+    printf( "--> STRING HELPERS BENCHMARK (%d items, %d bytes, %d rounds, %d bytes word):\n",
+        nItems, (int)(e - aBenchQueue), nRounds, (int)sizeof(TWord) );
+
+//  strsize
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=0; i<nItems; i++ ) sum1 += strsize( pItems[i] );
+    t1 = _benchSeconds( t );
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=0; i<nItems; i++ ) sum2 += wstrsize( pItems[i] );
+    t2 = _benchSeconds( t );
+    printf( "    strsize:   %8.3f s, wstrsize:   %8.3f s (x%.2f)%s\n", t1, t2, t2 > 0. ? t1/t2 : 0., sum1 != sum2 ? " MISMATCH":"" );
+
+//  strpush (the queue is rebuilt)
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=0, p=aBenchShift; i<nItems; i++ ) p = strpush( p, pItems[i] );
+    t1 = _benchSeconds( t );
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=0, p=aBenchShift; i<nItems; i++ ) p = wstrpush( p, pItems[i] );
+    t2 = _benchSeconds( t );
+    printf( "    strpush:   %8.3f s, wstrpush:   %8.3f s (x%.2f)%s\n", t1, t2, t2 > 0. ? t1/t2 : 0.,
+        memcmp(aBenchShift, aBenchQueue, e - aBenchQueue) ? " MISMATCH":"" );
+
+//  strpop (the queue is walked back)
+    sum1 = sum2 = 0;
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=1, p=e; i<nItems; i++ ) { p = strpop( p ); sum1 += p - aBenchQueue; }
+    t1 = _benchSeconds( t );
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=1, p=e; i<nItems; i++ ) { p = wstrpop( p ); sum2 += p - aBenchQueue; }
+    t2 = _benchSeconds( t );
+    printf( "    strpop:    %8.3f s, wstrpop:    %8.3f s (x%.2f)%s\n", t1, t2, t2 > 0. ? t1/t2 : 0., sum1 != sum2 ? " MISMATCH":"" );
+
+//  strshift (*pop* off the first item of the whole queue)
+    n = (int)(pItems[1] - pItems[0]);
+    t = clock();
+    for( r=0; r<nRounds; r++ ) strshift( aBenchShift, aBenchQueue + n, e );
+    t1 = _benchSeconds( t );
+    t = clock();
+    for( r=0; r<nRounds; r++ ) wstrshift( aBenchShift, aBenchQueue + n, e );
+    t2 = _benchSeconds( t );
+    printf( "    strshift:  %8.3f s, wstrshift:  %8.3f s (x%.2f)%s\n", t1, t2, t2 > 0. ? t1/t2 : 0.,
+        memcmp(aBenchShift, aBenchQueue + n, e - aBenchQueue - n) ? " MISMATCH":"" );
+
+//  endswith
+    sum1 = sum2 = 0;
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=0; i<nItems; i++ ) sum1 += endswith( pItems[i], "\n\r" );
+    t1 = _benchSeconds( t );
+    t = clock();
+    for( r=0; r<nRounds; r++ ) for( i=0; i<nItems; i++ ) sum2 += wendswith( pItems[i], "\n\r" );
+    t2 = _benchSeconds( t );
+    printf( "    endswith:  %8.3f s, wendswith:  %8.3f s (x%.2f)%s\n", t1, t2, t2 > 0. ? t1/t2 : 0., sum1 != sum2 ? " MISMATCH":"" );
+}
+
+#ifdef PB_STRING_BENCH_MAIN
+
+int main( int argc, char **argv ) {
+    pBStringBench( argc > 1 ? atoi(argv[1]) : 0 );
+    return 0;
+}
+
+#endif
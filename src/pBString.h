@@ -0,0 +1,58 @@
+#
+/*******************************************************************************
+ *  Port -B- String Helpers (word-at-a-time) header file
+ *  ----------------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBSTRING__
+#define __PBSTRING__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+typedef unsigned long TWord;              // machine word (4 bytes MIPS32, 8 bytes LP64 host)
+
+#define WORD_SIZE                sizeof(TWord)
+#define WORD_MASK                (WORD_SIZE - 1)
+#define WORD_ONES                ((TWord)-1 / 0xFF)        // 0x01010101...
+#define WORD_HIGHS               (WORD_ONES * 0x80)        // 0x80808080...
+                                          // a zero byte is in the word
+#define WORD_HAS_ZERO(w)         ( ((w) - WORD_ONES) & ~(w) & WORD_HIGHS )
+#define WORD_ALIGNED(p)          ( !((unsigned long)(p) & WORD_MASK) )
+                                          // word access of char data (no aliasing,
+                                          // a single load/store by the compiler)
+#define WORD_LOAD(w,p)           memcpy( &(w), (p), WORD_SIZE )
+#define WORD_STORE(p,w)          memcpy( (p), &(w), WORD_SIZE )
+
+#define BENCH_QUEUE_SIZE         10*1024  // benchmark queue (bytes)
+#define BENCH_ROUNDS             2000     // default benchmark rounds
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+//
+//  Public (client interface) --------------------------------------------------
+//
+int   wstrsize            ( char * );           // string size (strlen)
+char *wstrpush            ( char *, char * );   // copy string with terminator, returns next
+char *wstrpop             ( char * );           // the previous string beginning
+void  wstrshift           ( char *, char *, char * ); // shift block down
+void  wstradd             ( char *, char * );   // concatenate
+int   wendswith           ( char *, char * );   // string ends with the suffix
+void  pBStringBench       ( int );              // helpers microbenchmark
+//
+//  External -------------------------------------------------------------------
+//
+int   endswith            ( char *, char * );
+void  stradd              ( char *, char * );
+char *strpop              ( char * );
+char *strpush             ( char *, char * );
+void  strshift            ( char *, char *, char * );
+int   strsize             ( char * );
+
+#endif
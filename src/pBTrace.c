@@ -0,0 +1,814 @@
+#
+/*******************************************************************************
+ *  Port -B- Registers Trace (record and replay) implementation
+ *  -----------------------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  Brief description:
+ *
+ *  Field workloads (overruns at some traffic mix, stalls in *IsTXPortReady*)
+ *  are recorded on the board and rerun on the host exactly.
+ *
+ *  Recording (PB_REGISTER_TRACE, board or host model build): PB_READ/PB_WRITE
+ *  go through the trace hooks, every register access is kept as a 4 bytes
+ *  record (kind and register, value, cycles since the previous record) in
+ *  the trace memory. The driver adds the events needed to rerun it: client
+ *  calls with their arguments and pushed data, *nPortTimeout* changes, and
+ *  interrupts at the points the driver takes them (*isr_pb* trigger with
+ *  *isr_pb_state*). Recording stops when the memory is over
+ *  (TRACE_TRUNCATED), so it should be started before *pBInit*.
+ *
+ *  The trace memory is an image (TTraceHeader and records), it can be dumped
+ *  from the board memory as is or saved by *pBTraceSave*. Image of another
+ *  byte order (big endian board) is converted by *pBTraceLoad*.
+ *
+ *  Replay (PB_REGISTER_REPLAY, host build without the model): the recorded
+ *  client calls are made again with the same arguments, register reads
+ *  return the recorded values, writes are checked against the trace, and
+ *  interrupts are raised where the driver took them. *_getCycles* returns
+ *  the recorded time, so latency statistics (PB_LATENCY) are the field ones,
+ *  and the host time of the driver is measured on the field workload.
+ *  Accesses the trace doesn't expect (the driver went another way) are
+ *  counted as misses, reads return the last value of the register.
+ *
+ *  Not replayed: deferred requests (*pBDeferRequest* keeps arguments, not
+ *  the text), queues memory of *pBInitEx* (defaults are used), direct
+ *  register accesses of the application. Delimiters sets of binary input
+ *  requests (PB_RX_MODES) are replayed up to REPLAY_DELIMITERS.
+ *
+ *  Public interface (client side functions):
+ *  ----------------------------------------
+ *
+ *    pBTraceStart(pMemory, nSize) - starts recording into *pMemory* of
+ *      *nSize* bytes (null - static TRACE_SIZE memory)
+ *
+ *    pBTraceStop() - stops recording, returns the image size (bytes)
+ *
+ *    pBTraceImage(pSize) - returns the image and its size
+ *
+ *    pBTraceSave(sFile), pBTraceLoad(sFile, pSize) - image file (host)
+ *
+ *    pBReplayRun(pImage, pStat) - replays the image through the driver,
+ *      returns 1/0 (the driver went the recorded way or not)
+ *
+ *    pBReplayTime() - replay time (recorded cycles)
+ *
+ *    pBReplayCharTime() - recorded character time at 115200 (the clock of
+ *      the recorder, model ticks on the host), the gap of binary input
+ *      requests is taken by it.
+ *
+ *  Assembly (host replay): pBTrace.c pBController.c with PB_REGISTER_REPLAY
+ *  and PB_TRACE_REPLAY_MAIN (*main*: pbreplay file [rounds]), the same
+ *  queue variants and features as the recorded driver.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "..\config.h"
+
+#define PB_PORT_INTERNALS               // hot state names (PB_HOT_STATE)
+#include "pBController.h"
+#include "pBTrace.h"
+
+#include "..\common\pBCommon.h"
+
+// -----------------------------------------------------------------------------
+//  Declarations
+// -----------------------------------------------------------------------------
+extern unsigned char *BaseAddress;      // registers area base pointer
+extern unsigned char isr_pb_state;      // port interrupt reason (*ISR_PB*)
+#ifndef PB_HOT_STATE
+extern int   nPortTimeout;              // ready state waiting timeout (no IRQ)
+#endif
+extern unsigned long nInSeq;            // input items pushed
+extern unsigned long nOutSeq;           // output items pushed
+
+                                        // static trace memory (aligned)
+unsigned long aTraceMemory[TRACE_SIZE / sizeof(unsigned long)];
+
+TTraceHeader *pTrace = 0;               // recorded image
+TTraceRecord *pTraceNext, *pTraceEnd;   // free records
+unsigned long nTraceTime;               // time of the last record (cycles)
+long  nTraceTimeout;                    // the last recorded *nPortTimeout*
+int   IsTraceOn = 0;
+
+#ifdef PB_REGISTER_REPLAY
+int   isr_pb;                           // port interrupt trigger (ISR)
+
+TReplayStat *pReplayStat;               // replay results
+TTraceRecord *pReplay, *pReplayEnd;     // the current record, the end
+TTraceRecord *pReplayDelivered;         // the last interrupt raised
+unsigned long nReplayTime;              // recorded time of the current record
+unsigned long nReplayCharTime;          // recorded character time (cycles, IN_GAP)
+
+unsigned char aReplayShadow[TRACE_REGISTERS]; // the last values of registers
+char  sReplayItem[REPLAY_LINE_SIZE + SIZE_OFFSET + 1]; // pushed data (parts)
+TOutPart aReplayParts[REPLAY_PARTS];
+char  aReplayInputs[REPLAY_INPUTS][REPLAY_LINE_SIZE]; // input request buffers
+TInOptions aReplayOptions[REPLAY_INPUTS]; // input request options (PB_RX_MODES)
+char  aReplayDelimiters[REPLAY_INPUTS][REPLAY_DELIMITERS];
+int   nReplayInput;
+#endif
+
+#define SWAP16(v)                ( (unsigned short)( ((v) >> 8 & 0xFF) | ((v) << 8 & 0xFF00) ) )
+#define SWAP32(v)                ( ((v) >> 24 & 0xFF) | ((v) >> 8 & 0xFF00) | ((v) << 8 & 0xFF0000) | ((v) << 24 & 0xFF000000) )
+
+// *****************************************************************************
+//  RECORDING (PRIVATE)
+// *****************************************************************************
+
+int _traceRoom( int n ) {
+//
+//  Check the trace memory has *n* records free (recording stops if not).
+//
+    if( !IsTraceOn )
+        return 0;
+    if( pTraceEnd - pTraceNext >= n )
+        return 1;
+
+    IsTraceOn = 0;
+    pTrace->nFlags |= TRACE_TRUNCATED;
+    return 0;
+}
+
+void _traceTimed( int nOp, int Value ) {
+//
+//  Put a record with the time since the previous one (TRACE_TIME is put
+//  before it if the delta doesn't fit into 16 bits).
+//
+    unsigned long t = _getCycles();
+    unsigned long d = t - nTraceTime;
+
+    nTraceTime = t;
+
+    if( d > 0xFFFF ) {
+        pTraceNext->nOp = TRACE_EVENT | TRACE_TIME;
+        pTraceNext->Value = 0;
+        pTraceNext->nDelta = (unsigned short)( (d >> 16) > 0xFFFF ? 0xFFFF : (d >> 16) );
+        ++pTraceNext;
+        d &= 0xFFFF;
+    }
+
+    pTraceNext->nOp = (unsigned char)nOp;
+    pTraceNext->Value = (unsigned char)Value;
+    pTraceNext->nDelta = (unsigned short)d;
+    ++pTraceNext;
+}
+
+void _traceUntimed( int nOp, int Value, unsigned int nData ) {
+    pTraceNext->nOp = (unsigned char)nOp;
+    pTraceNext->Value = (unsigned char)Value;
+    pTraceNext->nDelta = (unsigned short)nData;
+    ++pTraceNext;
+}
+
+#ifndef PB_REGISTER_REPLAY
+
+// *****************************************************************************
+//  DRIVER HOOKS, RECORDING (PUBLIC)
+// *****************************************************************************
+
+unsigned char pBTraceRead( int Register ) {
+    unsigned char Value = PB_RAW_READ(Register);
+
+    if( _traceRoom(2) )
+        _traceTimed( TRACE_READ | (Register & (TRACE_REGISTERS-1)), Value );
+
+    return Value;
+}
+
+void pBTraceWrite( int Register, unsigned char Value ) {
+    PB_RAW_WRITE(Register, Value);
+
+    if( _traceRoom(2) )
+        _traceTimed( TRACE_WRITE | (Register & (TRACE_REGISTERS-1)), Value );
+}
+
+void pBTraceCall( int nCall, int Value ) {
+//
+//  Client call (entry of the driver function), *nPortTimeout* is recorded
+//  when it's changed.
+//
+    long n = ( nPortTimeout > 0xFFFFFF ? 0xFFFFFF : nPortTimeout );
+
+    if( !_traceRoom(3) )
+        return;
+
+    if( n != nTraceTimeout ) {
+        nTraceTimeout = n;
+        _traceUntimed( TRACE_EVENT | TRACE_TIMEOUT, (int)(n >> 16), (unsigned int)(n & 0xFFFF) );
+    }
+
+    _traceTimed( TRACE_EVENT | nCall, Value );
+}
+
+void pBTraceArg( unsigned long nArg ) {
+    if( !_traceRoom(2) )
+        return;
+
+    _traceUntimed( TRACE_EVENT | TRACE_ARG, 0, (unsigned int)(nArg >> 16 & 0xFFFF) );
+    _traceUntimed( TRACE_EVENT | TRACE_ARG, 0, (unsigned int)(nArg & 0xFFFF) );
+}
+
+void pBTraceItem( char *pData, int nSize ) {
+//
+//  Pushed data (the bytes follow by 4 in raw records).
+//
+    int nRecords;
+
+    if( nSize < 0 ) nSize = strsize(pData);
+    if( nSize > 0xFFFF ) nSize = 0xFFFF;
+
+    nRecords = (nSize + sizeof(TTraceRecord) - 1) / sizeof(TTraceRecord);
+
+    if( !_traceRoom(1 + nRecords) )
+        return;
+
+    _traceUntimed( TRACE_EVENT | TRACE_ITEM, 0, nSize );
+
+    if( nRecords ) {
+        memset( pTraceNext + nRecords - 1, 0, sizeof(TTraceRecord) );
+        memcpy( pTraceNext, pData, nSize );
+        pTraceNext += nRecords;
+    }
+}
+
+void pBTraceIRQ( unsigned char State ) {
+    if( _traceRoom(2) )
+        _traceTimed( TRACE_IRQ, State );
+}
+
+#else
+
+// *****************************************************************************
+//  REPLAY (PRIVATE)
+// *****************************************************************************
+
+TTraceRecord *_replayCurrent() {
+//
+//  Get the current record.
+//  -----------------------
+//  Time extensions are taken, interrupt is raised when its record comes
+//  (the driver takes it at the same point as it was recorded).
+//
+//  Returns:
+//
+//      The record or NULL (the end of trace).
+//
+    while( pReplay < pReplayEnd && pReplay->nOp == (TRACE_EVENT | TRACE_TIME) ) {
+        nReplayTime += (unsigned long)pReplay->nDelta << 16;
+        ++pReplay;
+    }
+
+    if( pReplay >= pReplayEnd )
+        return 0;
+
+    if( TRACE_KIND(pReplay->nOp) == TRACE_IRQ && pReplay != pReplayDelivered ) {
+        pReplayDelivered = pReplay;
+        isr_pb_state = pReplay->Value;
+        isr_pb = 1;
+        ++pReplayStat->nInterrupts;
+    }
+
+    return pReplay;
+}
+
+void _replayAdvance() {
+//
+//  Take the current record (and raw records of an item).
+//
+    TTraceRecord *pr = pReplay;
+
+    if( TRACE_KIND(pr->nOp) != TRACE_EVENT || TRACE_CODE(pr->nOp) >= TRACE_CALL_INIT )
+        nReplayTime += pr->nDelta;
+
+    ++pReplay;
+    if( pr->nOp == (TRACE_EVENT | TRACE_ITEM) )
+        pReplay += (pr->nDelta + sizeof(TTraceRecord) - 1) / sizeof(TTraceRecord);
+    if( pReplay > pReplayEnd )
+        pReplay = pReplayEnd;
+
+    _replayCurrent();
+}
+
+void _replayMiss() {
+    ++pReplayStat->nMisses;
+}
+
+unsigned long _replayArg( TTraceRecord *pr ) {
+//
+//  Get call argument (two TRACE_ARG records after the call record).
+//
+    if( pr + 2 >= pReplayEnd || pr[1].nOp != (TRACE_EVENT | TRACE_ARG) || pr[2].nOp != (TRACE_EVENT | TRACE_ARG) )
+        return 0;
+
+    return ((unsigned long)pr[1].nDelta << 16) | pr[2].nDelta;
+}
+
+int _replayItem() {
+//
+//  Get data pushed by the current call.
+//  ------------------------------------
+//  Data records follow the push call (*pBPush* inside of *pBOutRequest*),
+//  they are copied into *sReplayItem* as parts (*aReplayParts*), every part
+//  is terminated.
+//
+//  Returns:
+//
+//      Number of parts.
+//
+    TTraceRecord *pr = pReplay;
+    char *p = sReplayItem, *e = sReplayItem + sizeof(sReplayItem) - SIZE_OFFSET - 1;
+    int n, nParts = 0;
+
+    sReplayItem[0] = '\0';
+
+//  the request call is followed by the push one (the port state is checked)
+    if( TRACE_CODE(pr->nOp) == TRACE_CALL_OUT_REQUEST ) {
+        for( ++pr; pr < pReplayEnd && ( TRACE_KIND(pr->nOp) != TRACE_EVENT || TRACE_CODE(pr->nOp) < TRACE_CALL_INIT ); pr++ ) {
+            if( pr->nOp == (TRACE_EVENT | TRACE_ITEM) )
+                pr += (pr->nDelta + sizeof(TTraceRecord) - 1) / sizeof(TTraceRecord);
+        }
+        if( pr >= pReplayEnd || pr->nOp != (TRACE_EVENT | TRACE_CALL_PUSH) )
+            return 0;
+    }
+
+    for( ++pr; pr < pReplayEnd && pr->nOp == (TRACE_EVENT | TRACE_ITEM) && nParts < REPLAY_PARTS; ) {
+        n = pr->nDelta;
+        if( n > e - p ) n = (int)(e - p);
+        if( (char *)(pr + 1) + n > (char *)pReplayEnd ) n = (int)((char *)pReplayEnd - (char *)(pr + 1));
+        memcpy( p, pr + 1, n );
+        aReplayParts[nParts].pData = p;
+        aReplayParts[nParts].nSize = n;
+        ++nParts;
+        p += n;
+        *p = '\0';
+        if( p < e ) ++p;
+        pr += 1 + (pr->nDelta + sizeof(TTraceRecord) - 1) / sizeof(TTraceRecord);
+    }
+
+    return nParts;
+}
+
+TInOptions *_replayOptions( TTraceRecord *pr, int k ) {
+//
+//  Get input request options (the arguments and delimiters item follow
+//  the max size argument).
+//
+    TInOptions *po = &aReplayOptions[k];
+    unsigned long nArg = _replayArg( pr + 2 );
+    int n;
+
+    memset( po, 0, sizeof(TInOptions) );
+    po->nMode = (int)(nArg >> 16);
+    po->nGapChars = (int)(nArg & 0xFFFF);
+    po->nCount = (int)_replayArg( pr + 4 );
+
+    pr += 7;
+    if( pr < pReplayEnd && pr->nOp == (TRACE_EVENT | TRACE_ITEM) ) {
+        n = ( pr->nDelta > REPLAY_DELIMITERS ? REPLAY_DELIMITERS : pr->nDelta );
+        if( pr + 1 + (n + sizeof(TTraceRecord) - 1) / sizeof(TTraceRecord) <= pReplayEnd ) {
+            memcpy( aReplayDelimiters[k], pr + 1, n );
+            po->sDelimiters = aReplayDelimiters[k];
+            po->nDelimiters = n;
+        }
+    }
+
+    return po;
+}
+
+void _replayCall( TTraceRecord *pr ) {
+//
+//  Make the recorded client call.
+//  ------------------------------
+//  The driver takes the call record (and its arguments) by the hook at
+//  the function entry.
+//
+    unsigned long nArg = _replayArg( pr ), nSeq;
+    int n, k;
+
+    switch( TRACE_CODE(pr->nOp) ) {
+        case TRACE_TIMEOUT:
+            nPortTimeout = ((int)pr->Value << 16) | pr->nDelta;
+            _replayAdvance();
+            break;
+        case TRACE_CALL_INIT:
+            pBInitEx( pr->Value & 1, (pr->Value >> 1) & 1, 0 );
+            break;
+        case TRACE_CALL_TERM:
+            pBTerm();
+            break;
+        case TRACE_CALL_SEND:
+            pBSend( pr->Value );
+            break;
+        case TRACE_CALL_RECEIVE:
+            pBReceive( pr->Value );
+            break;
+        case TRACE_CALL_POLL:
+            pBPoll();
+            break;
+        case TRACE_CALL_OUT_REQUEST:
+            _replayItem();
+            pBOutRequest( (char *)"%s", sReplayItem );
+            break;
+        case TRACE_CALL_PUSH:
+            _replayItem();
+            pBPush( sReplayItem, pr->Value, 0 );
+            break;
+        case TRACE_CALL_PUSHV:
+            pBPushv( aReplayParts, _replayItem() );
+            break;
+        case TRACE_CALL_IN_REQUEST:
+            n = ( nArg > REPLAY_LINE_SIZE ? REPLAY_LINE_SIZE : (int)nArg );
+            k = nReplayInput % REPLAY_INPUTS;
+            nSeq = nInSeq;
+#ifdef PB_RX_MODES
+            if( pr->Value & 2 )
+                pBInRequestEx( pr->Value & 1 ? aReplayInputs[k] : 0, n, _replayOptions(pr, k) );
+            else
+#endif
+            pBInRequest( pr->Value & 1 ? aReplayInputs[k] : 0, n );
+        //  the buffer (options) is taken by the queued request only
+            if( nInSeq != nSeq ) ++nReplayInput;
+            break;
+        case TRACE_CALL_CANCEL:
+        //  the handle is recorded back from the next number
+            nSeq = REQUEST_IS_RX(nArg) ? nInSeq : nOutSeq;
+            pBCancel( nArg == REQUEST_NONE ? REQUEST_NONE :
+                REQUEST_HANDLE( nSeq - REQUEST_SEQ(nArg), REQUEST_IS_RX(nArg) ) );
+            break;
+        case TRACE_CALL_FLUSH_TX:
+            pBFlushTx();
+            break;
+        case TRACE_CALL_FLUSH_RX:
+            pBFlushRx();
+            break;
+        case TRACE_CALL_OVERFLOW:
+            pBSetOverflow( pr->Value, (int)nArg );
+            break;
+        case TRACE_CALL_RESERVE:
+            pBReserve( (int)nArg );
+            break;
+#ifdef PB_ADAPTIVE_IRQ
+        case TRACE_CALL_ADAPTIVE:
+            pBSetAdaptive( (short)(nArg >> 16), (short)(nArg & 0xFFFF), _replayArg( pr + 2 ) );
+            break;
+#endif
+#ifdef PB_FLOW_CONTROL
+        case TRACE_CALL_FLOW:
+            pBSetFlow( pr->Value, (short)(nArg >> 16), (short)(nArg & 0xFFFF) );
+            break;
+#endif
+    }
+}
+
+// *****************************************************************************
+//  DRIVER HOOKS, REPLAY (PUBLIC)
+// *****************************************************************************
+
+unsigned char pBTraceRead( int Register ) {
+    TTraceRecord *pr = _replayCurrent();
+
+    Register &= TRACE_REGISTERS-1;
+
+    if( pr && pr->nOp == (TRACE_READ | Register) ) {
+        aReplayShadow[Register] = pr->Value;
+        ++pReplayStat->nAccesses;
+        _replayAdvance();
+    }
+    else
+        _replayMiss();
+
+    return aReplayShadow[Register];
+}
+
+void pBTraceWrite( int Register, unsigned char Value ) {
+    TTraceRecord *pr = _replayCurrent();
+
+    Register &= TRACE_REGISTERS-1;
+
+    if( pr && pr->nOp == (TRACE_WRITE | Register) ) {
+        if( pr->Value != Value ) ++pReplayStat->nDiffers;
+        ++pReplayStat->nAccesses;
+        _replayAdvance();
+    }
+    else
+        _replayMiss();
+
+    aReplayShadow[Register] = Value;
+}
+
+void pBTraceCall( int nCall, int Value ) {
+    TTraceRecord *pr;
+
+    while( (pr = _replayCurrent()) && pr->nOp == (TRACE_EVENT | TRACE_TIMEOUT) ) {
+        nPortTimeout = ((int)pr->Value << 16) | pr->nDelta;
+        _replayAdvance();
+    }
+
+    if( pr && pr->nOp == (TRACE_EVENT | nCall) ) {
+        ++pReplayStat->nCalls;
+        _replayAdvance();
+    }
+    else
+        _replayMiss();
+}
+
+void pBTraceArg( unsigned long nArg ) {
+    int i;
+
+    for( i=0; i<2; i++ ) {
+        if( _replayCurrent() && pReplay->nOp == (TRACE_EVENT | TRACE_ARG) )
+            _replayAdvance();
+    }
+}
+
+void pBTraceItem( char *pData, int nSize ) {
+    if( _replayCurrent() && pReplay->nOp == (TRACE_EVENT | TRACE_ITEM) )
+        _replayAdvance();
+    else
+        _replayMiss();
+}
+
+void pBTraceIRQ( unsigned char State ) {
+    if( _replayCurrent() && TRACE_KIND(pReplay->nOp) == TRACE_IRQ )
+        _replayAdvance();
+    else
+        _replayMiss();
+}
+
+// *****************************************************************************
+//  INTERRUPTS (HOST BUILD)
+// *****************************************************************************
+
+void DisableInt() {
+}
+
+void EnableInt() {
+}
+
+#endif
+
+// *****************************************************************************
+//  CLIENT INTERFACE (PUBLIC)
+// *****************************************************************************
+
+void pBTraceStart( void *pMemory, int nSize ) {
+//
+//  Start recording.
+//  ----------------
+//
+//  Arguments:
+//
+//      pMemory -- trace memory (image), NULL - static memory
+//
+//      nSize -- memory size (bytes).
+//
+    if( !pMemory || nSize < (int)(sizeof(TTraceHeader) + 16*sizeof(TTraceRecord)) ) {
+        pMemory = aTraceMemory;
+        nSize = sizeof(aTraceMemory);
+    }
+
+    pTrace = (TTraceHeader *)pMemory;
+    memcpy( pTrace->sMagic, TRACE_MAGIC, sizeof(pTrace->sMagic) );
+    pTrace->nOrder = TRACE_ORDER;
+    pTrace->nFlags = 0;
+    pTrace->nRecords = 0;
+
+    pTraceNext = (TTraceRecord *)(pTrace + 1);
+    pTraceEnd = pTraceNext + (nSize - sizeof(TTraceHeader)) / sizeof(TTraceRecord);
+
+    nTraceTime = _getCycles();
+    pTrace->nStart = (unsigned int)nTraceTime;
+    pTrace->nCharTime = (unsigned int)_charTime();
+    nTraceTimeout = -1;
+
+    IsTraceOn = 1;
+}
+
+int pBTraceStop() {
+    int nSize;
+
+    pBTraceImage( &nSize );
+    IsTraceOn = 0;
+
+    return nSize;
+}
+
+void *pBTraceImage( int *pSize ) {
+//
+//  Get the recorded image (header and records up to now).
+//
+    if( pTrace )
+        pTrace->nRecords = (unsigned int)(pTraceNext - (TTraceRecord *)(pTrace + 1));
+    if( pSize )
+        *pSize = pTrace ? (int)(sizeof(TTraceHeader) + pTrace->nRecords * sizeof(TTraceRecord)) : 0;
+
+    return pTrace;
+}
+
+int pBTraceSave( char *sFile ) {
+//
+//  Write the recorded image into a file.
+//
+//  Returns:
+//
+//      1/0 - successfully or not.
+//
+    FILE *f;
+    void *pImage;
+    int nSize, IsDone;
+
+    if( !(pImage = pBTraceImage(&nSize)) || !(f = fopen(sFile, "wb")) )
+        return 0;
+
+    IsDone = ( fwrite(pImage, 1, nSize, f) == (size_t)nSize ) ? 1:0;
+    fclose( f );
+
+    return IsDone;
+}
+
+void _swapTrace( TTraceHeader *ph ) {
+//
+//  Convert image of another byte order (raw item records are kept).
+//
+    TTraceRecord *pr, *pe;
+
+    ph->nOrder = SWAP16(ph->nOrder);
+    ph->nFlags = SWAP16(ph->nFlags);
+    ph->nRecords = SWAP32(ph->nRecords);
+    ph->nStart = SWAP32(ph->nStart);
+    ph->nCharTime = SWAP32(ph->nCharTime);
+
+    pr = (TTraceRecord *)(ph + 1);
+    for( pe = pr + ph->nRecords; pr < pe; pr++ ) {
+        pr->nDelta = SWAP16(pr->nDelta);
+        if( pr->nOp == (TRACE_EVENT | TRACE_ITEM) )
+            pr += (pr->nDelta + sizeof(TTraceRecord) - 1) / sizeof(TTraceRecord);
+    }
+}
+
+void *pBTraceLoad( char *sFile, int *pSize ) {
+//
+//  Read image from a file.
+//  -----------------------
+//  The image of another byte order is converted.
+//
+//  Returns:
+//
+//      Image (malloc'ed) or NULL (no file or not a trace).
+//
+    FILE *f;
+    TTraceHeader *ph = 0;
+    long nSize;
+    unsigned int nRecords;
+
+    if( !(f = fopen(sFile, "rb")) )
+        return 0;
+
+    fseek( f, 0, SEEK_END );
+    nSize = ftell( f );
+    fseek( f, 0, SEEK_SET );
+
+    if( nSize >= (long)sizeof(TTraceHeader) && (ph = (TTraceHeader *)malloc(nSize)) &&
+        fread(ph, 1, nSize, f) != (size_t)nSize ) {
+        free( ph );
+        ph = 0;
+    }
+    fclose( f );
+
+    if( !ph )
+        return 0;
+
+    if( memcmp(ph->sMagic, TRACE_MAGIC, sizeof(ph->sMagic)) ||
+        ( ph->nOrder != TRACE_ORDER && ph->nOrder != SWAP16(TRACE_ORDER) ) ) {
+        free( ph );
+        return 0;
+    }
+
+//  the records are limited by the file size (dumped memory)
+    nRecords = (unsigned int)((nSize - sizeof(TTraceHeader)) / sizeof(TTraceRecord));
+
+    if( ph->nOrder != TRACE_ORDER ) {
+        if( SWAP32(ph->nRecords) > nRecords ) ph->nRecords = SWAP32(nRecords);
+        _swapTrace( ph );
+    }
+    else if( ph->nRecords > nRecords )
+        ph->nRecords = nRecords;
+
+    if( pSize ) *pSize = (int)nSize;
+
+    return ph;
+}
+
+#ifdef PB_REGISTER_REPLAY
+
+int pBReplayRun( void *pImage, TReplayStat *pStat ) {
+//
+//  Replay the image through the driver.
+//  ------------------------------------
+//  Client calls are made as recorded, records the driver doesn't take are
+//  skipped.
+//
+//  Arguments:
+//
+//      pImage -- trace image (host byte order, see *pBTraceLoad*)
+//
+//      pStat -- results.
+//
+//  Returns:
+//
+//      1/0 - the driver went the recorded way (no misses) or not.
+//
+    TTraceHeader *ph = (TTraceHeader *)pImage;
+    TTraceRecord *pr;
+    clock_t t;
+
+    memset( pStat, 0, sizeof(TReplayStat) );
+    pReplayStat = pStat;
+
+    pReplay = (TTraceRecord *)(ph + 1);
+    pReplayEnd = pReplay + ph->nRecords;
+    pReplayDelivered = 0;
+    nReplayTime = ph->nStart;
+    nReplayCharTime = ph->nCharTime;
+    nReplayInput = 0;
+    memset( aReplayShadow, 0, sizeof(aReplayShadow) );
+
+    isr_pb = 0;
+    isr_pb_state = 0;
+
+    pStat->nRecords = ph->nRecords;
+
+    t = clock();
+
+    while( (pr = _replayCurrent()) ) {
+        if( TRACE_KIND(pr->nOp) == TRACE_EVENT )
+            _replayCall( pr );
+        if( _replayCurrent() == pr ) {
+            ++pStat->nSkipped;
+            _replayAdvance();
+        }
+    }
+
+    pStat->nSeconds = (double)(clock() - t) / CLOCKS_PER_SEC;
+    pStat->nCycles = nReplayTime - ph->nStart;
+
+    return ( pStat->nMisses || pStat->nSkipped || pStat->nDiffers ) ? 0:1;
+}
+
+unsigned long pBReplayTime() {
+    return nReplayTime;
+}
+
+unsigned long pBReplayCharTime() {
+    return nReplayCharTime;
+}
+
+#endif
+
+#ifdef PB_TRACE_REPLAY_MAIN
+
+int main( int argc, char **argv ) {
+    TTraceHeader *ph;
+    TReplayStat Stat;
+    double nSeconds = 0.;
+    int i, nSize, nRounds = REPLAY_ROUNDS, IsSame = 1;
+
+    if( argc < 2 ) {
+        printf( "usage: %s trace [rounds]\n", argv[0] );
+        return 2;
+    }
+    if( argc > 2 ) nRounds = atoi(argv[2]);
+    if( nRounds <= 0 ) nRounds = 1;
+
+    if( !(ph = (TTraceHeader *)pBTraceLoad(argv[1], &nSize)) ) {
+        printf( "*** %s is not a trace\n", argv[1] );
+        return 2;
+    }
+
+    for( i=0; i<nRounds; i++ ) {
+        IsSame &= pBReplayRun( ph, &Stat );
+        nSeconds += Stat.nSeconds;
+    }
+
+    printf( "--> PORT -B- REPLAY (%s, %d bytes%s):\n", argv[1], nSize, ph->nFlags & TRACE_TRUNCATED ? ", truncated":"" );
+    printf( "    records:        %lu\n", Stat.nRecords );
+    printf( "    calls:          %lu\n", Stat.nCalls );
+    printf( "    accesses:       %lu\n", Stat.nAccesses );
+    printf( "    interrupts:     %lu\n", Stat.nInterrupts );
+    printf( "    misses:         %lu (%lu differ, %lu skipped)\n", Stat.nMisses, Stat.nDiffers, Stat.nSkipped );
+    printf( "    recorded time:  %lu cycles\n", Stat.nCycles );
+    printf( "    host time:      %.6f s per round (%d rounds)\n", nSeconds / nRounds, nRounds );
+
+    free( ph );
+    return (IsSame ? 0:1);
+}
+
+#endif
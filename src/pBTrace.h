@@ -0,0 +1,127 @@
+#
+/*******************************************************************************
+ *  Port -B- Registers Trace (record and replay) header file
+ *  --------------------------------------------------------
+ *  Designed for BSOUK apps.
+ *
+ *  v 1.03, 15/01/2010, ichar.
+ *
+ ***/
+
+#ifndef __PBTRACE__
+#define __PBTRACE__
+
+// -----------------------------------------------------------------------------
+//  Definitions
+// -----------------------------------------------------------------------------
+
+#define TRACE_SIZE               0x10000  // default trace memory (bytes, header and records)
+#define TRACE_MAGIC              "PBT2"   // trace image signature (format version)
+#define TRACE_ORDER              0x0102   // byte order check (swapped - another endian)
+#define TRACE_TRUNCATED          0x0001   // header flag: trace memory was exhausted
+
+#define TRACE_REGISTERS          0x40     // registers area (register code bits)
+                                          // record kinds (*nOp* bits 7-6)
+#define TRACE_READ               0x00     // register read (*Value* - data)
+#define TRACE_WRITE              0x40     // register write (*Value* - data)
+#define TRACE_IRQ                0x80     // interrupt taken by the driver (*Value* - *isr_pb_state*)
+#define TRACE_EVENT              0xC0     // event (code in bits 5-0)
+#define TRACE_KIND(op)           ((op) & 0xC0)
+#define TRACE_CODE(op)           ((op) & 0x3F)
+                                          // events without time (*nDelta* - data)
+#define TRACE_TIME               0x00     // time extension, *nDelta* - high 16 bits of the next delta
+#define TRACE_ARG                0x01     // call argument, 16 bits (two records)
+#define TRACE_ITEM               0x02     // pushed data (text, part), *nDelta* - size, raw records follow
+#define TRACE_TIMEOUT            0x03     // *nPortTimeout* changed (*Value*:*nDelta*, 24 bits)
+                                          // client calls (*Value* - flags)
+#define TRACE_CALL_INIT          0x10     // pBInitEx (EIRC | EITR << 1)
+#define TRACE_CALL_TERM          0x11     // pBTerm
+#define TRACE_CALL_SEND          0x12     // pBSend (start)
+#define TRACE_CALL_RECEIVE       0x13     // pBReceive (start)
+#define TRACE_CALL_POLL          0x14     // pBPoll
+#define TRACE_CALL_OUT_REQUEST   0x15     // pBOutRequest
+#define TRACE_CALL_DEFER_REQUEST 0x16     // pBDeferRequest
+#define TRACE_CALL_PUSH          0x17     // pBPush (IsNewLine), the text follows
+#define TRACE_CALL_PUSHV         0x18     // pBPushv (parts), the parts follow
+#define TRACE_CALL_IN_REQUEST    0x19     // pBInRequest[Ex] (buffer given | options << 1), argument - max size
+                                          // (options: mode:gap, count arguments, delimiters item)
+#define TRACE_CALL_CANCEL        0x1A     // pBCancel, argument - handle back from the next number
+#define TRACE_CALL_FLUSH_TX      0x1B     // pBFlushTx
+#define TRACE_CALL_FLUSH_RX      0x1C     // pBFlushRx
+#define TRACE_CALL_OVERFLOW      0x1D     // pBSetOverflow (policy), argument - timeout
+#define TRACE_CALL_RESERVE       0x1E     // pBReserve, argument - size
+#define TRACE_CALL_ADAPTIVE      0x1F     // pBSetAdaptive, arguments - high:low, window
+#define TRACE_CALL_FLOW          0x20     // pBSetFlow (mode), argument - high:low
+
+#define REPLAY_INPUTS            64       // input request buffers of the replay
+#define REPLAY_LINE_SIZE         MAX_OUTPUT_ITEM_SIZE // input request buffer and item text size
+#define REPLAY_PARTS             16       // max parts of *pBPushv*
+#define REPLAY_DELIMITERS        16       // max delimiters of input request options
+#define REPLAY_ROUNDS            10       // default replay rounds (PB_TRACE_REPLAY_MAIN)
+
+// *****************************************************************************
+//  CLASS PROTOTYPE DECLARATIONS (INTERFACE)
+// *****************************************************************************
+
+typedef struct {                          // trace image header (records follow)
+    char  sMagic[4];                      // TRACE_MAGIC
+    unsigned short nOrder;                // TRACE_ORDER in the recorder byte order
+    unsigned short nFlags;                // TRACE_TRUNCATED
+    unsigned int   nRecords;              // records counter
+    unsigned int   nStart;                // cycles counter at the start
+    unsigned int   nCharTime;             // character time at 115200 (cycles)
+} TTraceHeader;
+
+typedef struct {                          // trace record (4 bytes)
+    unsigned char  nOp;                   // kind and register (event code)
+    unsigned char  Value;                 // register value (event flags)
+    unsigned short nDelta;                // cycles since the previous record (event data)
+} TTraceRecord;
+
+typedef struct {                          // replay results
+    unsigned long nRecords;               // records in the trace
+    unsigned long nCalls;                 // client calls replayed
+    unsigned long nAccesses;              // register accesses matched
+    unsigned long nInterrupts;            // interrupts delivered
+    unsigned long nMisses;                // driver accesses (calls) not matching the trace
+    unsigned long nDiffers;               // registers written with another value
+    unsigned long nSkipped;               // records not taken by the driver
+    unsigned long nCycles;                // recorded time (cycles)
+    double        nSeconds;               // host time of the replay
+} TReplayStat;
+//
+//  Private --------------------------------------------------------------------
+//
+int   _traceRoom          ( int );
+void  _traceTimed         ( int, int );
+void  _traceUntimed       ( int, int, unsigned int );
+TTraceRecord *_replayCurrent( void );
+void  _replayAdvance      ( void );
+void  _replayMiss         ( void );
+unsigned long _replayArg  ( TTraceRecord * );
+int   _replayItem         ( void );
+TInOptions *_replayOptions( TTraceRecord *, int );
+void  _replayCall         ( TTraceRecord * );
+void  _swapTrace          ( TTraceHeader * );
+//
+//  Public (client interface) --------------------------------------------------
+//
+void  pBTraceStart        ( void *, int );      // start recording into given (static) memory
+int   pBTraceStop         ( void );             // stop recording, returns image size
+void *pBTraceImage        ( int * );            // recorded image and its size
+int   pBTraceSave         ( char * );           // write recorded image into a file
+void *pBTraceLoad         ( char *, int * );    // read image from a file (host byte order)
+int   pBReplayRun         ( void *, TReplayStat * ); // replay image through the driver
+unsigned long pBReplayTime( void );             // replay time (recorded cycles)
+unsigned long pBReplayCharTime( void );         // recorded character time at 115200
+//
+//  Driver hooks (PB_READ, PB_WRITE and PB_TRACE_... macros) -------------------
+//
+unsigned char pBTraceRead ( int );
+void  pBTraceWrite        ( int, unsigned char );
+void  pBTraceCall         ( int, int );
+void  pBTraceArg          ( unsigned long );
+void  pBTraceItem         ( char *, int );
+void  pBTraceIRQ          ( unsigned char );
+
+#endif
@@ -31,6 +31,133 @@ void test_receiver( void );
 #include "..\common\pBExt.h"
 #include "..\common\usr.h"
 
+#include "pBCommand.h"
+
+// -----------------------------------------------------------------------------
+//  Debugger commands
+// -----------------------------------------------------------------------------
+
+int  IsExit = 0;
+
+void cmd_exit( char *s, char *args ) {
+    IsExit = 1;
+}
+
+void cmd_help( char *s, char *args ) {
+    pBPrintf( "Port -B- Controller debugger (v 1.0, 20/12/2009).\n" );
+    pBPrintf( "Use commands:\n" );
+    pBPrintf( " 'GET EITR' - print current IER state\n" );
+    pBPrintf( " 'push ...' - push output request in the controller queue\n" );
+    pBPrintf( " 'receive'  - push input request in the controller queue\n" );
+    pBPrintf( " 'regs'     - print port registers\n" );
+    pBPrintf( " 'on'       - enable IRQ\n" );
+    pBPrintf( " 'tr on'    - enable EITR IRQ\n" );
+    pBPrintf( " 'rc on'    - enable EIRC IRQ\n" );
+    pBPrintf( " 'off'      - disable IRQ\n" );
+#ifdef PB_ADAPTIVE_IRQ
+    pBPrintf( " 'auto'     - enable IRQ, polled batches under load\n" );
+#endif
+#ifdef PB_SELF_TEST
+    pBPrintf( " 'selftest' - loopback self-test and link benchmark\n" );
+#endif
+    pBPrintf( "press *Enter* to GO or checking state, another way put data of a new output request.\n" );
+}
+
+void cmd_get_eitr( char *s, char *args ) {
+    isr_pb_state = GetPortRegister(PB_IER, 1);
+}
+
+void cmd_regs( char *s, char *args ) {
+#ifdef PB_USE_LOGGER
+    logger( msg, 1, "... CNR   (0x00): %08b\n", GetPortRegister(PB_CNR, 0) );
+    logger( msg, 1, "... STATUS(0x04): %08b\n", GetPortRegister(PB_STATUS, 0) );
+    logger( msg, 1, "... IER   (0x08): %08b\n", GetPortRegister(PB_IER, 0) );
+#endif
+}
+
+void cmd_on( char *s, char *args ) {
+    pBEnableIRQ(1,1);
+    rx = GetPortRegister(PB_IER, 1);
+    isr_pb_state = 0;
+}
+
+void cmd_tr_on( char *s, char *args ) {
+    pBEnableIRQ(0,1);
+    rx = GetPortRegister(PB_IER, 1);
+    isr_pb_state = 0;
+}
+
+void cmd_rc_on( char *s, char *args ) {
+    pBEnableIRQ(1,0);
+    rx = GetPortRegister(PB_IER, 1);
+    isr_pb_state = 0;
+}
+
+void cmd_off( char *s, char *args ) {
+#ifdef PB_ADAPTIVE_IRQ
+    pBSetAdaptive(-1, 0, 0);
+#endif
+    pBDisableIRQ(0,0);
+    rx = GetPortRegister(PB_IER, 1);
+}
+
+#ifdef PB_ADAPTIVE_IRQ
+void cmd_auto( char *s, char *args ) {
+    pBEnableIRQ(1,1);
+    pBSetAdaptive(0, -1, 0);
+    rx = GetPortRegister(PB_IER, 1);
+    isr_pb_state = 0;
+}
+#endif
+
+//  an input request...
+void cmd_receive( char *s, char *args ) {
+    test_receiver();
+}
+
+//  or an output request...
+void cmd_push( char *s, char *args ) {
+    pBPush(args, 1, 1);
+}
+
+#ifdef PB_SELF_TEST
+void cmd_selftest( char *s, char *args ) {
+    int errors = pBSelfTest( 0 );
+#ifdef PB_USE_LOGGER
+    logger( msg, 1, "... SELF-TEST %s (%d)\n", errors ? "FAILED":"PASSED", errors );
+#endif
+}
+#endif
+
+void cmd_default( char *s, char *args ) {
+    test_transmitter( s );
+}
+
+TCommand aCommands[] = {
+    { "exit",          CMD_EXACT, cmd_exit     },
+    { "help",          CMD_EXACT, cmd_help     },
+    { "h",             CMD_EXACT, cmd_help     },
+    { "GET EITR",      CMD_EXACT, cmd_get_eitr },
+    { "GET REGISTERS", CMD_EXACT, cmd_regs     },
+    { "regs",          CMD_EXACT, cmd_regs     },
+    { "on",            CMD_EXACT, cmd_on       },
+    { "SET EITR ON",   CMD_EXACT, cmd_tr_on    },
+    { "tr on",         CMD_EXACT, cmd_tr_on    },
+    { "SET EIRC ON",   CMD_EXACT, cmd_rc_on    },
+    { "rc on",         CMD_EXACT, cmd_rc_on    },
+    { "off",           CMD_EXACT, cmd_off      },
+#ifdef PB_ADAPTIVE_IRQ
+    { "auto",          CMD_EXACT, cmd_auto     },
+#endif
+    { "receive",       CMD_ARGS,  cmd_receive  },
+    { "push",          CMD_ARGS,  cmd_push     },
+#ifdef PB_SELF_TEST
+    { "selftest",      CMD_EXACT, cmd_selftest },
+#endif
+};
+
+TCommandTable Commands;
+
 // *****************************************************************************
 //  PORT -B- DEBUGGER
 // *****************************************************************************
@@ -48,7 +175,10 @@ int main( int argc, char **argv, char **envp ) {
 //  initialize port -B- (no interrupts by default)
     pBInit(0, 0);
 
-    while( 1 ) {
+//  make commands table
+    pBCommandInit( &Commands, aCommands, sizeof(aCommands)/sizeof(TCommand), cmd_default );
+
+    while( !IsExit ) {
 
 #ifdef PB_USE_LOGGER
     //  start trace log
@@ -59,70 +189,12 @@ int main( int argc, char **argv, char **envp ) {
     //  get *stdin* command line
         intype(s, sizeof(s), 0);
 
-    //  commands...
-        if( strcmp(s, (char *)"exit") == 0 )
-            break;
-        else if( strcmp(s, (char *)"help") == 0 || strcmp(s, (char *)"h") == 0 ) {
-            pBPrintf( "Port -B- Controller debugger (v 1.0, 20/12/2009).\n" );
-            pBPrintf( "Use commands:\n" );
-            pBPrintf( " 'GET EITR' - print current IER state\n" );
-            pBPrintf( " 'push ...' - push output request in the controller queue\n" );
-            pBPrintf( " 'receive'  - push input request in the controller queue\n" );
-            pBPrintf( " 'regs'     - print port registers\n" );
-            pBPrintf( " 'on'       - enable IRQ\n" );
-            pBPrintf( " 'tr on'    - enable EITR IRQ\n" );
-            pBPrintf( " 'rc on'    - enable EIRC IRQ\n" );
-            pBPrintf( " 'off'      - disable IRQ\n" );
-            pBPrintf( "press *Enter* to GO or checking state, another way put data of a new output request.\n" );
-        }
-        else if( strcmp(s, (char *)"GET EITR") == 0 ) {
-            isr_pb_state = GetPortRegister(PB_IER, 1);
-        }
-        else if( strcmp(s, (char *)"GET REGISTERS") == 0 || strcmp(s, (char *)"regs") == 0 ) {
-
-#ifdef PB_USE_LOGGER
-            logger( msg, 1, "... CNR   (0x00): %08b\n", GetPortRegister(PB_CNR, 0) );
-            logger( msg, 1, "... STATUS(0x04): %08b\n", GetPortRegister(PB_STATUS, 0) );
-            logger( msg, 1, "... IER   (0x08): %08b\n", GetPortRegister(PB_IER, 0) );
-#endif
-
-        }
-        else if( strcmp(s, (char *)"on") == 0 ) {
-            pBEnableIRQ(1,1);
-            rx = GetPortRegister(PB_IER, 1);
-            isr_pb_state = 0;
-        }
-        else if( strcmp(s, (char *)"SET EITR ON") == 0 || strcmp(s, (char *)"tr on") == 0 ) {
-            pBEnableIRQ(0,1);
-            rx = GetPortRegister(PB_IER, 1);
-            isr_pb_state = 0;
-        }
-        else if( strcmp(s, (char *)"SET EIRC ON") == 0 || strcmp(s, (char *)"rc on") == 0 ) {
-            pBEnableIRQ(1,0);
-            rx = GetPortRegister(PB_IER, 1);
-            isr_pb_state = 0;
-        }
-        else if( strcmp(s, (char *)"off") == 0 ) {
-            pBDisableIRQ(0,0);
-            rx = GetPortRegister(PB_IER, 1);
-        }
-
-    //  an input request...
-        else if( strmatch(s, (char *)"receive") ) {
-            test_receiver();
-        }
-    //  or an output request...
-        else if( strmatch(s, (char *)"push") ) {
-            pBPush(&s[5], 1, 1);
-        }
-        else {
-            test_transmitter( s );
-        }
-
+    //  commands, an input/output request...
+        pBCommandDispatch( &Commands, s );
 
 #ifdef PB_USE_LOGGER
     //  print debug log
-        if( UseLogger ) logger( msg, 2, "" );
+        if( UseLogger && !IsExit ) logger( msg, 2, "" );
 #endif
     }
 
@@ -137,7 +209,7 @@ int main( int argc, char **argv, char **envp ) {
 }
 
 void test_transmitter( char *s ) {
-    int  n, code, IsError;
+    int  n, code, IsError, spins;
     int  UseEITR = 0;
 
 #ifdef DEBUG
@@ -161,7 +233,7 @@ void test_transmitter( char *s ) {
 #endif
     else {
         code = 0;
-        n = 0;
+        n = spins = 0;
 
 #ifdef DEBUG
         IsInterrupt = 0;
@@ -172,14 +244,18 @@ void test_transmitter( char *s ) {
 
         //  if interrupt's enabled, wait it ...
             if( UseEITR ) {
-                if( isr_pb == 0 ) continue;
+            //  sleep up to the interrupt after a while
+                if( isr_pb == 0 ) {
+                    n += pBIdle(&spins) - 1;
+                    continue;
+                }
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
                 logger( msg, 1, "... INTERRUPT[%d], STATUS: %08b\n", isr_pb, isr_pb_state );
 #endif
                 IsInterrupt = 1;
 #endif
-                n = 0;
+                n = spins = 0;
             }
 #ifdef GREEN
             code = OK;
@@ -205,7 +281,7 @@ void test_transmitter( char *s ) {
 
 void test_receiver() {
     char s[10];
-    int  n, code, IsError;
+    int  n, code, IsError, spins;
     int  UseEIRC = 0;
 
 #ifdef DEBUG
@@ -228,7 +304,7 @@ void test_receiver() {
 #endif
     else {
         code = 0;
-        n = 0;
+        n = spins = 0;
 
 #ifdef DEBUG
         IsInterrupt = 0;
@@ -239,14 +315,18 @@ void test_receiver() {
 
         //  if interrupt's enabled, wait it ...
             if( UseEIRC ) {
-                if( isr_pb == 0 ) continue;
+            //  sleep up to the interrupt after a while
+                if( isr_pb == 0 ) {
+                    n += pBIdle(&spins) - 1;
+                    continue;
+                }
 #ifdef DEBUG
 #ifdef PB_USE_LOGGER
                 logger( msg, 1, "... INTERRUPT[%d], STATUS: %08b\n", isr_pb, isr_pb_state );
 #endif
                 IsInterrupt = 1;
 #endif
-                n = 0;
+                n = spins = 0;
             }
 #ifdef GREEN
             code = OK;